@@ -33,6 +33,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #if defined(__cplusplus)
 extern "C" {
@@ -47,6 +48,14 @@ extern "C" {
 
   /**
    *  \brief An opaque handle for a dsv parser object
+   *
+   *  A parser object holds settings only. Each parse works from its own copy
+   *  of them, so one parser object may be used by any number of parses at
+   *  once and from any number of threads as long as it is not changed or
+   *  destroyed while they run. The exception is a parse started by
+   *  \c dsv_parser_feed, which is kept with the parser object until
+   *  \c dsv_parser_finish. A dsv_operations_t object holds the state of the
+   *  parse it is used with so each concurrent parse needs its own.
    */
   typedef struct {
     void *p;
@@ -294,6 +303,101 @@ extern "C" {
    */
   int dsv_parser_escaped_binary_fields_allowed(dsv_parser_t parser);
 
+  /**
+   *  \brief Set whether the fields passed to the header and record callbacks
+   *  may point directly into the input for future parsing with \c parser
+   *
+   *  The default setting is 0 (false)
+   *
+   *  When enabled and the input is held in memory for the whole parse, that
+   *  is, when parsing with \c dsv_parse_buffer or \c dsv_parse_file_mmap,
+   *  unquoted fields and quoted fields that contain no escaped double quote
+   *  are not copied. The field pointers passed to the callbacks refer to the
+   *  bytes of the input instead. Fields that must be assembled, such as
+   *  those containing an escaped double quote, are still copied. Other
+   *  inputs are always copied.
+   *
+   *  In either case the fields are only guaranteed to be valid until the
+   *  callback returns.
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] flag nonzero to enable, zero to disable
+   */
+  void dsv_parser_allow_zero_copy_fields(dsv_parser_t parser, int flag);
+
+  /**
+   *  \brief Query whether the fields passed to the header and record
+   *  callbacks may point directly into the input for future parsing with
+   *  \c parser
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *
+   *  \retval nonzero enabled
+   *  \retval 0 disabled
+   */
+  int dsv_parser_zero_copy_fields_allowed(dsv_parser_t parser);
+
+  /**
+   *  \brief Set the number of records after the header that are passed over
+   *  for future parsing with \c parser
+   *
+   *  The default setting is 0, no records are skipped
+   *
+   *  Skipped records are not parsed. The only content examined is the double
+   *  quotes so that a newline inside an escaped field does not end a record.
+   *  Consequently skipped records are not checked for errors or for the
+   *  number of fields, are not passed to any callback and are not tested by
+   *  any predicate. Empty records are counted. A file with a header still
+   *  has its header passed to the header callback.
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] n The number of records to skip
+   */
+  void dsv_parser_set_skip_records(dsv_parser_t parser, size_t n);
+
+  /**
+   *  \brief Get the number of records after the header that are passed over
+   *  for future parsing with \c parser
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *
+   *  \retval n The number of records skipped
+   */
+  size_t dsv_parser_get_skip_records(dsv_parser_t parser);
+
+  /**
+   *  \brief Set the maximum number of records passed on for future parsing
+   *  with \c parser
+   *
+   *  The default setting is 0, no limit
+   *
+   *  Only the records passed on to the operations count toward the limit,
+   *  that is, not the skipped records or those rejected by a predicate. Once
+   *  the limit is reached, any batched records are passed on and the parse
+   *  stops successfully without reading the rest of the input. When parsing
+   *  with \c dsv_parser_feed, input after that point is ignored.
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] n The maximum number of records or 0 for no limit
+   */
+  void dsv_parser_set_max_records(dsv_parser_t parser, size_t n);
+
+  /**
+   *  \brief Get the maximum number of records passed on for future parsing
+   *  with \c parser
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *
+   *  \retval n The maximum number of records or 0 for no limit
+   */
+  size_t dsv_parser_get_max_records(dsv_parser_t parser);
+
 
 
   /**
@@ -515,176 +619,1460 @@ extern "C" {
   void dsv_set_record_callback(record_callback_t fn, void *context, dsv_operations_t operations);
 
   /**
-   *  \brief Parse the file stream \c stream with description \location_str with
-   *  \c parser, using the operations contained in \c operations. If \c stream
-   *  is \c NULL, then attempt to open the location \location_str using fopen.
+   *  \brief This function will be called for each batch of records parsed in
+   *  the file as an alternative to \c record_callback_t.
+   *
+   *  The fields of all records in the batch are stored in flat arrays. The
+   *  fields of record \c r are \c fields[offsets[r]] through
+   *  \c fields[offsets[r+1]-1] with the respective lengths in \c lengths.
+   *  An empty record has equal successive offsets. An example method of
+   *  traversing the batch is:
+   *
+   *  for(size_t r=0; r<size; ++r) {
+   *    for(size_t i=offsets[r]; i<offsets[r+1]; ++i) {
+   *      // fields[i] and lengths[i] are field i-offsets[r] of record r
+   *    }
+   *  }
    *
+   *  The size of a batch is limited by \c dsv_set_record_batch_size and
+   *  \c dsv_set_record_batch_bytes. Any remaining records are passed on at
+   *  the end of the input or before a failed parse returns. Parsing resumes
+   *  after the callback returns and the content of \c fields is only valid
+   *  until then.
+   *
+   *  \param[in] fields An array of pointers to byte arrays each representing
+   *    a parsed field. See \c record_callback_t
+   *  \param[in] lengths An array of the lengths of the respective byte array
+   *    contained in \c fields
+   *  \param[in] offsets An array of \c size+1 values. Record \c r consists
+   *    of the fields from offsets[r] up to but not including offsets[r+1]
+   *  \param[in] size The number of records in the batch
+   *  \param[in] context A user-defined value associted with this callback set
+   *  in \c dsv_set_record_batch_callback
    *
+   *  \retval nonzero if procssing should continue or 0 if processing should
+   *  cease and control should return from the parse function.
+   */
+  typedef int (*record_batch_callback_t)(const unsigned char *fields[],
+    const size_t lengths[], const size_t offsets[], size_t size,
+    void *context);
 
-   *  If the location_str begins with the '/' character, then the file is
-   *  understood to be an absolute path starting at the root directory. If the
-   *  filename does not begin with a '/' character, the file is understood to
-   *  be relative to the current working directory. In either case any
-   *  additional relative file inclusion mechanism will be relative to the
-   *  directory that holds the input file.
+  /**
+   *  \brief Obtain the callback currently set for batches of records
    *
-   *  If unable to successfully parse 'filename' a negative value will be
-   *  returned and the reason can be obtained by \c dsv_parse_error.
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
    *
-   *  Warnings or information about non-implemented features will return success
-   *  and be reported via \c dsv_parse_error.
+   *  \retval 0 No callback is registered
+   *  \retval nonzero The currently registered callback
+   */
+  record_batch_callback_t
+    dsv_get_record_batch_callback(dsv_operations_t operations);
+
+  /**
+   *  \brief Obtain the user-defined context currently set for batches of
+   *  records
    *
-   *  \param[in] location_str \parblock
-   *    A null-terminated byte string (NTBS) that is used to identify and
-   *    potentially locate the content to be parsed. Regardless of how the value
-   *    is used to initiate parsing, it is supplied as a reference value for
-   *    logging messages. See \c dsv_log_code.
-   *      - If the \c stream parameter is zero, the \c location_str parameter is
-   *        taken to mean the location of a file to be opened and parsed. If the
-   *        location_str begins with the '/' character, then the file is
-   *        understood to be an absolute path starting at the root directory. If
-   *        the filename does not begin with a '/' character, the file is
-   *        understood to be relative to the current working directory. The
-   *        parse function will open the file for reading and parse the
-   *        contents.
-   *      - If the \c stream parameter is non-zero, the \c location_str
-   *        parameter is not referenced and simply sued as an identifier for log
-   *        messages.
-   *  \endparblock
-   *  \param[in] stream \parblock
-   *    - If nonzero, the value is assumed to be a valid file stream opened for
-   *      reading and the content will be parsed. \c dsv_parse does not close
-   *      the stream when finished.
-   *    - If zero, \c dsv_parse will attempt to use the value of \c location_str
-   *      to open a file location for parsing.
-   *  \endparblock
-   *  \param[in] parser A pointer to a dsv_parser_t object previously
-   *    initialized with one of the \c dsv_parser_create* functions
    *  \param[in] operations A pointer to a dsv_operations_t object previously
    *    initialized with \c dsv_operations_create
    *
-   *  \retval 0 success
-   *  \retval ENOMEM out of memory
-   *  \retval >0 Any error code returned by fopen
-   *  \retval <0 failure, see dsv_parse_error
+   *  \retval 0 No context is registered
+   *  \retval nonzero The currently registered context
    */
-  int dsv_parse(const char *location_str, FILE *stream, dsv_parser_t parser,
-                dsv_operations_t operations);
+  void * dsv_get_record_batch_context(dsv_operations_t operations);
 
+  /**
+   *  \brief Associate the batch callback \c fn and a user-specified value
+   *  \c context with \c operation.
+   *
+   *  While a batch callback is registered, records are only passed to it and
+   *  the callback set with \c dsv_set_record_callback is not called. Pass a
+   *  \c fn of 0 to return to calling the record callback for each record.
+   *
+   *  \param[in] fn A function pointer conforming to
+   *    \c record_batch_callback_t
+   *  \param[in] context A user defined pointer to be supplied in future
+   *    calls to \c fn
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   */
+  void dsv_set_record_batch_callback(record_batch_callback_t fn,
+    void *context, dsv_operations_t operations);
 
   /**
-   *  \brief Logging levels for parser messages
+   *  \brief Obtain the maximum number of records in a batch
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval The maximum number of records or 0 if unlimited
    */
-  typedef enum {
-    dsv_log_none = 0,
-    dsv_log_error = 1L,
-    dsv_log_warning = (1L << 1),
-    dsv_log_info = (1L << 2),
-    dsv_log_debug = (1L << 3),
-    dsv_log_all = (dsv_log_error|dsv_log_warning|dsv_log_info|dsv_log_debug)
-  } dsv_log_level;
+  size_t dsv_get_record_batch_size(dsv_operations_t operations);
 
   /**
-   *  \brief Logging message codes
+   *  \brief Set the maximum number of records in a batch. The default is
+   *  1024.
+   *
+   *  \param[in] records The maximum number of records passed to the batch
+   *    callback at once or 0 for no limit
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
    */
-  typedef enum {
-    /**
-     *  \brief An error strictly associated with incorrect syntax based on the
-     *  current parser behavior.
-     *
-     *  This log code has the following parameters:
-     *    - The offending line associated with the start of the syntax
-     *      error[*][**]
-     *    - The offending line associated with the end of the syntax
-     *      error[*][**]
-     *    - The offending character associated with the start of the syntax
-     *      error[*]
-     *    - The offending character associated with the end of the syntax
-     *      error[*]
-     *    - The location_str associated with the syntax error if it was supplied
-     *      to \c dsv_parse
-     *
-     *  [*] Numbers provided as a string are capable of being translated to
-     *  a signed or unsigned integer value (ie strtoul).
-     *
-     *  [**] The line associated with the log is counted according to the
-     *  applied parser behavior. For example, if the system newline is LF and
-     *  the applied behavior is RFC4180-strict, then the lines will be counted
-     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
-     *  the lines will be counted based on the first parsed occurrence of a
-     *  newline. Note that this is different than the first seen occurence of a
-     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
-     *  quoted field and not a newline therefore the registered newline behavior
-     *  will be the CRLF.
-    */
-    dsv_syntax_error,
+  void dsv_set_record_batch_size(size_t records, dsv_operations_t operations);
 
-    /**
-     *  \brief An error strictly associated with parsing a non-uniform number of
-     *  fields when explicitly requested to do so. For example, if the header
-     *  contains 5 fields but the first record only contains 3.
-     *
-     *  This log code has the following parameters:
-     *    - The line number associated with the start of the offending
-     *      row[*][**]
-     *    - The line number associated with the end of the offending row[*][**]
-     *    - The expected number of fields[*]
-     *    - The number of fields parsed for this row[*]
-     *    - The location_str associated with the syntax error if it was supplied
-     *      to \c dsv_parse
-     *
-     *  [*] Numbers provided as a string are capable of being translated to
-     *  a signed or unsigned integer value (ie strtoul).
-     *
-     *  [**] The line associated with the log is counted according to the
-     *  applied parser behavior. For example, if the system newline is LF and
-     *  the applied behavior is RFC4180-strict, then the lines will be counted
-     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
-     *  the lines will be counted based on the first parsed occurrence of a
-     *  newline. Note that this is different than the first seen occurence of a
-     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
-     *  quoted field and not a newline therefore the registered newline behavior
-     *  will be the CRLF.
-    */
-    dsv_inconsistant_column_count,
+  /**
+   *  \brief Obtain the field byte budget of a batch
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval The byte budget or 0 if unlimited
+   */
+  size_t dsv_get_record_batch_bytes(dsv_operations_t operations);
 
-    /**
-     *  \brief An message associated with settings that prohibit non-ASCII
-     *  characters appearing in quoted fields. This error is also thrown if a
-     *  invalid newline representation appears in RFC4180-strict mode.
-     *
-     *  This log code has the following parameters:
-     *    - The offending line associated with the start of the syntax
-     *      error[*][**]
-     *    - The offending line associated with the end of the syntax
-     *      error[*][**]
-     *    - The offending character associated with the start of the syntax
-     *      error[*]
-     *    - The offending character associated with the end of the syntax
-     *      error[*]
-     *    - A byte-oriented string containing the hexadecimal representation of
-     *      the offending binary content.[***]
-     *    - The location_str associated with the syntax error if it was supplied
-     *      to \c dsv_parse
-     *
-     *  [*] Numbers provided as a string are capable of being translated to
-     *  a signed or unsigned integer value (ie strtoul).
-     *
-     *  [**] The line associated with the log is counted according to the
-     *  applied parser behavior. For example, if the system newline is LF and
-     *  the applied behavior is RFC4180-strict, then the lines will be counted
-     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
-     *  the lines will be counted based on the first parsed occurrence of a
-     *  newline. Note that this is different than the first seen occurence of a
-     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
-     *  quoted field and not a newline therefore the registered newline behavior
-     *  will be the CRLF.
-     *
-     *  [***] Each byte of the hexadecimal representation of binary content is
-     *  prefixed by a '0x' and therefore is capable of being translated to a
-     *  signed or unsigned integer value (ie strtol and family).
+  /**
+   *  \brief Set the field byte budget of a batch. The default is 1MiB.
+   *
+   *  A batch is passed on as soon as the total length of its fields reaches
+   *  \c bytes. The content of the pending records is held by the parser so
+   *  this bounds the memory used for batching. Wide records can make a
+   *  batch exceed the budget by up to one record.
+   *
+   *  \param[in] bytes The byte budget or 0 for no limit
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   */
+  void dsv_set_record_batch_bytes(size_t bytes, dsv_operations_t operations);
+
+  /**
+   *  \brief The values of one column of a column batch
+   *
+   *  The values are stored back to back in \c data. The value of row \c r
+   *  is the bytes from \c data+offsets[r] up to but not including
+   *  \c data+offsets[r+1]. This is the layout of the Arrow variable-length
+   *  binary type with 64-bit offsets.
+   */
+  typedef struct {
+    const unsigned char *data;
+    const int64_t *offsets;
+  } dsv_column_t;
+
+  /**
+   *  \brief This function will be called for each batch of records parsed
+   *  in the file as an alternative to \c record_callback_t with the fields
+   *  arranged by column.
+   *
+   *  Field \c i of each record is appended to column \c i as it is parsed.
+   *  The number of columns is the largest number of fields in any record
+   *  seen so far in the parse. A record with fewer fields, including an
+   *  empty record, has empty values in the remaining columns and a column
+   *  first seen in a later record has empty values in the preceding rows.
+   *  Columns are never removed during a parse so each batch has at least as
+   *  many columns as the one before.
+   *
+   *  The number of rows in a batch is limited by
+   *  \c dsv_set_record_batch_size and \c dsv_set_record_batch_bytes. Any
+   *  remaining rows are passed on at the end of the input or before a failed
+   *  parse returns. Parsing resumes after the callback returns and the
+   *  content of \c columns is only valid until then.
+   *
+   *  \param[in] columns An array of \c size columns each holding \c rows
+   *    values
+   *  \param[in] size The number of columns
+   *  \param[in] rows The number of rows in the batch
+   *  \param[in] context A user-defined value associted with this callback set
+   *  in \c dsv_set_column_batch_callback
+   *
+   *  \retval nonzero if procssing should continue or 0 if processing should
+   *  cease and control should return from the parse function.
+   */
+  typedef int (*column_batch_callback_t)(const dsv_column_t columns[],
+    size_t size, size_t rows, void *context);
+
+  /**
+   *  \brief Obtain the callback currently set for column batches
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 No callback is registered
+   *  \retval nonzero The currently registered callback
+   */
+  column_batch_callback_t
+    dsv_get_column_batch_callback(dsv_operations_t operations);
+
+  /**
+   *  \brief Obtain the user-defined context currently set for column batches
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 No context is registered
+   *  \retval nonzero The currently registered context
+   */
+  void * dsv_get_column_batch_context(dsv_operations_t operations);
+
+  /**
+   *  \brief Associate the column batch callback \c fn and a user-specified
+   *  value \c context with \c operation.
+   *
+   *  While a column batch callback is registered, records are only passed to
+   *  it and neither the record callback nor the record batch callback is
+   *  called. Pass a \c fn of 0 to stop.
+   *
+   *  \param[in] fn A function pointer conforming to
+   *    \c column_batch_callback_t
+   *  \param[in] context A user defined pointer to be supplied in future
+   *    calls to \c fn
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   */
+  void dsv_set_column_batch_callback(column_batch_callback_t fn,
+    void *context, dsv_operations_t operations);
+
+  /**
+   *  \brief Pass only the columns \c cols to the callbacks of
+   *  \c operations.
+   *
+   *  Field \c i of the header and of each record passed to any callback is
+   *  field \c cols[i] of the parsed row. A column may be selected more than
+   *  once and a column beyond the end of a row is passed as an empty field.
+   *  Empty records are still passed with no fields. The content of fields
+   *  that are not selected is only scanned for the end of the field, it is
+   *  neither copied nor kept.
+   *
+   *  The whole row is still parsed and checked. For example, column counts
+   *  refer to all of the fields of a row.
+   *
+   *  Replaces any projection set by name. Pass an \c n of 0 to pass all
+   *  columns [DEFAULT].
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] cols The zero-based columns to pass on in the order they are
+   *    passed on
+   *  \param[in] n The number of values in \c cols
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_set_projection(dsv_operations_t operations,
+    const size_t *cols, size_t n);
+
+  /**
+   *  \brief Pass only the columns named \c names in the header to the
+   *  callbacks of \c operations.
+   *
+   *  The names are looked up in the header of each parse and the result is
+   *  the same as passing their columns to \c dsv_operations_set_projection.
+   *  A name matches a header field with exactly the same bytes. If a header
+   *  contains the same name more than once, the first is used. If a name is
+   *  not in the header, \c dsv_unknown_column is logged as an error and the
+   *  parse fails.
+   *
+   *  Replaces any projection set by column number. Pass an \c n of 0 to
+   *  pass all columns.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] names Null-terminated column names in the order the columns
+   *    are passed on
+   *  \param[in] n The number of values in \c names
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_set_projection_names(dsv_operations_t operations,
+    const char * const names[], size_t n);
+
+  /**
+   *  \brief Only pass on records whose field in column \c col is exactly
+   *  the \c len bytes at \c value.
+   *
+   *  Predicates are checked as soon as the field they refer to is parsed.
+   *  Once a field fails, the content of the remaining fields of the record is
+   *  only scanned for the end of the record and the record is not passed to
+   *  any callback. A record must pass all predicates to be passed on. Columns
+   *  refer to all fields of the parsed row regardless of any projection and
+   *  a field beyond the end of a row, including all fields of an empty
+   *  record, is checked as an empty field. The header is never filtered.
+   *
+   *  Rows that are dropped are still parsed and checked. For example, an
+   *  inconsistent column count is still reported.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] col The zero-based column to check
+   *  \param[in] value The bytes the field must equal. Copied.
+   *  \param[in] len The number of bytes at \c value
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_add_predicate_equal(dsv_operations_t operations,
+    size_t col, const unsigned char *value, size_t len);
+
+  /**
+   *  \brief Only pass on records whose field in column \c col begins with
+   *  the \c len bytes at \c prefix.
+   *
+   *  See \c dsv_operations_add_predicate_equal for how predicates are
+   *  applied.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] col The zero-based column to check
+   *  \param[in] prefix The bytes the field must begin with. Copied.
+   *  \param[in] len The number of bytes at \c prefix
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_add_predicate_prefix(dsv_operations_t operations,
+    size_t col, const unsigned char *prefix, size_t len);
+
+  /**
+   *  \brief Only pass on records whose field in column \c col is a number
+   *  in the closed range [\c min, \c max].
+   *
+   *  The whole field must be a plain decimal number: an optional sign,
+   *  digits with an optional fraction and an optional exponent, such as
+   *  \c -3, \c 2.5 or \c 1e2. The decimal point is always '.' whatever
+   *  the locale. Fields that are empty, hold whitespace, \c inf, \c nan,
+   *  a hexadecimal number or anything else fail. See
+   *  \c dsv_operations_add_predicate_equal for how predicates are applied.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] col The zero-based column to check
+   *  \param[in] min The smallest accepted value
+   *  \param[in] max The largest accepted value
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_add_predicate_range(dsv_operations_t operations,
+    size_t col, double min, double max);
+
+  /**
+   *  \brief Remove all predicates from \c operations so that all records
+   *  are passed on [DEFAULT].
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   */
+  void dsv_operations_clear_predicates(dsv_operations_t operations);
+
+  /**
+   *  \brief This function will be called with each record of a partitioned
+   *  parse and the partition it belongs to. See
+   *  \c dsv_operations_set_partitions.
+   *
+   *  \param[in] partition The zero-based partition of the record
+   *  \param[in] fields The fields of the record as with \c record_callback_t
+   *  \param[in] lengths The lengths of the fields as with
+   *    \c record_callback_t
+   *  \param[in] size The size of the field and length array
+   *  \param[in] context A user-defined value associated with this callback
+   *    in \c dsv_operations_set_partitions
+   *
+   *  \retval nonzero if processing should continue or 0 if processing should
+   *  cease and control should return from the parse function. If 0 is
+   *  returned, the parse function will also return <0
+   */
+  typedef int (*partition_callback_t)(size_t partition,
+    const unsigned char *fields[], const size_t lengths[], size_t size,
+    void *context);
+
+  /**
+   *  \brief Route each record to one of \c partitions partitions by a hash
+   *  of the fields of the columns \c keys and pass it to \c fn rather than
+   *  to the record callbacks of \c operations.
+   *
+   *  Records with equal key fields always go to the same partition. The key
+   *  columns refer to the records as they are passed on, that is after any
+   *  projection, and a missing key field is hashed as an empty field. The
+   *  records are filtered by any predicates first. The header is still
+   *  passed to the header callback. The record, record batch and column
+   *  batch callbacks are not called while partitioning.
+   *
+   *  Replaces any partitioning set before, including partition files.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] keys The zero-based columns of the key
+   *  \param[in] n The number of values in \c keys, at least 1
+   *  \param[in] partitions The number of partitions, at least 1
+   *  \param[in] fn A function pointer conforming to \c partition_callback_t
+   *  \param[in] context A user defined pointer to be supplied in future
+   *    calls to \c fn
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_set_partitions(dsv_operations_t operations,
+    const size_t keys[], size_t n, size_t partitions, partition_callback_t fn,
+    void *context);
+
+  /**
+   *  \brief Route each record as with \c dsv_operations_set_partitions but
+   *  write partition \c i to \c files[i] rather than passing it to a
+   *  callback.
+   *
+   *  Each record is written as a line of fields separated by \c delimiter
+   *  and ended by CRLF. Fields that hold the delimiter, a DQUOTE, a CR or an
+   *  LF are escaped as described by RFC 4180. The first header passed on
+   *  after the files are set is written at the start of every file as well
+   *  as being passed to the header callback, so several inputs parsed one
+   *  after another into the same files leave a single header. The files are
+   *  not flushed or closed. A failed write ends the parse, which returns the
+   *  errno value of the write or EIO.
+   *
+   *  The files are written from the thread passing on the records. With
+   *  \c dsv_parse_dispatched and \c dsv_parse_many, the workers or files
+   *  share the files: the header is still written once and each line is
+   *  written whole, but the records of different workers or files may be
+   *  interleaved unless the files are passed on in order.
+   *
+   *  Replaces any partitioning set before.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] keys The zero-based columns of the key
+   *  \param[in] n The number of values in \c keys, at least 1
+   *  \param[in] files An array of \c partitions file streams opened for
+   *    writing. They must remain valid while \c operations is used
+   *  \param[in] partitions The number of partitions, at least 1
+   *  \param[in] delimiter The field delimiter to write
+   *
+   *  \retval 0 Success
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_operations_set_partition_files(dsv_operations_t operations,
+    const size_t keys[], size_t n, FILE * const files[], size_t partitions,
+    unsigned char delimiter);
+
+  /**
+   *  \brief Stop partitioning so that records are passed to the record
+   *  callbacks of \c operations [DEFAULT].
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   */
+  void dsv_operations_clear_partitions(dsv_operations_t operations);
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+  /**
+   *  \brief The schema structure of the Arrow C Data Interface. See the
+   *  Arrow documentation for the definition.
+   */
+  struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+  };
+
+  /**
+   *  \brief The array structure of the Arrow C Data Interface. See the
+   *  Arrow documentation for the definition.
+   */
+  struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+  };
+
+#endif
+
+  /**
+   *  \brief The Arrow type of exported columns
+   */
+  typedef enum {
+    /** Large UTF-8 strings (format "U"). The field bytes are not validated
+     *  so this is only correct for UTF-8 or ASCII input.
+     */
+    dsv_arrow_large_utf8 = 0,
+
+    /** Large binary (format "Z") */
+    dsv_arrow_large_binary = 1
+  } dsv_arrow_type;
+
+  /**
+   *  \brief Export the column batch currently being passed to the column
+   *  batch callback of \c operations through the Arrow C Data Interface.
+   *
+   *  Must only be called from within the column batch callback. The result
+   *  is a struct array (format "+s") with one child per column. Each child
+   *  is of type \c type and has no nulls. The children are named after the
+   *  fields of the header if one was parsed and the column number otherwise.
+   *
+   *  The value and offset buffers of the batch are moved into \c array
+   *  rather than copied. The pointers in the \c columns argument of the
+   *  callback remain valid until \c array is released but the parser
+   *  allocates new buffers for the next batch. A batch can only be exported
+   *  once.
+   *
+   *  Both \c schema and \c array must be released by the caller through
+   *  their release callbacks. They are independent of each other and of the
+   *  parser and children can be moved out and released separately as
+   *  specified by the interface.
+   *
+   *  \param[in] operations A pointer to a dsv_operations_t object whose
+   *    column batch callback is currently running
+   *  \param[in] type The type of the exported columns
+   *  \param[out] schema The schema of the batch
+   *  \param[out] array The content of the batch
+   *
+   *  \retval 0 Success
+   *  \retval EINVAL No column batch is being passed on or it was already
+   *    exported
+   *  \retval ENOMEM Out of memory
+   */
+  int dsv_column_batch_export(dsv_operations_t operations, dsv_arrow_type type,
+    struct ArrowSchema *schema, struct ArrowArray *array);
+
+  /**
+   *  \brief Parse the file stream \c stream with description \location_str with
+   *  \c parser, using the operations contained in \c operations. If \c stream
+   *  is \c NULL, then attempt to open the location \location_str using fopen.
+   *
+   *
+
+   *  If the location_str begins with the '/' character, then the file is
+   *  understood to be an absolute path starting at the root directory. If the
+   *  filename does not begin with a '/' character, the file is understood to
+   *  be relative to the current working directory. In either case any
+   *  additional relative file inclusion mechanism will be relative to the
+   *  directory that holds the input file.
+   *
+   *  If unable to successfully parse 'filename' a negative value will be
+   *  returned and the reason can be obtained by \c dsv_parse_error.
+   *
+   *  Warnings or information about non-implemented features will return success
+   *  and be reported via \c dsv_parse_error.
+   *
+   *  \param[in] location_str \parblock
+   *    A null-terminated byte string (NTBS) that is used to identify and
+   *    potentially locate the content to be parsed. Regardless of how the value
+   *    is used to initiate parsing, it is supplied as a reference value for
+   *    logging messages. See \c dsv_log_code.
+   *      - If the \c stream parameter is zero, the \c location_str parameter is
+   *        taken to mean the location of a file to be opened and parsed. If the
+   *        location_str begins with the '/' character, then the file is
+   *        understood to be an absolute path starting at the root directory. If
+   *        the filename does not begin with a '/' character, the file is
+   *        understood to be relative to the current working directory. The
+   *        parse function will open the file for reading and parse the
+   *        contents.
+   *      - If the \c stream parameter is non-zero, the \c location_str
+   *        parameter is not referenced and simply sued as an identifier for log
+   *        messages.
+   *  \endparblock
+   *  \param[in] stream \parblock
+   *    - If nonzero, the value is assumed to be a valid file stream opened for
+   *      reading and the content will be parsed. \c dsv_parse does not close
+   *      the stream when finished.
+   *    - If zero, \c dsv_parse will attempt to use the value of \c location_str
+   *      to open a file location for parsing.
+   *  \endparblock
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval >0 Any error code returned by fopen
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse(const char *location_str, FILE *stream, dsv_parser_t parser,
+                dsv_operations_t operations);
+
+  /**
+   *  \brief Parse the file stream \c stream or the file at \c location_str
+   *  as \c dsv_parse does but with reading, parsing and passing on the
+   *  records overlapped.
+   *
+   *  A thread reads the stream in large blocks ahead of a second thread that
+   *  parses them, which in turn collects the records in batches ahead of
+   *  the calling thread passing them on. This is useful when reading may
+   *  stall, as with network storage or pipes, or when the callbacks do
+   *  substantial work. All callbacks, including the logger, are called only
+   *  from the calling thread and never concurrently. They receive the same
+   *  records and messages as with \c dsv_parse except that a record batch
+   *  or column batch may end early where a batch of the parsing thread ends.
+   *
+   *  \param[in] location_str A null-terminated byte string (NTBS) used as
+   *    with \c dsv_parse
+   *  \param[in] stream Zero or a file stream as with \c dsv_parse
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EAGAIN the threads could not be started
+   *  \retval >0 Any error code returned by fopen or when reading the stream
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_pipelined(const char *location_str, FILE *stream,
+    dsv_parser_t parser, dsv_operations_t operations);
+
+  /**
+   *  \brief Flags controlling how \c dsv_parse_dispatched chooses the worker
+   *  for each record
+   */
+  typedef enum {
+    /** Give the records to the workers in turn [DEFAULT] */
+    dsv_dispatch_round_robin = 0,
+
+    /** Give each record to the worker chosen by a hash of its key field so
+     *  that records with equal keys always go to the same worker
+     */
+    dsv_dispatch_by_key = 1
+  } dsv_dispatch_flags;
+
+  /**
+   *  \brief Parse the file stream \c stream or the file at \c location_str
+   *  as \c dsv_parse does but pass the records on from \c workers worker
+   *  threads.
+   *
+   *  The content is parsed by the calling thread and each record is given
+   *  to one of the workers, which passes it on with the callbacks of
+   *  \c operations. This is useful when the callbacks do substantial work.
+   *  If \c contexts is not null, \c contexts[i] replaces the header, record,
+   *  record batch, column batch and partition contexts of \c operations for
+   *  worker \c i.
+   *
+   *  The callbacks of one worker are never called concurrently and a worker
+   *  receives its records in the order of the content, but the callbacks of
+   *  different workers are called concurrently. Every worker receives the
+   *  header before its first record. The logger is called from the calling
+   *  thread as the content is parsed. The records are collected in small
+   *  batches for each worker so a record batch or column batch may end
+   *  early. Once a callback asks to stop, the parse stops and records
+   *  already given to other workers may still be passed on.
+   *
+   *  \param[in] location_str A null-terminated byte string (NTBS) used as
+   *    with \c dsv_parse
+   *  \param[in] stream Zero or a file stream as with \c dsv_parse
+   *  \param[in] workers The number of worker threads, at least 1
+   *  \param[in] flags One of the \c dsv_dispatch_flags values
+   *  \param[in] key_column With \c dsv_dispatch_by_key, the column of the
+   *    key field in the records as they are passed on, that is after any
+   *    projection. A missing key field is hashed as an empty field
+   *  \param[in] contexts Null or an array of \c workers contexts
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EAGAIN the worker threads could not be started
+   *  \retval >0 Any error code returned by fopen
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_dispatched(const char *location_str, FILE *stream,
+    size_t workers, int flags, size_t key_column, void * const contexts[],
+    dsv_parser_t parser, dsv_operations_t operations);
+
+  /**
+   *  \brief Count the records and fields of the content in \c stream or at
+   *  \c location_str as it would be parsed with \c parser without parsing it
+   *
+   *  Only the double quotes, delimiters and newlines are examined, following
+   *  the delimiter, newline behavior and escaped binary field settings of
+   *  \c parser. This is far cheaper than a parse with no callbacks and is
+   *  intended for sizing buffers or reporting progress. Since the content is
+   *  not parsed, it is not checked for errors and nothing is logged. The
+   *  counts of malformed content are unspecified.
+   *
+   *  The header is not counted. An empty record is counted as a record with
+   *  no fields. Records to skip and the maximum number of records are not
+   *  applied.
+   *
+   *  \param[in] location_str \parblock
+   *    As for \c dsv_parse
+   *  \endparblock
+   *  \param[in] stream \parblock
+   *    As for \c dsv_parse
+   *  \endparblock
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[out] records If nonzero, set to the number of records following
+   *    the header
+   *  \param[out] fields If nonzero, set to the total number of fields in
+   *    those records
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval >0 Any error code returned by fopen or fread
+   */
+  int dsv_count_records(const char *location_str, FILE *stream,
+    dsv_parser_t parser, size_t *records, size_t *fields);
+
+  /**
+   *  \brief Flags controlling how \c dsv_validate reports errors
+   */
+  typedef enum {
+    /** Stop at the first error [DEFAULT] */
+    dsv_validate_default = 0,
+
+    /** Report every error. After an error, the rest of the offending record
+     *  is passed over and checking resumes with the next record.
+     */
+    dsv_validate_all_errors = 1
+  } dsv_validate_flags;
+
+  /**
+   *  \brief Check the content in \c stream or at \c location_str with
+   *  \c parser without passing on any fields
+   *
+   *  The content is checked exactly as \c dsv_parse would, including the
+   *  syntax, the number of fields of each record and binary content in
+   *  fields, and errors and warnings are reported through the logger of
+   *  \c parser in the same way. No field content is kept so this is
+   *  considerably cheaper than a parse. Records to skip and the maximum
+   *  number of records are not applied.
+   *
+   *  As with \c dsv_parse, if the logger returns zero for a warning, the
+   *  check stops and fails.
+   *
+   *  The passed over content of a record with an error is located as by
+   *  \c dsv_count_records. Its errors, if any, are not reported.
+   *
+   *  \param[in] location_str \parblock
+   *    As for \c dsv_parse
+   *  \endparblock
+   *  \param[in] stream \parblock
+   *    As for \c dsv_parse
+   *  \endparblock
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] flags A bitwise OR of \c dsv_validate_flags values
+   *
+   *  \retval 0 the content is valid
+   *  \retval ENOMEM out of memory
+   *  \retval >0 Any error code returned by fopen or fread
+   *  \retval <0 the content is not valid or the logger stopped the check
+   */
+  int dsv_validate(const char *location_str, FILE *stream, dsv_parser_t parser,
+    int flags);
+
+  /**
+   *  \brief Parse the \c len bytes at \c data with \c parser, using the
+   *  operations contained in \c operations.
+   *
+   *  The parse is otherwise identical to \c dsv_parse. The bytes are scanned
+   *  in place and are neither copied nor modified. This avoids wrapping
+   *  content that is already held in memory in a stream.
+   *
+   *  \param[in] location_str \parblock
+   *    A null-terminated byte string (NTBS) used to identify the content in
+   *    logging messages. See \c dsv_log_code. May be zero.
+   *  \endparblock
+   *  \param[in] data The content to be parsed. The memory must remain valid
+   *    until \c dsv_parse_buffer returns. May be zero if \c len is zero.
+   *  \param[in] len The number of bytes at \c data
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_buffer(const char *location_str, const unsigned char *data,
+    size_t len, dsv_parser_t parser, dsv_operations_t operations);
+
+  /**
+   *  \brief Flags controlling how \c dsv_parse_file_mmap maps its input
+   */
+  typedef enum {
+    /** Map the file read-only with sequential access advice [DEFAULT] */
+    dsv_mmap_default = 0,
+
+    /** Additionally request transparent huge pages for the mapping where the
+     *  platform supports it. This is advisory only and silently ignored
+     *  otherwise.
+     */
+    dsv_mmap_huge_pages = 1
+  } dsv_mmap_flags;
+
+  /**
+   *  \brief Parse the file \c filename by mapping it into memory with
+   *  \c parser, using the operations contained in \c operations.
+   *
+   *  The parse is otherwise identical to \c dsv_parse. The contents of a
+   *  regular file are scanned in place rather than copied through a stream
+   *  buffer which is considerably cheaper for large files. If \c filename
+   *  does not refer to a regular file (for example a pipe or a device) or the
+   *  file cannot be mapped, the file is parsed through a stream as if by
+   *  \c dsv_parse.
+   *
+   *  \note The file must not be truncated while it is being parsed. Doing so
+   *  will typically terminate the process with SIGBUS.
+   *
+   *  \param[in] filename \parblock
+   *    A null-terminated byte string (NTBS) naming the file to be parsed. The
+   *    value is also supplied as the location for logging messages. See
+   *    \c dsv_log_code.
+   *  \endparblock
+   *  \param[in] flags A bitwise OR of \c dsv_mmap_flags values
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval >0 Any error code returned by open or fstat
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_file_mmap(const char *filename, int flags, dsv_parser_t parser,
+    dsv_operations_t operations);
+
+  /**
+   *  \brief Flags controlling how \c dsv_parse_file_parallel passes on
+   *  records
+   */
+  typedef enum {
+    /** Pass on records in the order of the file [DEFAULT] */
+    dsv_parallel_ordered = 0,
+
+    /** Pass on each part of the file as soon as it is parsed. The records of
+     *  a part remain in order but the parts may not be.
+     */
+    dsv_parallel_unordered = 1
+  } dsv_parallel_flags;
+
+  /**
+   *  \brief Parse the file \c filename with \c threads threads using the
+   *  settings of \c parser and the operations contained in \c operations.
+   *
+   *  The file is mapped into memory as by \c dsv_parse_file_mmap and the
+   *  header is parsed first. The remainder is divided into parts that end at
+   *  record boundaries, following the double quotes so that a newline in an
+   *  escaped field never divides a record, and the parts are parsed
+   *  concurrently. All callbacks, including the logger, are called only from
+   *  the calling thread and never concurrently. They receive the same
+   *  records and messages as with \c dsv_parse except that:
+   *    - With \c dsv_parallel_unordered, the parts may be passed on in any
+   *      order
+   *    - A record batch or column batch never spans two parts
+   *    - On a failure, the records of the failing part that precede it are
+   *      passed on and no records of later parts are
+   *
+   *  Records to skip are passed over before the parts are formed. The
+   *  maximum number of records applies to the records in the order they are
+   *  passed on. Once it is reached, the remaining parts are abandoned.
+   *
+   *  If \c filename does not refer to a regular file or the file cannot be
+   *  mapped, it is parsed as by \c dsv_parse with a single thread.
+   *
+   *  \param[in] filename \parblock
+   *    A null-terminated byte string (NTBS) naming the file to be parsed. The
+   *    value is also supplied as the location for logging messages. See
+   *    \c dsv_log_code.
+   *  \endparblock
+   *  \param[in] threads The number of threads to parse with or 0 for one per
+   *    processor
+   *  \param[in] flags A bitwise OR of \c dsv_parallel_flags values
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EAGAIN no thread could be started
+   *  \retval >0 Any error code returned by open or fstat
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_file_parallel(const char *filename, size_t threads, int flags,
+    dsv_parser_t parser, dsv_operations_t operations);
+
+  /**
+   *  \brief Flags controlling how \c dsv_parse_many passes on records
+   */
+  typedef enum {
+    /** Pass on the records of each file from the thread parsing it
+     *  [DEFAULT]
+     */
+    dsv_many_concurrent = 0,
+
+    /** Pass on the files one at a time in the order given from the calling
+     *  thread
+     */
+    dsv_many_ordered = 1
+  } dsv_many_flags;
+
+  /**
+   *  \brief Parse each of the \c n files named by \c paths with \c threads
+   *  threads using the settings of \c parser and the operations contained in
+   *  \c operations.
+   *
+   *  Each file is parsed on its own as by \c dsv_parse_file_mmap and
+   *  receives the same header, records and messages. The threads take the
+   *  next file as soon as they finish one so that a few large files do not
+   *  hold up the rest.
+   *
+   *  If \c contexts is not null, \c contexts[i] replaces the header, record,
+   *  record batch, column batch and partition contexts of \c operations for
+   *  the file \c paths[i]. The logger context is not replaced but each message
+   *  carries the file name as its location.
+   *
+   *  With \c dsv_many_concurrent, the callbacks, including the logger, are
+   *  called from the thread parsing the file and may be called concurrently
+   *  for different files. With \c dsv_many_ordered, each file is collected
+   *  as it is parsed and the calling thread passes on the files in the order
+   *  of \c paths so that no callback is called concurrently.
+   *
+   *  \param[in] paths An array of \c n null-terminated byte strings (NTBS)
+   *    naming the files to be parsed
+   *  \param[in] n The number of files
+   *  \param[in] threads The number of threads to parse with or 0 for one per
+   *    processor
+   *  \param[in] flags A bitwise OR of \c dsv_many_flags values
+   *  \param[in] contexts Null or an array of \c n contexts, one for each file
+   *  \param[out] results Null or an array of \c n values that receive the
+   *    result of each file, as \c dsv_parse_file_mmap would return it
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 every file was parsed successfully
+   *  \retval EAGAIN no thread could be started
+   *  \retval other the first result of \c results that is not 0 in the order
+   *    of \c paths
+   */
+  int dsv_parse_many(const char * const paths[], size_t n, size_t threads,
+    int flags, void * const contexts[], int results[], dsv_parser_t parser,
+    dsv_operations_t operations);
+
+  /**
+   *  \brief A range of bytes of a file
+   */
+  typedef struct {
+    /** The offset of the first byte of the range from the start of the file
+     */
+    size_t offset;
+
+    /** The number of bytes in the range */
+    size_t length;
+
+    /** The line number of the first line of the range */
+    size_t line;
+  } dsv_byte_range_t;
+
+  /**
+   *  \brief Flags controlling how \c dsv_split and \c dsv_split_files divide
+   *  a file
+   */
+  typedef enum {
+    /** The parts cover the whole file and the first begins with the header
+     *  [DEFAULT]
+     */
+    dsv_split_default = 0,
+
+    /** The parts cover the records after the header. \c dsv_split_files
+     *  begins every part with a copy of the header so that each is a
+     *  complete file.
+     */
+    dsv_split_after_header = 1
+  } dsv_split_flags;
+
+  /**
+   *  \brief Divide the file \c filename into at most \c n parts of about
+   *  equal size that each begin and end at a record boundary using the
+   *  settings of \c parser.
+   *
+   *  The parts are found without parsing the file. Records end where the
+   *  parser would end them, that is at newlines as recognized by the newline
+   *  behavior of \c parser and the delimiter and escaped binary settings
+   *  that determine how double quotes and newlines are read. A newline in an
+   *  escaped field therefore never divides a part. A permissive newline
+   *  behavior is settled by the header as in a parse. The parts are in the
+   *  order of the file, adjoin one another and each part after the first
+   *  begins on a new record. The last part ends at the end of the file. The
+   *  content of the records is not checked so a malformed file may be
+   *  divided at points where a parse would fail.
+   *
+   *  There may be fewer than \c n parts, or none, if the file is small or
+   *  holds records larger than a part would be. With \c dsv_split_default,
+   *  a file holding only a header is a single part. Each part can be parsed
+   *  on its own, for example by another process, once it is preceded by the
+   *  header, which is the bytes of the file before the first part with
+   *  \c dsv_split_after_header.
+   *
+   *  The file is mapped into memory as by \c dsv_parse_file_mmap and the
+   *  search is shared by up to \c n threads.
+   *
+   *  \param[in] filename A null-terminated byte string (NTBS) naming the
+   *    file to divide
+   *  \param[in] n The largest number of parts, at least 1
+   *  \param[in] flags A bitwise OR of \c dsv_split_flags values
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[out] ranges An array of \c n ranges that receives the parts
+   *  \param[out] parts Receives the number of parts
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EINVAL \c n is 0 or \c filename does not refer to a regular
+   *    file that can be mapped
+   *  \retval >0 Any error code returned by open or fstat
+   */
+  int dsv_split(const char *filename, size_t n, int flags, dsv_parser_t parser,
+    dsv_byte_range_t ranges[], size_t *parts);
+
+  /**
+   *  \brief Divide the file \c filename as by \c dsv_split and write part
+   *  \c i to the file named by \c paths[i].
+   *
+   *  Each file is created or truncated. The files for paths beyond the
+   *  number of parts are not touched. With \c dsv_split_after_header, each
+   *  file begins with the header followed by the part.
+   *
+   *  Where the system supports it, the bytes are copied with
+   *  \c copy_file_range so that they do not pass through the process and
+   *  the filesystem may share them between the files rather than copy them.
+   *  Otherwise they are read and written.
+   *
+   *  \param[in] filename A null-terminated byte string (NTBS) naming the
+   *    file to divide
+   *  \param[in] n The largest number of parts, at least 1
+   *  \param[in] flags A bitwise OR of \c dsv_split_flags values
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] paths An array of \c n null-terminated byte strings (NTBS)
+   *    naming the files to write
+   *  \param[out] parts Receives the number of parts and so of files written
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EINVAL \c n is 0 or \c filename does not refer to a regular
+   *    file that can be mapped
+   *  \retval >0 Any error code returned by open, fstat, read, write or
+   *    \c copy_file_range
+   */
+  int dsv_split_files(const char *filename, size_t n, int flags,
+    dsv_parser_t parser, const char * const paths[], size_t *parts);
+
+  /**
+   *  \brief Build an index of the records of the file \c filename using the
+   *  settings of \c parser and write it to the file named by \c index_path.
+   *
+   *  The index holds the offset and line of every \c stride-th record so
+   *  that \c dsv_parse_range can start at any record after passing over
+   *  fewer than \c stride records. A record always starts outside of an
+   *  escaped field so no quote state is needed. The records are found as by
+   *  \c dsv_split, without being parsed, and are counted from 0 after the
+   *  header. The index takes 16 bytes per indexed record.
+   *
+   *  The index also holds the size, modification time, device and inode of
+   *  the file and the delimiter, newline and escaped binary settings it was
+   *  built with so that a file changed since or a parser that reads the
+   *  records differently is detected.
+   *
+   *  \param[in] filename A null-terminated byte string (NTBS) naming the
+   *    file to index
+   *  \param[in] index_path A null-terminated byte string (NTBS) naming the
+   *    index file to create or replace
+   *  \param[in] stride The number of records between indexed records, which
+   *    must not be 0
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EINVAL \c filename does not refer to a regular file that can
+   *    be mapped
+   *  \retval >0 Any error code returned by open, stat, fstat or write
+   */
+  int dsv_index_build(const char *filename, const char *index_path,
+    size_t stride, dsv_parser_t parser);
+
+  /**
+   *  \brief Obtain the number of records, not counting the header, of the
+   *  file indexed by the index file \c index_path.
+   *
+   *  \param[in] index_path A null-terminated byte string (NTBS) naming an
+   *    index file written by \c dsv_index_build
+   *  \param[out] records Receives the number of records
+   *
+   *  \retval 0 success
+   *  \retval EINVAL \c index_path is not an index file
+   *  \retval >0 Any error code returned by open or read
+   */
+  int dsv_index_records(const char *index_path, size_t *records);
+
+  /**
+   *  \brief Parse the \c count records of the file \c filename that start
+   *  with record \c first_record using the settings of \c parser and the
+   *  operations contained in \c operations.
+   *
+   *  Records are counted from 0 after the header. The header is parsed and
+   *  passed on as in \c dsv_parse so that the column count, projection by
+   *  name and predicates are settled. The parse then resumes at
+   *  \c first_record and passes on at most \c count records followed by
+   *  any remaining batches. Log messages give the lines of the file. As the
+   *  records to skip of \c parser follow the header in \c dsv_parse, they
+   *  follow \c first_record here: that many more records are passed over
+   *  and are not counted in \c count. The maximum number of records still
+   *  applies.
+   *
+   *  If \c index_path is not null, it names an index written by
+   *  \c dsv_index_build for \c filename and only the records from the
+   *  nearest indexed record are passed over. Otherwise every record before
+   *  \c first_record is passed over from the start of the file. Records are
+   *  passed over without being parsed, as by \c dsv_split.
+   *
+   *  \param[in] filename \parblock
+   *    A null-terminated byte string (NTBS) naming the file to be parsed. The
+   *    value is also supplied as the location for logging messages. See
+   *    \c dsv_log_code.
+   *  \endparblock
+   *  \param[in] index_path Null or a null-terminated byte string (NTBS)
+   *    naming the index file of \c filename
+   *  \param[in] first_record The first record to pass on
+   *  \param[in] count The largest number of records to pass on
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval EINVAL \c filename does not refer to a regular file that can
+   *    be mapped, \c index_path is not an index file or the index was built
+   *    with settings that read the records differently than \c parser
+   *  \retval ESTALE the file was changed after the index was built
+   *  \retval >0 Any error code returned by open, stat, fstat or read
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parse_range(const char *filename, const char *index_path,
+    size_t first_record, size_t count, dsv_parser_t parser,
+    dsv_operations_t operations);
+
+  /**
+   *  \brief Parse the \c len bytes at \c bytes as the next piece of the
+   *  content being parsed by \c parser, using the operations contained in
+   *  \c operations.
+   *
+   *  This allows content that arrives in pieces, for example from a socket
+   *  or a decompressor, to be parsed without first collecting it. The first
+   *  call starts a new parse, each call parses as far as the bytes supplied
+   *  so far allow, and \c dsv_parser_finish completes it. Pieces may be split
+   *  at any byte, including within a field or a CRLF pair. Header and record
+   *  callbacks are invoked from within \c dsv_parser_feed and
+   *  \c dsv_parser_finish as soon as a record is complete.
+   *
+   *  Only the bytes that belong to an incomplete token are retained between
+   *  calls so \c bytes need not remain valid after \c dsv_parser_feed
+   *  returns.
+   *
+   *  The same \c operations should be supplied for every call of a parse. If
+   *  a call fails, the parse is abandoned and the next call to
+   *  \c dsv_parser_feed starts a new one. Only one such parse may be in
+   *  progress for \c parser at a time but the other \c dsv_parse*
+   *  functions may use \c parser meanwhile. The settings of \c parser are
+   *  copied when the parse starts.
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *  \param[in] bytes The next piece of content. May be zero if \c len is
+   *    zero.
+   *  \param[in] len The number of bytes at \c bytes
+   *
+   *  \retval 0 success, more content may be supplied
+   *  \retval ENOMEM out of memory
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parser_feed(dsv_parser_t parser, dsv_operations_t operations,
+    const unsigned char *bytes, size_t len);
+
+  /**
+   *  \brief Complete the parse started by \c dsv_parser_feed.
+   *
+   *  Any content held back waiting for more input is parsed as the end of
+   *  the content. Whether or not the parse succeeds, the next call to
+   *  \c dsv_parser_feed starts a new parse. Calling \c dsv_parser_finish
+   *  without a prior call to \c dsv_parser_feed parses empty content.
+   *
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *  \param[in] operations A pointer to a dsv_operations_t object previously
+   *    initialized with \c dsv_operations_create
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval <0 failure, see dsv_parse_error
+   */
+  int dsv_parser_finish(dsv_parser_t parser, dsv_operations_t operations);
+
+  /**
+   *  \brief An opaque handle for a dsv reader object
+   */
+  typedef struct {
+    void *p;
+  } dsv_reader_t;
+
+  /**
+   *  \brief Open the file stream \c stream with description \c location_str
+   *  for reading one record at a time with \c parser. If \c stream is
+   *  \c NULL, then attempt to open the location \c location_str using fopen.
+   *
+   *  This is the pull counterpart of \c dsv_parse. Rather than having the
+   *  parser call a \c record_callback_t for every record, the caller obtains
+   *  each record in turn with \c dsv_reader_next. Content is read from the
+   *  stream and parsed only as needed to produce the next record.
+   *
+   *  The reader works from a copy of the settings of \c parser, which may
+   *  be changed, used for other parses or destroyed while the reader is
+   *  open.
+   *
+   *  \note You must eventually call dsv_reader_close.
+   *
+   *  \param[in,out] reader A pointer to a dsv_reader_t object to initialize
+   *  \param[in] location_str \parblock
+   *    A null-terminated byte string (NTBS) that is used to identify and
+   *    potentially locate the content to be parsed. See \c dsv_parse.
+   *  \endparblock
+   *  \param[in] stream \parblock
+   *    - If nonzero, the value is assumed to be a valid file stream opened for
+   *      reading. \c dsv_reader_close does not close the stream.
+   *    - If zero, \c dsv_reader_open will attempt to use the value of
+   *      \c location_str to open a file location for reading.
+   *  \endparblock
+   *  \param[in] parser A pointer to a dsv_parser_t object previously
+   *    initialized with one of the \c dsv_parser_create* functions
+   *
+   *  \retval 0 success
+   *  \retval ENOMEM out of memory
+   *  \retval >0 Any error code returned by fopen
+   */
+  int dsv_reader_open(dsv_reader_t *reader, const char *location_str,
+    FILE *stream, dsv_parser_t parser);
+
+  /**
+   *  \brief Obtain the header of the content being read by \c reader.
+   *
+   *  The header may be obtained at any time. If no record has been obtained
+   *  yet, just enough content is parsed to produce the header. See
+   *  \c header_callback_t for the meaning of the header and the layout of
+   *  \c fields and \c lengths. An empty header yields a \c size of 0.
+   *
+   *  \param[in] reader A dsv_reader_t object previously initialized with
+   *    \c dsv_reader_open
+   *  \param[out] fields The fields of the header. Valid until the reader is
+   *    closed.
+   *  \param[out] lengths The lengths of the respective fields. Valid until
+   *    the reader is closed.
+   *  \param[out] size The number of fields
+   *
+   *  \retval 1 the header was obtained
+   *  \retval 0 the content is empty and there is no header
+   *  \retval ENOMEM out of memory
+   *  \retval >1 Any error code returned when reading the stream
+   *  \retval <0 failure, see dsv_parse_error. The only valid operation on
+   *    \c reader is then \c dsv_reader_close.
+   */
+  int dsv_reader_header(dsv_reader_t reader, const unsigned char * const **fields,
+    const size_t **lengths, size_t *size);
+
+  /**
+   *  \brief Obtain the next record of the content being read by \c reader.
+   *
+   *  See \c record_callback_t for the layout of \c fields and \c lengths. An
+   *  empty record yields a \c size of 0.
+   *
+   *  \param[in] reader A dsv_reader_t object previously initialized with
+   *    \c dsv_reader_open
+   *  \param[out] fields The fields of the record. Valid until the next call
+   *    to \c dsv_reader_next or \c dsv_reader_close.
+   *  \param[out] lengths The lengths of the respective fields. Valid until
+   *    the next call to \c dsv_reader_next or \c dsv_reader_close.
+   *  \param[out] size The number of fields
+   *
+   *  \retval 1 a record was obtained
+   *  \retval 0 there are no more records
+   *  \retval ENOMEM out of memory
+   *  \retval >1 Any error code returned when reading the stream
+   *  \retval <0 failure, see dsv_parse_error. The only valid operation on
+   *    \c reader is then \c dsv_reader_close.
+   */
+  int dsv_reader_next(dsv_reader_t reader, const unsigned char * const **fields,
+    const size_t **lengths, size_t *size);
+
+  /**
+   *  \brief Close the dsv_reader_t object.
+   *
+   *  \post using \c reader with any function other than \c dsv_reader_open
+   *    is undefined
+   *
+   *  \param[in] reader A dsv_reader_t object previously initialized with
+   *    \c dsv_reader_open
+   */
+  void dsv_reader_close(dsv_reader_t reader);
+
+
+  /**
+   *  \brief Logging levels for parser messages
+   */
+  typedef enum {
+    dsv_log_none = 0,
+    dsv_log_error = 1L,
+    dsv_log_warning = (1L << 1),
+    dsv_log_info = (1L << 2),
+    dsv_log_debug = (1L << 3),
+    dsv_log_all = (dsv_log_error|dsv_log_warning|dsv_log_info|dsv_log_debug)
+  } dsv_log_level;
+
+  /**
+   *  \brief Logging message codes
+   */
+  typedef enum {
+    /**
+     *  \brief An error strictly associated with incorrect syntax based on the
+     *  current parser behavior.
+     *
+     *  This log code has the following parameters:
+     *    - The offending line associated with the start of the syntax
+     *      error[*][**]
+     *    - The offending line associated with the end of the syntax
+     *      error[*][**]
+     *    - The offending character associated with the start of the syntax
+     *      error[*]
+     *    - The offending character associated with the end of the syntax
+     *      error[*]
+     *    - The location_str associated with the syntax error if it was supplied
+     *      to \c dsv_parse
+     *
+     *  [*] Numbers provided as a string are capable of being translated to
+     *  a signed or unsigned integer value (ie strtoul).
+     *
+     *  [**] The line associated with the log is counted according to the
+     *  applied parser behavior. For example, if the system newline is LF and
+     *  the applied behavior is RFC4180-strict, then the lines will be counted
+     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
+     *  the lines will be counted based on the first parsed occurrence of a
+     *  newline. Note that this is different than the first seen occurence of a
+     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
+     *  quoted field and not a newline therefore the registered newline behavior
+     *  will be the CRLF.
+    */
+    dsv_syntax_error,
+
+    /**
+     *  \brief An error strictly associated with parsing a non-uniform number of
+     *  fields when explicitly requested to do so. For example, if the header
+     *  contains 5 fields but the first record only contains 3.
+     *
+     *  This log code has the following parameters:
+     *    - The line number associated with the start of the offending
+     *      row[*][**]
+     *    - The line number associated with the end of the offending row[*][**]
+     *    - The expected number of fields[*]
+     *    - The number of fields parsed for this row[*]
+     *    - The location_str associated with the syntax error if it was supplied
+     *      to \c dsv_parse
+     *
+     *  [*] Numbers provided as a string are capable of being translated to
+     *  a signed or unsigned integer value (ie strtoul).
+     *
+     *  [**] The line associated with the log is counted according to the
+     *  applied parser behavior. For example, if the system newline is LF and
+     *  the applied behavior is RFC4180-strict, then the lines will be counted
+     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
+     *  the lines will be counted based on the first parsed occurrence of a
+     *  newline. Note that this is different than the first seen occurence of a
+     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
+     *  quoted field and not a newline therefore the registered newline behavior
+     *  will be the CRLF.
+    */
+    dsv_inconsistant_column_count,
+
+    /**
+     *  \brief An message associated with settings that prohibit non-ASCII
+     *  characters appearing in quoted fields. This error is also thrown if a
+     *  invalid newline representation appears in RFC4180-strict mode.
+     *
+     *  This log code has the following parameters:
+     *    - The offending line associated with the start of the syntax
+     *      error[*][**]
+     *    - The offending line associated with the end of the syntax
+     *      error[*][**]
+     *    - The offending character associated with the start of the syntax
+     *      error[*]
+     *    - The offending character associated with the end of the syntax
+     *      error[*]
+     *    - A byte-oriented string containing the hexadecimal representation of
+     *      the offending binary content.[***]
+     *    - The location_str associated with the syntax error if it was supplied
+     *      to \c dsv_parse
+     *
+     *  [*] Numbers provided as a string are capable of being translated to
+     *  a signed or unsigned integer value (ie strtoul).
+     *
+     *  [**] The line associated with the log is counted according to the
+     *  applied parser behavior. For example, if the system newline is LF and
+     *  the applied behavior is RFC4180-strict, then the lines will be counted
+     *  based on the occurrence of CRLF. If the behavior is newline_permissive,
+     *  the lines will be counted based on the first parsed occurrence of a
+     *  newline. Note that this is different than the first seen occurence of a
+     *  newline. For example, if a record is "..LF.."CRLF, the LF is parsed as a
+     *  quoted field and not a newline therefore the registered newline behavior
+     *  will be the CRLF.
+     *
+     *  [***] Each byte of the hexadecimal representation of binary content is
+     *  prefixed by a '0x' and therefore is capable of being translated to a
+     *  signed or unsigned integer value (ie strtol and family).
+    */
+    dsv_unexpected_binary,
+
+    /**
+     *  \brief An error associated with a column selected by name with
+     *  \c dsv_operations_set_projection_names that does not appear in the
+     *  header.
+     *
+     *  This log code has the following parameters:
+     *    - The line of the header[*]
+     *    - The name of the column
+     *    - The location_str associated with the error if it was supplied
+     *      to \c dsv_parse
+     *
+     *  [*] Numbers provided as a string are capable of being translated to
+     *  a signed or unsigned integer value (ie strtoul).
     */
-    dsv_unexpected_binary
+    dsv_unknown_column
   } dsv_log_code;
 
 
@@ -0,0 +1,196 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_ARROW_EXPORT_H
+#define LIBDSV_ARROW_EXPORT_H
+
+#include "dsv_parser.h"
+#include "parse_operations.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+
+namespace detail {
+
+  /**
+   *  Export of a column batch through the Arrow C Data Interface.
+   *
+   *  Every structure handed out owns its private data independently so that
+   *  the consumer may move children out of the parent and release them in
+   *  any order. A child array owns the buffers of its column which are moved
+   *  out of the parse operations rather than copied.
+   */
+  struct exported_schema {
+    std::string name;
+
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema *> child_ptrs;
+
+    static void release(ArrowSchema *schema);
+  };
+
+  struct exported_array {
+    parse_operations::column_buffer column;
+    const void *buffers[3];
+
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray *> child_ptrs;
+
+    static void release(ArrowArray *array);
+  };
+
+  /*
+      Export the rows of columns as a struct array of format with children of
+      child_format. The buffers of columns are moved into array. Throws
+      std::bad_alloc before anything is moved if memory runs out.
+   */
+  void export_columns(std::vector<parse_operations::column_buffer> &columns,
+    std::size_t rows, const std::vector<std::string> &names,
+    const char *child_format, ArrowSchema *schema, ArrowArray *array);
+
+
+
+
+  inline void exported_schema::release(ArrowSchema *schema)
+  {
+    for(int64_t i=0; i<schema->n_children; ++i) {
+      if(schema->children[i]->release)
+        schema->children[i]->release(schema->children[i]);
+    }
+
+    delete static_cast<exported_schema*>(schema->private_data);
+    schema->release = 0;
+  }
+
+  inline void exported_array::release(ArrowArray *array)
+  {
+    for(int64_t i=0; i<array->n_children; ++i) {
+      if(array->children[i]->release)
+        array->children[i]->release(array->children[i]);
+    }
+
+    delete static_cast<exported_array*>(array->private_data);
+    array->release = 0;
+  }
+
+  inline void export_columns(
+    std::vector<parse_operations::column_buffer> &columns, std::size_t rows,
+    const std::vector<std::string> &names, const char *child_format,
+    ArrowSchema *schema, ArrowArray *array)
+  {
+    // the data buffer of an empty column must still point somewhere
+    static const unsigned char no_data[1] = {0};
+
+    std::size_t size = columns.size();
+
+    std::unique_ptr<exported_schema> parent_schema(new exported_schema);
+    parent_schema->children.resize(size);
+    parent_schema->child_ptrs.resize(size);
+
+    std::unique_ptr<exported_array> parent_array(new exported_array);
+    parent_array->children.resize(size);
+    parent_array->child_ptrs.resize(size);
+
+    std::vector<std::unique_ptr<exported_schema> > child_schemas(size);
+    std::vector<std::unique_ptr<exported_array> > child_arrays(size);
+    for(std::size_t i=0; i<size; ++i) {
+      child_schemas[i].reset(new exported_schema);
+      child_schemas[i]->name = (i < names.size() ? names[i]
+        : std::to_string(i));
+      child_arrays[i].reset(new exported_array);
+    }
+
+    // nothing below throws
+    for(std::size_t i=0; i<size; ++i) {
+      exported_schema &child_schema = *child_schemas[i];
+
+      ArrowSchema &schema_child = parent_schema->children[i];
+      schema_child.format = child_format;
+      schema_child.name = child_schema.name.c_str();
+      schema_child.metadata = 0;
+      schema_child.flags = 0;
+      schema_child.n_children = 0;
+      schema_child.children = 0;
+      schema_child.dictionary = 0;
+      schema_child.release = &exported_schema::release;
+      schema_child.private_data = child_schemas[i].release();
+      parent_schema->child_ptrs[i] = &schema_child;
+
+      exported_array &child_array = *child_arrays[i];
+      child_array.column.data.swap(columns[i].data);
+      child_array.column.offsets.swap(columns[i].offsets);
+      child_array.buffers[0] = 0;
+      child_array.buffers[1] = child_array.column.offsets.data();
+      child_array.buffers[2] = (child_array.column.data.empty() ? no_data
+        : child_array.column.data.data());
+
+      ArrowArray &array_child = parent_array->children[i];
+      array_child.length = rows;
+      array_child.null_count = 0;
+      array_child.offset = 0;
+      array_child.n_buffers = 3;
+      array_child.n_children = 0;
+      array_child.buffers = child_array.buffers;
+      array_child.children = 0;
+      array_child.dictionary = 0;
+      array_child.release = &exported_array::release;
+      array_child.private_data = child_arrays[i].release();
+      parent_array->child_ptrs[i] = &array_child;
+    }
+
+    schema->format = "+s";
+    schema->name = "";
+    schema->metadata = 0;
+    schema->flags = 0;
+    schema->n_children = size;
+    schema->children = parent_schema->child_ptrs.data();
+    schema->dictionary = 0;
+    schema->release = &exported_schema::release;
+    schema->private_data = parent_schema.release();
+
+    exported_array &parent = *parent_array;
+    parent.buffers[0] = 0;
+
+    array->length = rows;
+    array->null_count = 0;
+    array->offset = 0;
+    array->n_buffers = 1;
+    array->n_children = size;
+    array->buffers = parent.buffers;
+    array->children = parent.child_ptrs.data();
+    array->dictionary = 0;
+    array->release = &exported_array::release;
+    array->private_data = parent_array.release();
+  }
+
+}
+
+#endif
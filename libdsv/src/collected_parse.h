@@ -0,0 +1,315 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_COLLECTED_PARSE_H
+#define LIBDSV_COLLECTED_PARSE_H
+
+#include "parser.h"
+#include "parse_operations.h"
+
+#include <vector>
+#include <string>
+#include <system_error>
+
+namespace detail {
+
+  /**
+   *  The header, records and log messages of a parse made by one thread,
+   *  held so that another thread can pass them on.
+   *
+   *  collect() directs a parse here in place of the callbacks. The fields
+   *  are held one after another in data. Field i is [offsets[i],offsets[i+1])
+   *  and the fields of record r are [records[r],records[r+1]). Each log
+   *  message remembers how many records were collected before it so that
+   *  deliver() passes it on just before the record it was logged for, as
+   *  the parse itself would have.
+   */
+  class collected_parse {
+    public:
+      collected_parse(void);
+
+      /*
+          Replace the logger of settings and the callbacks of operations so
+          that a parse with them is collected here. The projection and the
+          predicates are kept
+       */
+      void collect(parser_settings &settings, parse_operations &operations);
+
+      /*
+          0 if the parse succeeded, -1 if it failed or an errno value
+       */
+      int status(void) const;
+      int status(int val);
+
+      /*
+          Pass on the header, log messages and records with the logger of p
+          and the callbacks of operations. Returns 1 if all were passed on,
+          0 if the maximum number of records of p was reached and -1 if the
+          parse failed or a callback asked to stop. An errno value is thrown
+          as std::system_error
+       */
+      int deliver(parser &p, parse_operations &operations);
+
+      /*
+          Collect the header, a record or a log message as the callbacks set
+          by collect() do
+       */
+      void add_header(const unsigned char *fields[], const size_t lengths[],
+        size_t size);
+      void add_record(const unsigned char *fields[], const size_t lengths[],
+        size_t size);
+      void add_log(dsv_log_code code, dsv_log_level level,
+        const char *params[], size_t size);
+
+      /*
+          The number of records and the bytes of their fields collected
+       */
+      std::size_t size(void) const;
+      std::size_t bytes(void) const;
+
+    private:
+      struct log_entry {
+        // the number of records collected before the message
+        std::size_t record;
+        dsv_log_code code;
+        dsv_log_level level;
+        std::vector<std::string> params;
+      };
+
+      bool has_header;
+      std::vector<unsigned char> header_data;
+      std::vector<std::size_t> header_offsets;
+
+      // the number of log messages that precede the header
+      std::size_t header_logs;
+
+      std::vector<unsigned char> data;
+      std::vector<std::size_t> offsets;
+      std::vector<std::size_t> records;
+      std::vector<log_entry> logs;
+
+      int _status;
+
+      bool pass_log(const log_entry &entry, parser &p);
+
+      static int collect_header(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      static int collect_record(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      static int collect_log(dsv_log_code code, dsv_log_level level,
+        const char *params[], size_t size, void *context);
+  };
+
+  inline collected_parse::collected_parse(void) :has_header(false),
+    header_offsets(1,0), header_logs(0), offsets(1,0), records(1,0),
+    _status(0)
+  {
+  }
+
+  inline void collected_parse::collect(parser_settings &settings,
+    parse_operations &operations)
+  {
+    settings.log_callback(&collect_log);
+    settings.log_context(this);
+
+    operations.redirect(&collect_header,&collect_record,this);
+  }
+
+  inline int collected_parse::status(void) const
+  {
+    return _status;
+  }
+
+  inline int collected_parse::status(int val)
+  {
+    std::swap(val,_status);
+    return val;
+  }
+
+  inline int collected_parse::deliver(parser &p, parse_operations &operations)
+  {
+    if(_status > 0)
+      throw std::system_error(_status,std::system_category());
+
+    record_arena &arena = p.arena();
+
+    int result = 1;
+    std::size_t log = 0;
+    if(has_header) {
+      for(; log<header_logs && result > 0; ++log) {
+        if(!pass_log(logs[log],p))
+          result = -1;
+      }
+
+      if(result > 0) {
+        arena.clear();
+        arena.input(header_data.data());
+
+        record_arena::span list = arena.begin_list();
+        for(std::size_t i=0; i+1<header_offsets.size(); ++i) {
+          arena.push_field(list,arena.input_span(header_offsets[i],
+            header_offsets[i+1]-header_offsets[i]));
+        }
+
+        if(!operations.deliver_header(arena,list))
+          result = -1;
+      }
+    }
+
+    arena.clear();
+    arena.input(data.data());
+
+    for(std::size_t r=0; result > 0; ++r) {
+      for(; log<logs.size() && logs[log].record <= r; ++log) {
+        if(!pass_log(logs[log],p))
+          result = -1;
+      }
+
+      if(r+1 >= records.size() || result < 0)
+        break;
+
+      record_arena::span list = arena.begin_list();
+      for(std::size_t i=records[r]; i<records[r+1]; ++i) {
+        arena.push_field(list,
+          arena.input_span(offsets[i],offsets[i+1]-offsets[i]));
+      }
+
+      if(!operations.deliver_record(arena,list))
+        result = -1;
+      else {
+        p.record_passed();
+        if(p.record_limit_reached())
+          result = 0;
+      }
+    }
+
+    // batches must not refer to the collected fields once they are gone
+    if(!operations.flush_records(arena))
+      result = -1;
+
+    arena.clear();
+    arena.input(0);
+
+    if(result > 0 && _status != 0)
+      result = -1;
+
+    return result;
+  }
+
+  /*
+      Returns false if the logger rejected a warning
+   */
+  inline bool collected_parse::pass_log(const log_entry &entry, parser &p)
+  {
+    if(entry.level & dsv_log_error)
+      p.count_error();
+
+    log_callback_t logger = p.log_callback();
+    if(!logger)
+      return true;
+
+    std::vector<const char *> params;
+    for(std::size_t j=0; j<entry.params.size(); ++j)
+      params.push_back(entry.params[j].c_str());
+
+    return logger(entry.code,entry.level,params.data(),params.size(),
+      p.log_context()) || (entry.level & dsv_log_error);
+  }
+
+  inline void collected_parse::add_header(const unsigned char *fields[],
+    const size_t lengths[], size_t size)
+  {
+    for(std::size_t i=0; i<size; ++i) {
+      header_data.insert(header_data.end(),fields[i],fields[i]+lengths[i]);
+      header_offsets.push_back(header_data.size());
+    }
+
+    has_header = true;
+    header_logs = logs.size();
+  }
+
+  inline void collected_parse::add_record(const unsigned char *fields[],
+    const size_t lengths[], size_t size)
+  {
+    for(std::size_t i=0; i<size; ++i) {
+      data.insert(data.end(),fields[i],fields[i]+lengths[i]);
+      offsets.push_back(data.size());
+    }
+
+    records.push_back(offsets.size()-1);
+  }
+
+  inline void collected_parse::add_log(dsv_log_code code, dsv_log_level level,
+    const char *params[], size_t size)
+  {
+    log_entry entry;
+    entry.record = records.size()-1;
+    entry.code = code;
+    entry.level = level;
+    entry.params.assign(params,params+size);
+    logs.push_back(entry);
+  }
+
+  inline std::size_t collected_parse::size(void) const
+  {
+    return records.size()-1;
+  }
+
+  inline std::size_t collected_parse::bytes(void) const
+  {
+    return data.size();
+  }
+
+  inline int collected_parse::collect_header(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    static_cast<collected_parse*>(context)->add_header(fields,lengths,size);
+    return 1;
+  }
+
+  inline int collected_parse::collect_record(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    static_cast<collected_parse*>(context)->add_record(fields,lengths,size);
+    return 1;
+  }
+
+  inline int collected_parse::collect_log(dsv_log_code code,
+    dsv_log_level level, const char *params[], size_t size, void *context)
+  {
+    static_cast<collected_parse*>(context)->add_log(code,level,params,size);
+    return 1;
+  }
+
+}
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_DISPATCHED_PARSE_H
+#define LIBDSV_DISPATCHED_PARSE_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "scanner_state.h"
+#include "collected_parse.h"
+#include "spsc_ring.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <system_error>
+#include <new>
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace detail {
+
+  /**
+   *  Parse with the calling thread and pass the records on from several
+   *  worker threads.
+   *
+   *  Each record is given to one worker, either in turn or by a hash of one
+   *  of its fields so that records with equal keys always go to the same
+   *  worker. The records of a worker are collected in batches that go to it
+   *  through a ring of its own and the worker passes them on with its own
+   *  copy of the operations, in which the contexts may be replaced by one
+   *  for the worker. A worker therefore sees its records in the order of
+   *  the content and the callbacks of one worker are never called
+   *  concurrently, but those of different workers are.
+   *
+   *  Every worker is passed the header before its first record. The logger
+   *  is called by the calling thread as the content is parsed. The records
+   *  to skip and the maximum number of records are applied by the parse.
+   *  Once a callback asks to stop, its worker gives up and the parse stops
+   *  at the next record given to it.
+   *
+   *  The parse itself is left to parse_content, which reports a failure by
+   *  throwing std::system_error as parse in dsv_parser.cc does. Records
+   *  before a failure are still passed on.
+   */
+  class dispatched_parse {
+    public:
+      typedef void (*parse_function)(scanner_state &scanner, parser &p,
+        parse_operations &operations);
+
+      dispatched_parse(std::size_t workers, bool by_key,
+        std::size_t key_column, void * const contexts[]);
+
+      void run(scanner_state &scanner, const parser_settings &settings,
+        const parse_operations &operations, parse_function parse_content);
+
+    private:
+      // a batch is given to its worker once it holds this many records or
+      // bytes
+      static const std::size_t batch_records = 1024;
+      static const std::size_t batch_bytes = 256*1024;
+      static const std::size_t batch_count = 4;
+
+      typedef spsc_ring<std::unique_ptr<collected_parse> > batch_ring;
+
+      std::size_t workers;
+      bool by_key;
+      std::size_t key_column;
+      void * const *contexts;
+
+      parser_settings worker_settings;
+      std::vector<parse_operations> worker_operations;
+
+      std::vector<std::unique_ptr<batch_ring> > rings;
+
+      // the batch being filled for each worker and the worker given the
+      // last record in turn, used only by the calling thread
+      std::vector<std::unique_ptr<collected_parse> > current;
+      std::size_t next;
+
+      // -1 once a callback has asked to stop or ENOMEM if a worker ran out
+      // of memory, guarded by lock
+      std::mutex lock;
+      int failure;
+
+      void work(std::size_t worker);
+
+      /*
+          Give the current batch of worker to it and start another. Returns
+          false if the worker has given up
+       */
+      bool hand_off(std::size_t worker);
+
+      /*
+          Give every worker what is left, wait for them to finish and return
+          why one gave up, if any
+       */
+      int finish(std::vector<std::thread> &threads);
+
+      static int dispatch_header(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      static int dispatch_record(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      dispatched_parse(const dispatched_parse &);
+      dispatched_parse & operator=(const dispatched_parse &);
+  };
+
+  inline dispatched_parse::dispatched_parse(std::size_t n, bool key,
+    std::size_t column, void * const worker_contexts[]) :workers(n),
+    by_key(key), key_column(column), contexts(worker_contexts), next(0),
+    failure(0)
+  {
+  }
+
+  inline void dispatched_parse::run(scanner_state &scanner,
+    const parser_settings &settings, const parse_operations &operations,
+    parse_function parse_content)
+  {
+    // the parse applies the records to skip and the maximum
+    worker_settings = settings;
+    worker_settings.skip_records(0);
+    worker_settings.max_records(0);
+
+    for(std::size_t i=0; i<workers; ++i) {
+      worker_operations.push_back(operations);
+
+      parse_operations &ops = worker_operations.back();
+      if(contexts) {
+        ops.header_context = contexts[i];
+        ops.record_context = contexts[i];
+        ops.record_batch_context = contexts[i];
+        ops.column_batch_context = contexts[i];
+        ops.partition_context = contexts[i];
+      }
+      ops.reset();
+
+      rings.push_back(std::unique_ptr<batch_ring>(new batch_ring(batch_count)));
+      current.push_back(std::unique_ptr<collected_parse>(new collected_parse));
+    }
+
+    parse_operations dispatch_operations(operations);
+    dispatch_operations.redirect(&dispatch_header,&dispatch_record,this);
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+
+    try {
+      for(std::size_t i=0; i<workers; ++i)
+        threads.push_back(std::thread(&dispatched_parse::work,this,i));
+    }
+    catch(std::system_error &) {
+      for(std::size_t i=0; i<rings.size(); ++i)
+        rings[i]->close();
+      for(std::size_t i=0; i<threads.size(); ++i)
+        threads[i].join();
+
+      throw std::system_error(EAGAIN,std::system_category());
+    }
+
+    try {
+      parser p(settings);
+      parse_content(scanner,p,dispatch_operations);
+    }
+    catch(...) {
+      finish(threads);
+      throw;
+    }
+
+    int err = finish(threads);
+    if(err > 0)
+      throw std::system_error(err,std::system_category());
+    if(err < 0)
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+  }
+
+  inline void dispatched_parse::work(std::size_t worker)
+  {
+    int err = 0;
+
+    try {
+      parser p(worker_settings);
+      parse_operations &ops = worker_operations[worker];
+
+      std::unique_ptr<collected_parse> batch;
+      while(!err && rings[worker]->pop(batch)) {
+        if(batch->deliver(p,ops) < 0)
+          err = -1;
+
+        batch.reset();
+      }
+    }
+    catch(std::bad_alloc &) {
+      err = ENOMEM;
+    }
+    catch(...) {
+      abort();
+    }
+
+    if(err) {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!failure)
+          failure = err;
+      }
+
+      rings[worker]->close();
+    }
+  }
+
+  inline bool dispatched_parse::hand_off(std::size_t worker)
+  {
+    std::unique_ptr<collected_parse> batch(new collected_parse);
+    if(!rings[worker]->push(current[worker]))
+      return false;
+
+    current[worker] = std::move(batch);
+
+    return true;
+  }
+
+  inline int dispatched_parse::finish(std::vector<std::thread> &threads)
+  {
+    for(std::size_t i=0; i<threads.size(); ++i) {
+      rings[i]->push(current[i]);
+      rings[i]->close();
+    }
+
+    for(std::size_t i=0; i<threads.size(); ++i)
+      threads[i].join();
+    threads.clear();
+
+    std::lock_guard<std::mutex> guard(lock);
+    return failure;
+  }
+
+  inline int dispatched_parse::dispatch_header(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    dispatched_parse &dispatch = *static_cast<dispatched_parse*>(context);
+
+    for(std::size_t i=0; i<dispatch.workers; ++i)
+      dispatch.current[i]->add_header(fields,lengths,size);
+
+    return 1;
+  }
+
+  inline int dispatched_parse::dispatch_record(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    dispatched_parse &dispatch = *static_cast<dispatched_parse*>(context);
+
+    std::size_t worker;
+    if(dispatch.by_key) {
+      worker = key_hash(fields,lengths,size,&dispatch.key_column,1)
+        % dispatch.workers;
+    }
+    else {
+      worker = dispatch.next;
+      dispatch.next = (dispatch.next+1) % dispatch.workers;
+    }
+
+    collected_parse &batch = *dispatch.current[worker];
+    batch.add_record(fields,lengths,size);
+
+    if(batch.size() < batch_records && batch.bytes() < batch_bytes)
+      return 1;
+
+    return dispatch.hand_off(worker);
+  }
+
+}
+
+#endif
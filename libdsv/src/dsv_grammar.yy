@@ -41,29 +41,35 @@
   #include <vector>
 
   // Change me with bison version > 3
+  //
+  // The parser state is allocated with malloc so the members must be
+  // trivially copyable. They refer to content held in parser.arena()
   struct YYSTYPE {
-    // use vectors of unsigned characters instead of std::string so that we can store 0s
-    typedef std::vector<unsigned char> char_buff_type;
-    typedef std::shared_ptr<char_buff_type> char_buff_ptr_type;
+    typedef detail::record_arena::span span_type;
 
-    typedef std::vector<char_buff_ptr_type> char_buff_vec_type;
-    typedef std::shared_ptr<char_buff_vec_type> char_buff_vec_ptr_type;
+    // bytes of a field or part of a field
+    span_type char_buf;
 
-    // shared_ptr to character buffer
-    char_buff_ptr_type char_buf_ptr;
-
-    // shared_ptr to vector of shared_ptrs to character buffers
-    char_buff_vec_ptr_type char_buf_vec_ptr;
+    // list of fields
+    span_type field_list;
   };
 
 }
 
+%code provides {
+  int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
+   detail::parser &parser);
+}
+
 
 %code {
   #include "dsv_grammar.hh"
+  #include "structural_scan.h"
+  #include <cstring>
   #include <iostream>
   #include <sstream>
   #include <iomanip>
+  #include <algorithm>
 
   /**
    *  Error reporting function as required by Bison
@@ -73,6 +79,8 @@
     detail::parser &parser, const detail::parse_operations &operations,
     const std::unique_ptr<detail::scanner_state> &context, const char *s)
   {
+    parser.count_error();
+
     log_callback_t logger = parser.log_callback();
     if((parser.log_level() & dsv_log_error) && logger) {
       std::string first_line = std::to_string(llocp->first_line);
@@ -101,6 +109,8 @@
     std::cerr << "LOG LEVEL: " << parser.log_level() << "\n";
 
     bool result = !(level & dsv_log_error);
+    if(!result)
+      parser.count_error();
 
     // - The line number associated with the start of the offending row[*][**]
     // - The line number associated with the end of the offending row[*][**]
@@ -137,9 +147,11 @@
 
   bool unexpected_binary(const YYLTYPE &llocp,
     const detail::scanner_state &scanner, detail::parser &parser,
-    const YYSTYPE::char_buff_type &char_buf, dsv_log_level level)
+    const unsigned char *char_buf, std::size_t len, dsv_log_level level)
   {
     bool result = !(level & dsv_log_error);
+    if(!result)
+      parser.count_error();
 
     // - The offending line associated with the start of the syntax error[*][**]
     // - The offending line associated with the end of the syntax error[*][**]
@@ -160,7 +172,7 @@
       std::string filename = scanner.filename();
 
       std::stringstream out;
-      for(std::size_t i=0; i<char_buf.size(); ++i)
+      for(std::size_t i=0; i<len; ++i)
         out << std::hex << std::showbase << std::internal << std::setfill('0')
           << std::setw(4) << (unsigned int)(char_buf[i]);
       std::string out_str = out.str();
@@ -185,23 +197,49 @@
     return result;
   }
 
+  /**
+   *  A column selected by name is not in the header. Always an error
+   */
+  void unknown_column(const YYLTYPE &llocp,
+    const detail::scanner_state &scanner, detail::parser &parser,
+    const std::string &name)
+  {
+    parser.count_error();
+
+    // - The line of the header[*]
+    // - The name of the column
+    // - The location_str associated with the error if it was supplied to
+    //   \c dsv_parse
+    log_callback_t logger = parser.log_callback();
+    if((parser.log_level() & dsv_log_error) && logger) {
+      std::string first_line = std::to_string(llocp.first_line);
+      std::string filename = scanner.filename();
+
+      const char *fields[] = {
+        first_line.c_str(),
+        name.c_str(),
+        filename.c_str()
+      };
+
+      logger(dsv_unknown_column,dsv_log_error,fields,
+        sizeof(fields)/sizeof(const char *),parser.log_context());
+    }
+  }
 
-  int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
-   detail::parser &parser);
 
   /**
    *  Use namespaces here to avoid multiple symbol name clashes
    */
   namespace detail {
+    static const YYSTYPE::span_type empty_field = {0,0,false};
+
     /**
      *  convenience declares
      */
     bool check_or_update_column_count(const YYLTYPE &llocp,
       const detail::scanner_state &scanner, detail::parser &parser,
-      const YYSTYPE::char_buff_vec_ptr_type &char_buf_vec_ptr)
+      ssize_t columns)
     {
-      ssize_t columns = char_buf_vec_ptr->size();
-
       if(!parser.effective_field_columns_set()) {
 //         std::cerr << "effective_field_columns_set NOT set\n";
         parser.effective_field_columns_set(true);
@@ -221,62 +259,197 @@
       return true;
     }
 
-    bool process_header(const YYSTYPE::char_buff_vec_ptr_type &char_buf_vec_ptr,
-      detail::parse_operations &operations)
+    /*
+        Prepare for the records that follow header, which is empty if the
+        file has none. Resolve a projection by name with the fields of the
+        header, have the scanner skip the content of the columns that are
+        not passed on and start filtering records
+     */
+    bool start_records(const YYLTYPE &llocp,
+      const detail::scanner_state &scanner, detail::parser &parser,
+      detail::parse_operations &operations, const YYSTYPE::span_type &header)
     {
-//         std::cerr << "CALLING PROCESS_HEADER\n";
-      bool keep_going = true;
-      if(operations.header_callback) {
-//          std::cerr << "got size " << str_vec_ptr->size() << "\nGot:\n";
-//          for(int i=0; i<str_vec_ptr->size(); ++i)
-//            std::cerr << "\t" << (*str_vec_ptr)[i] << "\n";
-
-        operations.field_storage.clear();
-        operations.len_storage.clear();
-        operations.field_storage.reserve(char_buf_vec_ptr->size());
-        operations.len_storage.reserve(char_buf_vec_ptr->size());
-
-        for(size_t i=0; i<char_buf_vec_ptr->size(); ++i) {
-          operations.field_storage.push_back((*char_buf_vec_ptr)[i]->data());
-          operations.len_storage.push_back((*char_buf_vec_ptr)[i]->size());
-        }
+      const detail::record_arena &arena = parser.arena();
+
+      if(!operations.projection_names.empty()) {
+        const YYSTYPE::span_type *fields = arena.fields(header);
 
-//        std::cerr << "CALLING REGISTERED CALLBACK\n";
-        keep_going = operations.header_callback(operations.field_storage.data(),
-          operations.len_storage.data(),operations.field_storage.size(),
-          operations.header_context);
+        operations.projection.clear();
+        for(std::size_t i=0; i<operations.projection_names.size(); ++i) {
+          const std::string &name = operations.projection_names[i];
+
+          std::size_t col = 0;
+          while(col < header.len && !(fields[col].len == name.size()
+            && std::equal(name.begin(),name.end(),arena.data(fields[col]))))
+          {
+            ++col;
+          }
+
+          if(col == header.len) {
+            unknown_column(llocp,scanner,parser,name);
+            return false;
+          }
+
+          operations.projection.push_back(col);
+        }
       }
-      return keep_going;
+
+      operations.filtering = !operations.predicates.empty();
+
+      // the newline is known from the one ending the header, if any
+      parser.records_to_skip(parser.validating() ? 0 : parser.skip_records());
+      parser.skip_scan().newline(parser.effective_newline());
+
+      if(operations.projection.empty())
+        return true;
+
+      // columns with predicates are needed whether passed on or not
+      std::vector<bool> mask(operations.predicate_mask);
+      std::size_t size = *std::max_element(operations.projection.begin(),
+        operations.projection.end())+1;
+      if(mask.size() < size)
+        mask.resize(size,false);
+      for(std::size_t i=0; i<operations.projection.size(); ++i)
+        mask[operations.projection[i]] = true;
+
+      parser.column_mask(mask);
+
+      return true;
     }
 
-    bool process_record(const YYSTYPE::char_buff_vec_ptr_type &char_buf_vec_ptr,
-      detail::parse_operations &operations)
+    /*
+        Pass over the records still to be skipped without scanning their
+        content into tokens. Only the quote state is followed so a newline in
+        an escaped field does not end the record. Returns false if the input
+        ran out first and more is expected.
+     */
+    bool skip_records(YYLTYPE *llocp, detail::scanner_state &scanner,
+      detail::parser &parser)
     {
-//        std::cerr << "CALLING PROCESS_RECORD\n";
-      bool keep_going = true;
-      if(operations.record_callback) {
-        operations.field_storage.clear();
-        operations.len_storage.clear();
-        operations.field_storage.reserve(char_buf_vec_ptr->size());
-        operations.len_storage.reserve(char_buf_vec_ptr->size());
-
-        for(size_t i=0; i<char_buf_vec_ptr->size(); ++i) {
-          operations.field_storage.push_back((*char_buf_vec_ptr)[i]->data());
-          operations.len_storage.push_back((*char_buf_vec_ptr)[i]->size());
+      detail::record_scan &scan = parser.skip_scan();
+      std::size_t remaining = parser.records_to_skip();
+
+      std::size_t avail;
+      while(remaining && (avail = scanner.available()) != 0) {
+        std::size_t lines = scan.lines();
+        std::size_t len = scan.scan(scanner.current(),avail,remaining);
+        scanner.fadvance(len);
+
+        if(scan.lines() != lines) {
+          llocp->last_line += scan.lines()-lines;
+          llocp->last_column = 1;
         }
+        else
+          llocp->last_column += len;
+      }
+
+      parser.records_to_skip(remaining);
+
+      if(remaining && scanner.getc() == detail::scanner_state::underflow) {
+        // nothing skipped needs to be kept for a rescan
+        scanner.mark();
+        return false;
+      }
+
+      return true;
+    }
+
+    /*
+        Check the last field of the record field_list against its
+        predicates. The scanner skips the rest of a rejected record
+     */
+    void filter_field(const YYSTYPE::span_type &field_list,
+      detail::parser &parser, detail::parse_operations &operations)
+    {
+      if(!operations.filtering || operations.record_rejected)
+        return;
+
+      std::size_t col = field_list.len-1;
+      if(!operations.has_predicate(col))
+        return;
 
-        keep_going = operations.record_callback(operations.field_storage.data(),
-          operations.len_storage.data(),operations.field_storage.size(),
-          operations.record_context);
+      const detail::record_arena &arena = parser.arena();
+      const YYSTYPE::span_type &field = arena.fields(field_list)[col];
+
+      if(!operations.field_passes(col,arena.data(field),field.len)) {
+        operations.record_rejected = true;
+
+        // unless the scanner has already moved on to the next record
+        if(parser.field_index() > col)
+          parser.skip_record();
+      }
+    }
+
+    /*
+        The fields of field_list that are passed on
+     */
+    YYSTYPE::span_type project_fields(const YYSTYPE::span_type &field_list,
+      detail::parser &parser, const detail::parse_operations &operations)
+    {
+      if(operations.projection.empty())
+        return field_list;
+
+      detail::record_arena &arena = parser.arena();
+
+      YYSTYPE::span_type result = arena.begin_list();
+      for(std::size_t i=0; i<operations.projection.size(); ++i) {
+        std::size_t col = operations.projection[i];
+
+        // copied as the span buffer may move while pushing
+        YYSTYPE::span_type field = (col < field_list.len
+          ? arena.fields(field_list)[col] : empty_field);
+        arena.push_field(result,field);
       }
-      return keep_going;
+
+      return result;
+    }
+
+    bool process_header(const YYSTYPE::span_type &all_fields,
+      detail::parser &parser, detail::parse_operations &operations)
+    {
+//         std::cerr << "CALLING PROCESS_HEADER\n";
+      YYSTYPE::span_type field_list = project_fields(all_fields,parser,
+        operations);
+
+      return operations.deliver_header(parser.arena(),field_list);
     }
 
-    std::string to_string(const YYSTYPE::char_buff_type &buf)
+    bool process_record(const YYSTYPE::span_type &all_fields,
+      detail::parser &parser, detail::parse_operations &operations)
+    {
+      if(!operations.accept_record(all_fields.len)) {
+        // unless it holds a batch, nothing in the arena is needed
+        if(!operations.record_batch_callback)
+          parser.arena().release();
+        return true;
+      }
+
+      parser.record_passed();
+
+      YYSTYPE::span_type field_list = project_fields(all_fields,parser,
+        operations);
+
+      return operations.deliver_record(parser.arena(),field_list);
+    }
+
+    bool process_empty_record(detail::parser &parser,
+      detail::parse_operations &operations)
+    {
+      static const YYSTYPE::span_type empty_list = {0,0,false};
+
+      if(!operations.accept_record(0))
+        return true;
+
+      parser.record_passed();
+
+      return operations.deliver_record(parser.arena(),empty_list);
+    }
+
+    std::string to_string(const unsigned char *buf, std::size_t len)
     {
       std::stringstream out;
 
-      for(std::size_t i=0; i<buf.size(); ++i) {
+      for(std::size_t i=0; i<len; ++i) {
         if(buf[i] > 32 || buf[i] < 126)
           out << buf[i];
         else
@@ -286,14 +459,32 @@
       return out.str();
     }
 
+    /*
+        The content of the token of len bytes that ends at the current read
+        location. If the arena refers to the input, so does the result.
+        Otherwise the bytes at copy, which are the same as those of the
+        token, are appended to the arena. The content of a field that is not
+        selected is always empty.
+     */
+    YYSTYPE::span_type token_content(const detail::scanner_state &scanner,
+      detail::parser &parser, const unsigned char *copy, std::size_t len)
+    {
+      detail::record_arena &arena = parser.arena();
+
+      if(!parser.field_selected())
+        return empty_field;
 
-    static const YYSTYPE::char_buff_ptr_type empty_buf(new YYSTYPE::char_buff_type());
-    static const YYSTYPE::char_buff_vec_ptr_type empty_vec(new YYSTYPE::char_buff_vec_type());
+      if(arena.has_input())
+        return arena.input_span(scanner.offset()-len,len);
+
+      return arena.append(copy,len);
+    }
   }
 
 }
 
 %define api.pure full
+%define api.push-pull both
 %locations
 
 %debug
@@ -308,30 +499,42 @@
 %parse-param {const std::unique_ptr<detail::scanner_state> &context}
 
 %token END 0 "end-of-file"
-%token DELIMITER "delimiter"
+%token <char_buf> DELIMITER "delimiter"
 //%token HEADER_DELIMITER "header delimiter"
-%token <char_buf_ptr> LF "linefeed"
-%token <char_buf_ptr> CR "carriage-return"
-%token <char_buf_ptr> NL "newline"
+%token <char_buf> LF "linefeed"
+%token <char_buf> CR "carriage-return"
+%token <char_buf> NL "newline"
 %token DQUOTE "\""
-%token <char_buf_ptr> D2QUOTE "\"\""
-%token <char_buf_ptr> TEXTDATA
+%token <char_buf> D2QUOTE "\"\""
+%token <char_buf> TEXTDATA
 %token BINARYDATA "binary data"
 
+// Never seen by the grammar. Returned by the lexer when the input appended so
+// far ends before the next token is complete. See push_parser
+%token NEED_INPUT "incomplete input"
+
 
 // file
-%type <char_buf_vec_ptr> field_list
-%type <char_buf_ptr> field
-%type <char_buf_ptr> escaped_field;
-%type <char_buf_ptr> escaped_textdata_list
-%type <char_buf_ptr> escaped_textdata
-%type <char_buf_ptr> non_escaped_field;
+%type <field_list> field_list
+%type <char_buf> field
+%type <char_buf> escaped_field;
+%type <char_buf> escaped_textdata_list
+%type <char_buf> escaped_textdata
+%type <char_buf> non_escaped_field;
 
 
 
 %% /* The grammar follows.  */
 
 file:
+    file_content {
+      // pass on the records of the last batch
+      if(!operations.flush_records(parser.arena()))
+        YYABORT;
+    }
+  ;
+
+file_content:
     /* empty */
   | empty_header
   | empty_header record_block
@@ -344,57 +547,83 @@ empty_header:
     NL {
       // NL means no header. Check to see if empty records are allowed
 //       std::cerr << "HERE!!!!!!!!!!!!!!\n";
-      if(!detail::check_or_update_column_count(@1,scanner,parser,detail::empty_vec)) {
+      if(!detail::check_or_update_column_count(@1,scanner,parser,0)) {
 //         std::cerr << "ABORTING!!!!!!!!!!!!!!\n";
         YYABORT;
       }
 
-      // do manual process header cause we know it is empty
-      if(operations.header_callback &&
-        !operations.header_callback(0,0,0,operations.header_context))
-      {
-        YYABORT;
+      // without a header, this is the first record and it is empty
+      if(parser.records_only()) {
+        if(!detail::process_empty_record(parser,operations))
+          YYABORT;
+      }
+      else {
+        if(!detail::start_records(@1,scanner,parser,operations,
+          detail::empty_field))
+        {
+          YYABORT;
+        }
+
+        // do manual process header cause we know it is empty
+        if(operations.header_callback &&
+          !operations.header_callback(0,0,0,operations.header_context))
+        {
+          YYABORT;
+        }
       }
     }
   ;
 
 header_block:
   field_list {
-      if(!detail::check_or_update_column_count(@1,scanner,parser,$1))
+      if(!detail::check_or_update_column_count(@1,scanner,parser,$1.len))
         YYABORT;
 
-      if(!detail::process_header($1,operations))
-        YYABORT;
+      // without a header, this is the first record
+      if(parser.records_only()) {
+        if(!detail::process_record($1,parser,operations))
+          YYABORT;
+      }
+      else {
+        if(!detail::start_records(@1,scanner,parser,operations,$1))
+          YYABORT;
+
+        if(!detail::process_header($1,parser,operations))
+          YYABORT;
+      }
     }
 //   | delimited_header_list
   ;
 
 field_list:
     field {
-      $$.reset(new YYSTYPE::char_buff_vec_type());
-      $$->push_back($1);
+      $$ = parser.arena().begin_list();
+      parser.arena().push_field($$,$1);
+      detail::filter_field($$,parser,operations);
     }
   | DELIMITER {
-      $$.reset(new YYSTYPE::char_buff_vec_type());
-      $$->push_back(detail::empty_buf);
-      $$->push_back(detail::empty_buf);
+      $$ = parser.arena().begin_list();
+      parser.arena().push_field($$,detail::empty_field);
+      detail::filter_field($$,parser,operations);
+      parser.arena().push_field($$,detail::empty_field);
+      detail::filter_field($$,parser,operations);
     }
   | DELIMITER field {
-      $$.reset(new YYSTYPE::char_buff_vec_type());
-      $$->push_back(detail::empty_buf);
-      $$->push_back($2);
+      $$ = parser.arena().begin_list();
+      parser.arena().push_field($$,detail::empty_field);
+      detail::filter_field($$,parser,operations);
+      parser.arena().push_field($$,$2);
+      detail::filter_field($$,parser,operations);
     }
   | field_list DELIMITER {
-      $$.reset(new YYSTYPE::char_buff_vec_type());
-      $$->reserve($1->size()+1);
-      $$->assign($1->begin(),$1->end());
-      $$->push_back(detail::empty_buf);
+      $$ = $1;
+      parser.arena().push_field($$,detail::empty_field);
+      detail::filter_field($$,parser,operations);
     }
   | field_list DELIMITER field {
-      $$.reset(new YYSTYPE::char_buff_vec_type());
-      $$->reserve($1->size()+1);
-      $$->assign($1->begin(),$1->end());
-      $$->push_back($3);
+      $$ = $1;
+      parser.arena().push_field($$,$3);
+      detail::filter_field($$,parser,operations);
     }
   ;
 
@@ -426,26 +655,21 @@ close_quote:
 escaped_textdata_list:
     escaped_textdata { $$ = $1; }
   | escaped_textdata_list escaped_textdata {
-      // need to aggregate so must use unique vector
-      $$.reset(new YYSTYPE::char_buff_type());
-      $$->reserve($1->size()+$2->size());
-      $$->assign($1->begin(),$1->end());
-      $$->insert($$->end(),$2->begin(),$2->end());
+      // the pieces are usually adjacent in the arena so this rarely copies
+      $$ = parser.arena().concat($1,$2);
     }
   ;
 
 escaped_textdata:
     TEXTDATA { $$ = $1; }
-  | DELIMITER {
-      // delimiter must be recreated as it could change across parser invocations
-      // todo, still can be cached in the parser...
-      $$.reset(new YYSTYPE::char_buff_type(1,parser.delimiter()));
-    }
+  | DELIMITER { $$ = $1; }
   | NL { $$ = $1; } // NL are always accepted
   | LF {
-      // LF is returned if it wasn't already considered an NL
+      // LF is returned if it wasn't already considered an NL. The content is
+      // not kept when only validating
       if(!parser.escaped_binary_fields()) {
-        unexpected_binary(@1,scanner,parser,*$1,dsv_log_error);
+        static const unsigned char lf = 0x0A;
+        unexpected_binary(@1,scanner,parser,&lf,1,dsv_log_error);
         YYABORT;
       }
 
@@ -453,7 +677,8 @@ escaped_textdata:
   | CR {
       // CR is returned if it wasn't already considered an NL, ie CRLF
       if(!parser.escaped_binary_fields()) {
-        unexpected_binary(@1,scanner,parser,*$1,dsv_log_error);
+        static const unsigned char cr = 0x0D;
+        unexpected_binary(@1,scanner,parser,&cr,1,dsv_log_error);
         YYABORT;
       }
 
@@ -467,33 +692,43 @@ non_escaped_field:
   ;
 
 record_block:
-    NL {  // A single NL means an empty record block
-      // check to see if empty records are allowed
-      if(!detail::check_or_update_column_count(@1,scanner,parser,detail::empty_vec))
-        YYABORT;
-
-      // manual process record cause we know it is empty, the return value doesn't matter
-      if(operations.record_callback)
-        operations.record_callback(0,0,0,operations.record_context);
-
-    }
-  | record
+    record
   | record_list
   | record_list record
   ;
 
 record_list:
     record NL
+  | NL {  // A leading NL means an empty record
+      // check to see if empty records are allowed
+      if(!detail::check_or_update_column_count(@1,scanner,parser,0))
+        YYABORT;
+
+      // do manual process record cause we know it is empty
+      if(!detail::process_empty_record(parser,operations))
+        YYABORT;
+
+      // the rest of the input is not wanted once the limit is reached
+      if(parser.record_limit_reached()) {
+        if(!operations.flush_records(parser.arena()))
+          YYABORT;
+        YYACCEPT;
+      }
+    }
   | record_list NL {
       // Single NL means empty record
-      if(!detail::check_or_update_column_count(@2,scanner,parser,detail::empty_vec))
+      if(!detail::check_or_update_column_count(@2,scanner,parser,0))
         YYABORT;
 
       // do manual process record cause we know it is empty
-      if(operations.record_callback &&
-        !operations.record_callback(0,0,0,operations.record_context))
-      {
+      if(!detail::process_empty_record(parser,operations))
         YYABORT;
+
+      // the rest of the input is not wanted once the limit is reached
+      if(parser.record_limit_reached()) {
+        if(!operations.flush_records(parser.arena()))
+          YYABORT;
+        YYACCEPT;
       }
     }
   | record_list record NL
@@ -501,11 +736,18 @@ record_list:
 
 record:
     field_list {
-      if(!detail::check_or_update_column_count(@1,scanner,parser,$1))
+      if(!detail::check_or_update_column_count(@1,scanner,parser,$1.len))
         YYABORT;
 
-      if(!detail::process_record($1,operations))
+      if(!detail::process_record($1,parser,operations))
         YYABORT;
+
+      // the rest of the input is not wanted once the limit is reached
+      if(parser.record_limit_reached()) {
+        if(!operations.flush_records(parser.arena()))
+          YYABORT;
+        YYACCEPT;
+      }
     }
   ;
 
@@ -525,21 +767,25 @@ record:
     field data content and the double quote (ie "");
 
     Only TEXTDATA strings are returned in YYSTYPE
+
+    If the scanner runs out of incremental input before a token is complete,
+    the scanner and location are restored to the start of the token and
+    NEED_INPUT is returned so that the token can be rescanned once more input
+    is available. Inside an escaped field, the TEXTDATA scanned so far is
+    returned instead since adjacent escaped TEXTDATA is concatenated anyway.
  */
 int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
  detail::parser &parser)
 {
-  static const unsigned char crlf_il[] = {0x0D,0x0A};
-  static const YYSTYPE::char_buff_ptr_type
-    lf_buf(new YYSTYPE::char_buff_type(1,0x0A));
-  static const YYSTYPE::char_buff_ptr_type
-    cr_buf(new YYSTYPE::char_buff_type(1,0x0D));
-  static const YYSTYPE::char_buff_ptr_type
-    crlf_buf(new YYSTYPE::char_buff_type(crlf_il,
-      crlf_il+sizeof(crlf_il)/sizeof(unsigned char)));
-
-  static const YYSTYPE::char_buff_ptr_type
-    quote_buf(new YYSTYPE::char_buff_type(1,0x22));
+  // the content of these tokens is only needed inside escaped fields but
+  // recording it keeps it adjacent to the surrounding TEXTDATA, whether in
+  // the arena or the input
+  static const unsigned char lf_buf[] = {0x0A};
+  static const unsigned char cr_buf[] = {0x0D};
+  static const unsigned char crlf_buf[] = {0x0D,0x0A};
+  static const unsigned char quote_buf[] = {0x22};
+
+  detail::record_arena &arena = parser.arena();
 
   // <32 is non-printing
   // > 126 is non-printing
@@ -558,8 +804,18 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
 
 //  while(cur = scanner.getc() && scanner.advance()) {
 
+  // skipped records directly follow the header
+  if(parser.records_to_skip() && !detail::skip_records(llocp,scanner,parser))
+    return NEED_INPUT;
+
+  const YYLTYPE token_loc = *llocp;
+  scanner.mark();
+
   int cur;
   while((cur = scanner.fadvancec()) != EOF) {
+    if(cur == detail::scanner_state::underflow)
+      return NEED_INPUT;
+
     llocp->first_line = llocp->last_line;
     // last_column is always 1-past as is C
     llocp->first_column = (llocp->last_column)++;
@@ -576,10 +832,20 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
     int lookahead = scanner.getc();
 
     if(cur == parser.delimiter()) {
+      // only content inside an escaped field. Appending it here rather than in
+      // the grammar action keeps it adjacent to the surrounding TEXTDATA so
+      // that long escaped fields are accumulated without copying
+      if(parser.escaped_field()) {
+        unsigned char delim = cur;
+        lvalp->char_buf = detail::token_content(scanner,parser,&delim,1);
+      }
+      else
+        parser.next_field();
+
       return DELIMITER;
     }
     else if(cur == 0x0A) {//LF
-      lvalp->char_buf_ptr = lf_buf;
+      lvalp->char_buf = detail::token_content(scanner,parser,lf_buf,sizeof(lf_buf));
       if(parser.effective_newline() != dsv_newline_crlf_strict) {
         // only register the effective newline if we are not in a quoted field
         if(parser.effective_newline() == dsv_newline_permissive
@@ -593,19 +859,29 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
 
         ++(llocp->last_line);
         llocp->last_column = 1;
+        if(!parser.escaped_field())
+          parser.next_record();
         return NL;
       }
 
       return LF;
     }
     else if(cur == 0x0D) { //CR
+      // CR or CRLF cannot be decided yet
+      if(lookahead == detail::scanner_state::underflow) {
+        scanner.rewind();
+        *llocp = token_loc;
+        return NEED_INPUT;
+      }
+
       if(lookahead == 0x0A // LF
         && parser.effective_newline() != dsv_newline_lf_strict)
       {
         scanner.fadvancec();
         ++(llocp->last_line);
         llocp->last_column = 1;
-        lvalp->char_buf_ptr = crlf_buf;
+        lvalp->char_buf =
+          detail::token_content(scanner,parser,crlf_buf,sizeof(crlf_buf));
 
         // only register the effective newline if we are not in a quoted field
         if(parser.effective_newline() == dsv_newline_permissive
@@ -617,14 +893,25 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
 //         else
 //           std::cerr << "IGNORING SETTING EFFECTIVE CRLF\n";
 
+        if(!parser.escaped_field())
+          parser.next_record();
         return NL;
       }
 
-      lvalp->char_buf_ptr = cr_buf;
+      lvalp->char_buf = detail::token_content(scanner,parser,cr_buf,sizeof(cr_buf));
       return CR;
     }
     else if(cur == 0x22) { //"
-      lvalp->char_buf_ptr = quote_buf;
+      // DQUOTE or D2QUOTE cannot be decided yet
+      if(lookahead == detail::scanner_state::underflow) {
+        scanner.rewind();
+        *llocp = token_loc;
+        return NEED_INPUT;
+      }
+
+      // the first DQUOTE is the content of a D2QUOTE
+      lvalp->char_buf =
+        detail::token_content(scanner,parser,quote_buf,sizeof(quote_buf));
       if(lookahead == 0x22) {
         scanner.fadvancec();
         ++(llocp->last_column);
@@ -634,24 +921,28 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
       return DQUOTE;
     }
     else if(parser.escaped_field() && parser.escaped_binary_fields()) {
-      // straight textdata
-      lvalp->char_buf_ptr.reset(new YYSTYPE::char_buff_type(&cur, (&cur)+1));
+      // straight textdata. The bytes of an unselected field are only skipped
+      bool keep = parser.field_selected();
+      unsigned char first = cur;
+      YYSTYPE::span_type &buf = lvalp->char_buf;
+      buf = detail::token_content(scanner,parser,&first,1);
 
       // only a DQUOTE will terminate a binary enabled escaped field. Don't eat
       // until we know it is not a terminating byte
-      while((cur = scanner.getc()) != EOF) {
-        if(cur == 0x22) { // DQUOTE
+      std::size_t avail;
+      while((avail = scanner.available()) != 0) {
+        const unsigned char *data = scanner.current();
+        const unsigned char *quote =
+          static_cast<const unsigned char *>(std::memchr(data,0x22,avail));
+        std::size_t len = (quote ? quote-data : avail);
+
+        if(keep)
+          arena.extend(buf,data,len);
+        llocp->last_column += len;
+        scanner.fadvance(len);
+
+        if(quote) // DQUOTE
           return TEXTDATA;
-        }
-
-        ++(llocp->last_column);
-
-// std::cerr << "TEXTDATA scanned '" << char(cur) << "' token now at row: "
-//   << llocp->first_line << ":" << llocp->last_line << " col: "
-//   << llocp->first_column << ":" << llocp->last_column << "\n";
-
-        lvalp->char_buf_ptr->push_back(cur);
-        scanner.fadvancec();
       }
 
       return TEXTDATA;
@@ -660,29 +951,37 @@ int parser_lex(YYSTYPE *lvalp, YYLTYPE *llocp, detail::scanner_state &scanner,
       return BINARYDATA;
     }
     else {
-      // straight textdata
-      lvalp->char_buf_ptr.reset(new YYSTYPE::char_buff_type(&cur, (&cur)+1));
-
-      // scan for anything that could terminate the ASCII field. Don't eat
-      // until we know it is not a terminating byte
-      while((cur = scanner.getc()) != EOF) {
-        if(cur == parser.delimiter()
-          || cur == 0x0A //LF
-          || cur == 0x0D //CR
-          || cur == 0x22 // DQUOTE
-          || cur < 32 || cur > 126) // non-ASCII
-        {
+      // straight textdata. The bytes of an unselected field are only skipped
+      bool keep = parser.field_selected();
+      unsigned char first = cur;
+      YYSTYPE::span_type &buf = lvalp->char_buf;
+      buf = detail::token_content(scanner,parser,&first,1);
+
+      // scan for anything that could terminate the ASCII field, ie the
+      // delimiter, LF, CR, DQUOTE, or non-ASCII. Whole runs of ordinary bytes
+      // are located and copied at once. See structural_scan.h
+      std::size_t avail;
+      while((avail = scanner.available()) != 0) {
+        const unsigned char *data = scanner.current();
+        std::size_t len = detail::find_structural(data,avail,parser.delimiter());
+
+        if(keep)
+          arena.extend(buf,data,len);
+        llocp->last_column += len;
+        scanner.fadvance(len);
+
+        if(len != avail)
           return TEXTDATA;
-        }
-
-        ++(llocp->last_column);
-
-// std::cerr << "TEXTDATA scanned '" << char(cur) << "' token now at row: "
-//   << llocp->first_line << ":" << llocp->last_line << " col: "
-//   << llocp->first_column << ":" << llocp->last_column << "\n";
+      }
 
-        lvalp->char_buf_ptr->push_back(cur);
-        scanner.fadvancec();
+      // an unescaped field may continue in the next input
+      cur = scanner.getc();
+      if(cur == detail::scanner_state::underflow && !parser.escaped_field()) {
+        if(keep)
+          arena.discard(buf);
+        scanner.rewind();
+        *llocp = token_loc;
+        return NEED_INPUT;
       }
 
       return TEXTDATA;
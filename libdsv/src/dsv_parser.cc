@@ -32,20 +32,363 @@
 #include "parser.h"
 #include "parse_operations.h"
 #include "scanner_state.h"
+#include "mapped_file.h"
+#include "push_parser.h"
+#include "parallel_parse.h"
+#include "parse_many.h"
+#include "pipelined_parse.h"
+#include "dispatched_parse.h"
+#include "record_bounds.h"
+#include "range_copy.h"
+#include "record_index.h"
+#include "reader.h"
+#include "arrow_export.h"
 #include "dsv_grammar.hh"
 
 #include <cerrno>
 #include <cstdlib>
+#include <cassert>
 
 #include <system_error>
 #include <regex>
 #include <sstream>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <limits>
 
 #include <boost/system/error_code.hpp>
 
 namespace bs = boost::system;
 
+namespace {
+
+  /*
+      What a dsv_parser_t refers to. A parse only reads the settings so any
+      number of parses may share them. A parse started by dsv_parser_feed
+      keeps its state here until dsv_parser_finish and is therefore the one
+      parse that is tied to the handle.
+   */
+  struct parser_handle {
+    detail::parser_settings settings;
+
+    std::shared_ptr<detail::parser> incremental_parser;
+    std::shared_ptr<detail::push_parser> incremental_parse;
+  };
+
+  parser_handle & handle(dsv_parser_t parser)
+  {
+    return *static_cast<parser_handle*>(parser.p);
+  }
+
+  /*
+      Run the grammar over scanner. A failed parse is reported by throwing
+      std::system_error. See parse_error_code for the translation.
+   */
+  void parse(detail::scanner_state &scanner, detail::parser &parser,
+    detail::parse_operations &operations)
+  {
+    //parser_debug = 1;
+
+    std::unique_ptr<detail::scanner_state> base_ctx;
+
+    operations.reset();
+    if(parser.zero_copy_fields() && scanner.in_place())
+      parser.arena().input(scanner.region());
+
+    int err = parser_parse(scanner,parser,operations,base_ctx);
+    if(err != 0) {
+      if(err == 2)
+        throw std::system_error(ENOMEM,std::system_category());
+
+      // records that were complete before the failure are still delivered
+      operations.flush_records(parser.arena());
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+    }
+  }
+
+  /*
+      Map filename into memory and parse it. Files that cannot be mapped are
+      read instead.
+   */
+  void parse_mapped(const char *filename, bool huge_pages,
+    detail::parser &parser, detail::parse_operations &operations)
+  {
+    detail::mapped_file file(filename,huge_pages);
+
+    if(file.is_mapped()) {
+      detail::scanner_state scanner(filename,file.data(),file.size());
+      parse(scanner,parser,operations);
+    }
+    else {
+      // pipes, devices, and filesystems without mmap support
+      detail::scanner_state scanner(filename);
+      parse(scanner,parser,operations);
+    }
+  }
+
+  /*
+      Check the content of scanner without keeping any field. Every error is
+      logged. Unless all_errors, the first one ends the check. Otherwise the
+      rest of the offending record is passed over and the check resumes with
+      the next record. Returns false if any error was found or the logger
+      asked to stop.
+   */
+  bool validate(detail::scanner_state &scanner,
+    const detail::parser_settings &settings, bool all_errors)
+  {
+    std::unique_ptr<detail::scanner_state> base_ctx;
+    detail::parser parser(settings);
+    detail::parse_operations operations;
+
+    parser.validating(true);
+
+    std::shared_ptr<parser_pstate> pstate(parser_pstate_new(),
+      &parser_pstate_delete);
+    if(!pstate)
+      throw std::bad_alloc();
+
+    YYLTYPE lloc;
+    lloc.first_line = lloc.last_line = 1;
+    lloc.first_column = lloc.last_column = 1;
+
+    std::size_t errors = 0;
+    int status = YYPUSH_MORE;
+    while(status == YYPUSH_MORE) {
+      YYSTYPE lval;
+      int token = parser_lex(&lval,&lloc,scanner,parser);
+      status = parser_push_parse(pstate.get(),token,&lval,&lloc,scanner,
+        parser,operations,base_ctx);
+
+      if(status == 2)
+        throw std::system_error(ENOMEM,std::system_category());
+
+      // a failure without an error is a request from the logger to stop
+      if(status != 1 || !all_errors || token == END
+        || parser.errors() == errors)
+      {
+        continue;
+      }
+
+      errors = parser.errors();
+
+      // unless the failure came at a newline, pass over the rest of the
+      // record and start over with the next as if it were the first
+      if(token != NL || parser.escaped_field()) {
+        detail::record_scan scan(parser.effective_newline(),
+          parser.delimiter(),parser.escaped_binary_fields());
+        scan.quoted(parser.escaped_field());
+
+        std::size_t remaining = 1;
+        std::size_t avail;
+        while(remaining && (avail = scanner.available()) != 0)
+          scanner.fadvance(scan.scan(scanner.current(),avail,remaining));
+
+        lloc.last_line += scan.lines();
+        lloc.last_column = 1;
+      }
+
+      parser.escaped_field(false);
+      parser.next_record();
+      parser.arena().clear();
+
+      pstate.reset(parser_pstate_new(),&parser_pstate_delete);
+      if(!pstate)
+        throw std::bad_alloc();
+
+      status = YYPUSH_MORE;
+    }
+
+    return status == 0 && parser.errors() == 0;
+  }
+
+  /*
+      Count the records following the header in scanner and their fields
+      without parsing them
+   */
+  void count(detail::scanner_state &scanner,
+    const detail::parser_settings &settings, std::size_t &records,
+    std::size_t &fields)
+  {
+    detail::record_scan scan(settings.newline_behavior(),settings.delimiter(),
+      settings.escaped_binary_fields());
+
+    records = fields = 0;
+
+    std::size_t header = 1;
+    std::size_t avail;
+    while(header && (avail = scanner.available()) != 0)
+      scanner.fadvance(scan.scan(scanner.current(),avail,header));
+
+    if(header)
+      return;
+
+    while((avail = scanner.available()) != 0) {
+      scan.count(scanner.current(),avail);
+      scanner.fadvance(avail);
+    }
+
+    scan.finish();
+
+    records = scan.records();
+    fields = scan.fields();
+  }
+
+  /*
+      Translate the exception currently being handled into a return code
+      for the dsv_parse family of functions. Must only be called from within
+      a catch block.
+   */
+  int parse_error_code(void)
+  {
+    int err = 0;
+
+    try {
+      throw;
+    }
+    catch(std::system_error &ex) {
+      // system errors due to failed parser or memory error from parse
+      if(ex.code().category() == std::system_category())
+        err = ex.code().value();
+      else if(ex.code().category() == std::generic_category()) {
+        if(ex.code().value() == -1)
+          err = -1;
+        else
+          abort();
+      }
+      else
+        abort();
+    }
+    catch(std::bad_alloc &) {
+      err = ENOMEM;
+    }
+    catch(...) {
+      abort();
+    }
+
+    return err;
+  }
+
+  /*
+      Parse the file path as dsv_parse_file_mmap does and return its result.
+      Each file of dsv_parse_many is parsed with this.
+   */
+  int parse_file(const char *path, detail::parser &parser,
+    detail::parse_operations &operations)
+  {
+    int err = 0;
+
+    try {
+      parse_mapped(path,false,parser,operations);
+    }
+    catch(...) {
+      err = parse_error_code();
+    }
+
+    return err;
+  }
+
+  /*
+      Parse the records of scanner, which starts on line line, as the
+      records that follow the header already parsed with header_parser
+   */
+  void parse_records(detail::scanner_state &scanner, std::size_t line,
+    const detail::parser &header_parser,
+    detail::parse_operations &operations)
+  {
+    detail::parser parser(header_parser.settings());
+    parser.effective_newline(header_parser.effective_newline());
+    parser.effective_field_columns(header_parser.effective_field_columns());
+    parser.effective_field_columns_set(
+      header_parser.effective_field_columns_set());
+    parser.records_only(true);
+
+    std::vector<bool> mask(header_parser.column_mask());
+    parser.column_mask(mask);
+
+    if(parser.zero_copy_fields() && scanner.in_place())
+      parser.arena().input(scanner.region());
+
+    std::unique_ptr<detail::scanner_state> base_ctx;
+    std::shared_ptr<parser_pstate> pstate(parser_pstate_new(),
+      &parser_pstate_delete);
+    if(!pstate)
+      throw std::bad_alloc();
+
+    YYLTYPE lloc;
+    lloc.first_line = lloc.last_line = line;
+    lloc.first_column = lloc.last_column = 1;
+
+    int status = YYPUSH_MORE;
+    while(status == YYPUSH_MORE) {
+      YYSTYPE lval;
+      int token = parser_lex(&lval,&lloc,scanner,parser);
+      status = parser_push_parse(pstate.get(),token,&lval,&lloc,scanner,
+        parser,operations,base_ctx);
+    }
+
+    if(status != 0) {
+      if(status == 2)
+        throw std::system_error(ENOMEM,std::system_category());
+
+      operations.flush_records(parser.arena());
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+    }
+  }
+
+  /*
+      Divide the mapped file into at most n parts that begin and end at
+      record boundaries for dsv_split. header receives the length of the
+      header.
+   */
+  void split(const detail::mapped_file &file, std::size_t n,
+    bool after_header, const detail::parser_settings &settings,
+    std::vector<dsv_byte_range_t> &parts, std::size_t &header)
+  {
+    // the header settles a permissive newline behavior for the records
+    detail::record_scan scan(settings.newline_behavior(),
+      settings.delimiter(),settings.escaped_binary_fields());
+    std::size_t one = 1;
+    header = scan.scan(file.data(),file.size(),one);
+
+    std::size_t len = file.size()-header;
+    std::size_t threads = std::min<std::size_t>(n,
+      std::max(1u,std::thread::hardware_concurrency()));
+
+    detail::record_bounds located(file.data()+header,len,scan.lines()+1,
+      scan.newline(),settings.delimiter(),settings.escaped_binary_fields());
+    located.locate(len/n + (len%n != 0),threads);
+
+    const std::vector<const unsigned char *> &bounds = located.bounds();
+    const std::vector<std::size_t> &lines = located.lines();
+
+    parts.clear();
+    for(std::size_t i=0; i+1<bounds.size(); ++i) {
+      dsv_byte_range_t range;
+      range.offset = bounds[i]-file.data();
+      range.length = bounds[i+1]-bounds[i];
+      range.line = lines[i];
+      parts.push_back(range);
+    }
+
+    if(!after_header && header) {
+      if(parts.empty()) {
+        dsv_byte_range_t range;
+        range.offset = 0;
+        range.length = 0;
+        range.line = 1;
+        parts.push_back(range);
+      }
+
+      parts.front().offset = 0;
+      parts.front().length += header;
+      parts.front().line = 1;
+    }
+  }
+
+}
+
 extern "C" {
 
 int dsv_parser_create(dsv_parser_t *_parser)
@@ -53,11 +396,11 @@ int dsv_parser_create(dsv_parser_t *_parser)
   int err = 0;
 
   try {
-    std::unique_ptr<detail::parser> parser(new detail::parser);
+    std::unique_ptr<parser_handle> parser(new parser_handle);
 
-    parser->newline_behavior(dsv_newline_permissive);
-    parser->field_columns(0);
-    parser->delimiter(',');
+    parser->settings.newline_behavior(dsv_newline_permissive);
+    parser->settings.field_columns(0);
+    parser->settings.delimiter(',');
 
     _parser->p = parser.release();
   }
@@ -76,11 +419,11 @@ int dsv_parser_create_RFC4180_strict(dsv_parser_t *_parser)
   int err = 0;
 
   try {
-    std::unique_ptr<detail::parser> parser(new detail::parser);
+    std::unique_ptr<parser_handle> parser(new parser_handle);
 
-    parser->newline_behavior(dsv_newline_RFC4180_strict);
-    parser->field_columns(0);
-    parser->delimiter(',');
+    parser->settings.newline_behavior(dsv_newline_RFC4180_strict);
+    parser->settings.field_columns(0);
+    parser->settings.delimiter(',');
 
     _parser->p = parser.release();
   }
@@ -99,11 +442,11 @@ int dsv_parser_create_RFC4180_permissive(dsv_parser_t *_parser)
   int err = 0;
 
   try {
-    std::unique_ptr<detail::parser> parser(new detail::parser);
+    std::unique_ptr<parser_handle> parser(new parser_handle);
 
-    parser->newline_behavior(dsv_newline_permissive);
-    parser->field_columns(0);
-    parser->delimiter(',');
+    parser->settings.newline_behavior(dsv_newline_permissive);
+    parser->settings.field_columns(0);
+    parser->settings.delimiter(',');
 
     _parser->p = parser.release();
   }
@@ -120,7 +463,7 @@ int dsv_parser_create_RFC4180_permissive(dsv_parser_t *_parser)
 void dsv_parser_destroy(dsv_parser_t parser)
 {
   try {
-     delete static_cast<detail::parser*>(parser.p);
+     delete static_cast<parser_handle*>(parser.p);
   }
   catch(...) {
     abort();
@@ -134,12 +477,12 @@ int dsv_parser_set_newline_behavior(dsv_parser_t _parser, dsv_newline_behavior b
   if(!(behavior >= dsv_newline_permissive && behavior <= dsv_newline_crlf_strict))
     return EINVAL;
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   int result = 0;
 
   try {
-    parser.newline_behavior(behavior);
+    settings.newline_behavior(behavior);
   }
   catch(...) {
     abort();
@@ -152,12 +495,12 @@ dsv_newline_behavior dsv_parser_get_newline_behavior(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   dsv_newline_behavior result;
 
   try {
-    result = parser.newline_behavior();
+    result = settings.newline_behavior();
   }
   catch(...) {
     abort();
@@ -171,10 +514,10 @@ void dsv_parser_set_field_columns(dsv_parser_t _parser, ssize_t num_cols)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   try {
-    parser.field_columns(num_cols);
+    settings.field_columns(num_cols);
   }
   catch(...) {
     abort();
@@ -185,12 +528,12 @@ ssize_t dsv_parser_get_field_columns(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   ssize_t result;
 
   try {
-    result = parser.field_columns();
+    result = settings.field_columns();
   }
   catch(...) {
     abort();
@@ -203,10 +546,10 @@ void dsv_parser_set_field_delimiter(dsv_parser_t _parser, unsigned char delim)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   try {
-    parser.delimiter(delim);
+    settings.delimiter(delim);
   }
   catch(...) {
     abort();
@@ -217,12 +560,12 @@ unsigned char dsv_parser_get_field_delimiter(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   unsigned char result;
 
   try {
-    result = parser.delimiter();
+    result = settings.delimiter();
   }
   catch(...) {
     abort();
@@ -235,10 +578,10 @@ void dsv_parser_allow_escaped_binary_fields(dsv_parser_t _parser, int flag)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   try {
-    parser.escaped_binary_fields(flag);
+    settings.escaped_binary_fields(flag);
   }
   catch(...) {
     abort();
@@ -249,12 +592,108 @@ int dsv_parser_escaped_binary_fields_allowed(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  int result;
+
+  try {
+    result = settings.escaped_binary_fields();
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void dsv_parser_allow_zero_copy_fields(dsv_parser_t _parser, int flag)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  try {
+    settings.zero_copy_fields(flag);
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+int dsv_parser_zero_copy_fields_allowed(dsv_parser_t _parser)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
 
   int result;
 
   try {
-    result = parser.escaped_binary_fields();
+    result = settings.zero_copy_fields();
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void dsv_parser_set_skip_records(dsv_parser_t _parser, size_t n)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  try {
+    settings.skip_records(n);
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+size_t dsv_parser_get_skip_records(dsv_parser_t _parser)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  size_t result;
+
+  try {
+    result = settings.skip_records();
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void dsv_parser_set_max_records(dsv_parser_t _parser, size_t n)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  try {
+    settings.max_records(n);
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+size_t dsv_parser_get_max_records(dsv_parser_t _parser)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  size_t result;
+
+  try {
+    result = settings.max_records();
   }
   catch(...) {
     abort();
@@ -438,64 +877,1007 @@ void dsv_set_record_callback(record_callback_t fn, void *context,
   }
 }
 
-int dsv_parse(const char *location_str, FILE *stream, dsv_parser_t _parser,
-              dsv_operations_t _operations)
+record_batch_callback_t dsv_get_record_batch_callback(dsv_operations_t _operations)
 {
-  assert(_parser.p && _operations.p);
+  assert(_operations.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
-  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
 
-  int err = 0;
+  record_batch_callback_t result = 0;
 
   try {
-    //parser_debug = 1;
+    result = operations.record_batch_callback;
 
-    detail::scanner_state scanner(location_str,stream);
-    std::unique_ptr<detail::scanner_state> base_ctx;
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void * dsv_get_record_batch_context(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  void * result = 0;
+
+  try {
+    result = operations.record_batch_context;
 
-    parser.reset();
-    int err = parser_parse(scanner,parser,operations,base_ctx);
-    if(err != 0) {
-      if(err == 2)
-        throw std::system_error(ENOMEM,std::system_category());
-      throw std::system_error(-1,std::generic_category(),"Parse failed");
-    }
   }
-  catch(std::system_error &ex) {
-    // system errors due to failed parser or memory error from parse
-//    std::cerr << "got system error\n\n";
-    if(ex.code().category() == std::system_category())
-      err = ex.code().value();
-    else if(ex.code().category() == std::generic_category()) {
-      if(ex.code().value() == -1)
-        err = -1;
-      else
-        abort();
-    }
-    else
-      abort();
+  catch(...) {
+    abort();
   }
-  catch(std::bad_alloc &) {
-    err = ENOMEM;
+
+  return result;
+}
+
+
+
+void dsv_set_record_batch_callback(record_batch_callback_t fn, void *context,
+  dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  try {
+    operations.record_batch_callback = fn;
+    operations.record_batch_context = context;
   }
   catch(...) {
     abort();
   }
+}
 
-  return err;
+size_t dsv_get_record_batch_size(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  size_t result = 0;
+
+  try {
+    result = operations.batch_size;
+
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void dsv_set_record_batch_size(size_t records,
+  dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  try {
+    operations.batch_size = records;
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+size_t dsv_get_record_batch_bytes(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  size_t result = 0;
+
+  try {
+    result = operations.batch_bytes;
+
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void dsv_set_record_batch_bytes(size_t bytes,
+  dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  try {
+    operations.batch_bytes = bytes;
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+column_batch_callback_t dsv_get_column_batch_callback(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  column_batch_callback_t result = 0;
+
+  try {
+    result = operations.column_batch_callback;
+
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+void * dsv_get_column_batch_context(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  void * result = 0;
+
+  try {
+    result = operations.column_batch_context;
+
+  }
+  catch(...) {
+    abort();
+  }
+
+  return result;
+}
+
+
+
+void dsv_set_column_batch_callback(column_batch_callback_t fn, void *context,
+  dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  try {
+    operations.column_batch_callback = fn;
+    operations.column_batch_context = context;
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+int dsv_operations_set_projection(dsv_operations_t _operations,
+  const size_t *cols, size_t n)
+{
+  assert(_operations.p && (cols || n == 0));
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    operations.projection_columns.assign(cols,cols+n);
+    operations.projection_names.clear();
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_operations_set_projection_names(dsv_operations_t _operations,
+  const char * const names[], size_t n)
+{
+  assert(_operations.p && (names || n == 0));
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    operations.projection_names.assign(names,names+n);
+    operations.projection_columns.clear();
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_operations_add_predicate_equal(dsv_operations_t _operations,
+  size_t col, const unsigned char *value, size_t len)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::parse_operations::predicate pred;
+    pred.kind = detail::parse_operations::predicate::equal;
+    pred.column = col;
+    pred.value.assign(value,value+len);
+
+    operations.add_predicate(pred);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_operations_add_predicate_prefix(dsv_operations_t _operations,
+  size_t col, const unsigned char *prefix, size_t len)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::parse_operations::predicate pred;
+    pred.kind = detail::parse_operations::predicate::prefix;
+    pred.column = col;
+    pred.value.assign(prefix,prefix+len);
+
+    operations.add_predicate(pred);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_operations_add_predicate_range(dsv_operations_t _operations,
+  size_t col, double min, double max)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::parse_operations::predicate pred;
+    pred.kind = detail::parse_operations::predicate::range;
+    pred.column = col;
+    pred.min = min;
+    pred.max = max;
+
+    operations.add_predicate(pred);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+void dsv_operations_clear_predicates(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  try {
+    operations.predicates.clear();
+    operations.predicate_mask.clear();
+  }
+  catch(...) {
+    abort();
+  }
+}
+
+int dsv_operations_set_partitions(dsv_operations_t _operations,
+  const size_t keys[], size_t n, size_t partitions, partition_callback_t fn,
+  void *context)
+{
+  assert(_operations.p && keys && n && partitions && fn);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    operations.partition_keys.assign(keys,keys+n);
+    operations.partition_count = partitions;
+    operations.partition_callback = fn;
+    operations.partition_context = context;
+    operations.partition_files.clear();
+    operations.partition_state.reset();
+  }
+  catch(...) {
+    operations.partition_keys.clear();
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_operations_set_partition_files(dsv_operations_t _operations,
+  const size_t keys[], size_t n, FILE * const files[], size_t partitions,
+  unsigned char delimiter)
+{
+  assert(_operations.p && keys && n && files && partitions);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    operations.partition_keys.assign(keys,keys+n);
+    operations.partition_count = partitions;
+    operations.partition_callback = 0;
+    operations.partition_context = 0;
+    operations.partition_files.assign(files,files+partitions);
+    operations.partition_delimiter = delimiter;
+    operations.partition_state.reset(
+      new detail::parse_operations::partition_file_state);
+  }
+  catch(...) {
+    operations.partition_keys.clear();
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+void dsv_operations_clear_partitions(dsv_operations_t _operations)
+{
+  assert(_operations.p);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  operations.partition_keys.clear();
+  operations.partition_callback = 0;
+  operations.partition_context = 0;
+  operations.partition_files.clear();
+  operations.partition_state.reset();
+}
+
+int dsv_column_batch_export(dsv_operations_t _operations,
+  dsv_arrow_type type, struct ArrowSchema *schema, struct ArrowArray *array)
+{
+  assert(_operations.p && schema && array);
+
+  detail::parse_operations &operations =
+    *static_cast<detail::parse_operations*>(_operations.p);
+
+  if(!operations.column_batch_exportable)
+    return EINVAL;
+
+  int err = 0;
+
+  try {
+    detail::export_columns(operations.columns,operations.column_rows,
+      operations.column_names,(type == dsv_arrow_large_binary ? "Z" : "U"),
+      schema,array);
+
+    operations.column_batch_exportable = false;
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse(const char *location_str, FILE *stream, dsv_parser_t _parser,
+              dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::scanner_state scanner(location_str,stream);
+    detail::parser parser(settings);
+    parse(scanner,parser,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_validate(const char *location_str, FILE *stream, dsv_parser_t _parser,
+  int flags)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  int err = 0;
+
+  try {
+    detail::scanner_state scanner(location_str,stream);
+    if(!validate(scanner,settings,(flags & dsv_validate_all_errors)))
+      err = -1;
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_pipelined(const char *location_str, FILE *stream,
+  dsv_parser_t _parser, dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::pipelined_parse pipeline(location_str,stream);
+    detail::parser parser(settings);
+
+    operations.reset();
+    pipeline.run(parser,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_dispatched(const char *location_str, FILE *stream,
+  size_t workers, int flags, size_t key_column, void * const contexts[],
+  dsv_parser_t _parser, dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p && workers);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::scanner_state scanner(location_str,stream);
+    detail::dispatched_parse dispatch(workers,(flags & dsv_dispatch_by_key),
+      key_column,contexts);
+    dispatch.run(scanner,settings,operations,&parse);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_count_records(const char *location_str, FILE *stream,
+  dsv_parser_t _parser, size_t *records, size_t *fields)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  int err = 0;
+
+  try {
+    detail::scanner_state scanner(location_str,stream);
+
+    std::size_t num_records;
+    std::size_t num_fields;
+    count(scanner,settings,num_records,num_fields);
+
+    if(records)
+      *records = num_records;
+    if(fields)
+      *fields = num_fields;
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_buffer(const char *location_str, const unsigned char *data,
+  size_t len, dsv_parser_t _parser, dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+  assert(data || len == 0);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::scanner_state scanner(location_str,data,len);
+    detail::parser parser(settings);
+    parse(scanner,parser,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_file_mmap(const char *filename, int flags, dsv_parser_t _parser,
+  dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::parser parser(settings);
+    parse_mapped(filename,(flags & dsv_mmap_huge_pages),parser,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_file_parallel(const char *filename, size_t threads, int flags,
+  dsv_parser_t _parser, dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::mapped_file file(filename);
+    detail::parser parser(settings);
+
+    if(file.is_mapped()) {
+      // the header settles the newline behavior, the column count and the
+      // projection for the parts so it is parsed first on its own
+      detail::record_scan scan(settings.newline_behavior(),
+        settings.delimiter(),settings.escaped_binary_fields());
+      std::size_t header = 1;
+      std::size_t len = scan.scan(file.data(),file.size(),header);
+
+      detail::scanner_state scanner(filename,file.data(),len);
+      parse(scanner,parser,operations);
+
+      if(len < file.size()) {
+        detail::parallel_parse records(filename,file.data()+len,
+          file.size()-len,scan.lines()+1,threads,
+          !(flags & dsv_parallel_unordered));
+        records.run(parser,operations);
+      }
+    }
+    else {
+      // pipes, devices, and filesystems without mmap support
+      detail::scanner_state scanner(filename);
+      parse(scanner,parser,operations);
+    }
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_many(const char * const paths[], size_t n, size_t threads,
+  int flags, void * const contexts[], int results[], dsv_parser_t _parser,
+  dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::parse_many files(paths,contexts,n,threads,
+      (flags & dsv_many_ordered),&parse_file);
+    err = files.run(settings,operations,results);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_split(const char *filename, size_t n, int flags, dsv_parser_t _parser,
+  dsv_byte_range_t ranges[], size_t *parts)
+{
+  assert(_parser.p && ranges && parts);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  *parts = 0;
+
+  if(!n)
+    return EINVAL;
+
+  int err = 0;
+
+  try {
+    detail::mapped_file file(filename);
+    if(!file.is_mapped())
+      return EINVAL;
+
+    std::vector<dsv_byte_range_t> found;
+    std::size_t header = 0;
+    split(file,n,(flags & dsv_split_after_header),settings,found,header);
+
+    std::copy(found.begin(),found.end(),ranges);
+    *parts = found.size();
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_split_files(const char *filename, size_t n, int flags,
+  dsv_parser_t _parser, const char * const paths[], size_t *parts)
+{
+  assert(_parser.p && paths && parts);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  *parts = 0;
+
+  if(!n)
+    return EINVAL;
+
+  int err = 0;
+
+  try {
+    detail::mapped_file file(filename);
+    if(!file.is_mapped())
+      return EINVAL;
+
+    bool after_header = (flags & dsv_split_after_header);
+
+    std::vector<dsv_byte_range_t> found;
+    std::size_t header = 0;
+    split(file,n,after_header,settings,found,header);
+
+    detail::range_copy copy(filename);
+    for(std::size_t i=0; i<found.size(); ++i) {
+      copy.open(paths[i]);
+      if(after_header)
+        copy.copy(0,header);
+      copy.copy(found[i].offset,found[i].length);
+      copy.close();
+    }
+
+    *parts = found.size();
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_index_build(const char *filename, const char *index_path,
+  size_t stride, dsv_parser_t _parser)
+{
+  assert(_parser.p && index_path && stride);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  int err = 0;
+
+  try {
+    struct stat st;
+    if(stat(filename,&st) != 0)
+      return errno;
+
+    detail::mapped_file file(filename);
+    if(!file.is_mapped())
+      return EINVAL;
+
+    detail::record_index index;
+    index.build(file.data(),file.size(),stride,settings);
+    index.save(index_path,st);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_index_records(const char *index_path, size_t *records)
+{
+  assert(index_path && records);
+
+  int err = 0;
+
+  try {
+    detail::record_index index;
+    index.load(index_path,0);
+    *records = index.records();
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parse_range(const char *filename, const char *index_path,
+  size_t first_record, size_t count, dsv_parser_t _parser,
+  dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    detail::mapped_file file(filename);
+    if(!file.is_mapped())
+      return EINVAL;
+
+    const unsigned char *data = file.data();
+    std::size_t size = file.size();
+
+    detail::record_scan scan(settings.newline_behavior(),
+      settings.delimiter(),settings.escaped_binary_fields());
+
+    // the records to skip follow first_record as they follow the header in
+    // a parse
+    std::size_t start = first_record + settings.skip_records();
+    if(start < first_record)
+      start = std::numeric_limits<std::size_t>::max();
+
+    // where the records to pass over start
+    std::size_t header = 0;
+    std::size_t offset = 0;
+    std::size_t line = 1;
+    std::size_t skip = start;
+
+    if(index_path) {
+      struct stat st;
+      if(stat(filename,&st) != 0)
+        return errno;
+
+      detail::record_index index;
+      index.load(index_path,start);
+
+      if(!index.current(st))
+        return ESTALE;
+
+      if(!index.compatible(settings) || index.header_length() > size)
+        return EINVAL;
+
+      header = offset = index.header_length();
+      scan.newline(index.newline());
+
+      if(start < index.records()) {
+        skip = index.locate(start,offset,line);
+        if(offset > size)
+          return EINVAL;
+      }
+      else {
+        // past the last record
+        offset = size;
+        skip = 0;
+      }
+    }
+    else {
+      std::size_t one = 1;
+      header = offset = scan.scan(data,size,one);
+      line = scan.lines()+1;
+      scan.reset();
+    }
+
+    offset += scan.scan(data+offset,size-offset,skip);
+    line += scan.lines();
+
+    std::size_t n = count;
+    std::size_t end = offset + scan.scan(data+offset,size-offset,n);
+
+    detail::parser parser(settings);
+    detail::scanner_state header_scanner(filename,data,header);
+    parse(header_scanner,parser,operations);
+
+    detail::scanner_state scanner(filename,data+offset,end-offset);
+    parse_records(scanner,line,parser,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parser_feed(dsv_parser_t _parser, dsv_operations_t _operations,
+  const unsigned char *bytes, size_t len)
+{
+  assert(_parser.p && _operations.p);
+
+  parser_handle &parser = handle(_parser);
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    if(!parser.incremental_parse) {
+      operations.reset();
+      parser.incremental_parser =
+        std::make_shared<detail::parser>(parser.settings);
+      parser.incremental_parse = std::make_shared<detail::push_parser>();
+    }
+
+    parser.incremental_parse->feed(bytes,len,*parser.incremental_parser,
+      operations);
+  }
+  catch(...) {
+    parser.incremental_parse.reset();
+    parser.incremental_parser.reset();
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_parser_finish(dsv_parser_t _parser, dsv_operations_t _operations)
+{
+  assert(_parser.p && _operations.p);
+
+  parser_handle &parser = handle(_parser);
+  detail::parse_operations &operations = *static_cast<detail::parse_operations*>(_operations.p);
+
+  int err = 0;
+
+  try {
+    std::shared_ptr<detail::parser> context;
+    std::shared_ptr<detail::push_parser> push;
+    context.swap(parser.incremental_parser);
+    push.swap(parser.incremental_parse);
+
+    if(!push) {
+      operations.reset();
+      context = std::make_shared<detail::parser>(parser.settings);
+      push = std::make_shared<detail::push_parser>();
+    }
+
+    push->finish(*context,operations);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_reader_open(dsv_reader_t *_reader, const char *location_str,
+  FILE *stream, dsv_parser_t _parser)
+{
+  assert(_parser.p);
+
+  detail::parser_settings &settings = handle(_parser).settings;
+
+  int err = 0;
+
+  try {
+    _reader->p = new detail::reader(location_str,stream,settings);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_reader_header(dsv_reader_t _reader, const unsigned char * const **fields,
+  const size_t **lengths, size_t *size)
+{
+  assert(_reader.p);
+
+  detail::reader &reader = *static_cast<detail::reader*>(_reader.p);
+
+  int err = 0;
+
+  try {
+    err = reader.header(*fields,*lengths,*size);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+int dsv_reader_next(dsv_reader_t _reader, const unsigned char * const **fields,
+  const size_t **lengths, size_t *size)
+{
+  assert(_reader.p);
+
+  detail::reader &reader = *static_cast<detail::reader*>(_reader.p);
+
+  int err = 0;
+
+  try {
+    err = reader.next(*fields,*lengths,*size);
+  }
+  catch(...) {
+    err = parse_error_code();
+  }
+
+  return err;
+}
+
+void dsv_reader_close(dsv_reader_t reader)
+{
+  try {
+     delete static_cast<detail::reader*>(reader.p);
+  }
+  catch(...) {
+    abort();
+  }
 }
 
 log_callback_t dsv_get_logger_callback(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   log_callback_t result = 0;
 
   try {
-    result = parser.log_callback();
+    result = settings.log_callback();
   }
   catch(...) {
     abort();
@@ -514,12 +1896,12 @@ void * dsv_get_logger_context(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   void *result = 0;
 
   try {
-    result = parser.log_context();
+    result = settings.log_context();
   }
   catch(...) {
     abort();
@@ -532,12 +1914,12 @@ dsv_log_level dsv_get_log_level(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   dsv_log_level result;
 
   try {
-    result = parser.log_level();
+    result = settings.log_level();
   }
   catch(...) {
     abort();
@@ -556,12 +1938,12 @@ dsv_log_level dsv_get_log_level(dsv_parser_t _parser)
 {
   assert(_parser.p);
 
-  detail::parser &parser = *static_cast<detail::parser*>(_parser.p);
+  detail::parser_settings &settings = handle(_parser).settings;
 
   try {
-    parser.log_callback(fn);
-    parser.log_context(context);
-    parser.log_level(level);
+    settings.log_callback(fn);
+    settings.log_context(context);
+    settings.log_level(level);
   }
   catch(...) {
     abort();
@@ -0,0 +1,147 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_MAPPED_FILE_H
+#define LIBDSV_MAPPED_FILE_H
+
+#include <cstddef>
+#include <system_error>
+
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace detail {
+
+  /**
+   *  Read-only mapping of a file. Only regular files are mapped. If the file
+   *  is not a regular file, reports a size of 0 but has content or the
+   *  system refuses to map it, is_mapped() returns false and the caller is
+   *  expected to fall back to stream reads.
+   */
+  class mapped_file {
+    public:
+      mapped_file(const char *filename, bool huge_pages=false);
+      ~mapped_file(void);
+
+      bool is_mapped(void) const;
+
+      const unsigned char * data(void) const;
+      std::size_t size(void) const;
+
+    private:
+      void *addr;
+      std::size_t len;
+      bool mapped;
+
+      mapped_file(const mapped_file &);
+      mapped_file & operator=(const mapped_file &);
+  };
+
+  inline mapped_file::mapped_file(const char *filename, bool huge_pages)
+    :addr(0), len(0), mapped(false)
+  {
+    errno = 0;
+    int fd = open(filename,O_RDONLY);
+    if(fd < 0)
+      throw std::system_error(errno,std::system_category());
+
+    struct stat st;
+    if(fstat(fd,&st) != 0) {
+      int err = errno;
+      close(fd);
+      throw std::system_error(err,std::system_category());
+    }
+
+    if(S_ISREG(st.st_mode)) {
+      len = st.st_size;
+
+      // mmap refuses zero length mappings. Files of procfs, sysfs and some
+      // FUSE filesystems report a size of 0 but still have content so only a
+      // file that has nothing to read is an empty region. Otherwise it is
+      // left to the stream reads
+      if(len == 0) {
+        unsigned char probe;
+        ssize_t n;
+        while((n = read(fd,&probe,1)) < 0 && errno == EINTR)
+          ;
+        mapped = (n == 0);
+      }
+      else {
+        addr = mmap(0,len,PROT_READ,MAP_PRIVATE,fd,0);
+        if(addr != MAP_FAILED) {
+          mapped = true;
+
+          // advisory only, failures are harmless
+          madvise(addr,len,MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+          if(huge_pages)
+            madvise(addr,len,MADV_HUGEPAGE);
+#endif
+        }
+        else {
+          addr = 0;
+          len = 0;
+        }
+      }
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+  }
+
+  inline mapped_file::~mapped_file(void)
+  {
+    if(addr)
+      munmap(addr,len);
+  }
+
+  inline bool mapped_file::is_mapped(void) const
+  {
+    return mapped;
+  }
+
+  inline const unsigned char * mapped_file::data(void) const
+  {
+    return static_cast<const unsigned char *>(addr);
+  }
+
+  inline std::size_t mapped_file::size(void) const
+  {
+    return len;
+  }
+
+}
+
+#endif
@@ -0,0 +1,402 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_PARALLEL_PARSE_H
+#define LIBDSV_PARALLEL_PARSE_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "scanner_state.h"
+#include "record_scan.h"
+#include "record_bounds.h"
+#include "collected_parse.h"
+#include "dsv_grammar.hh"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <system_error>
+#include <new>
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace detail {
+
+  /**
+   *  Parse the records of content held in memory, such as a mapped file,
+   *  with several threads.
+   *
+   *  The content is divided by record_bounds into chunks that end at record
+   *  boundaries so a newline in an escaped field never splits a record. The
+   *  threads share the scan for the boundaries and then parse the chunks
+   *  concurrently, each with its own parser and operations, and collect the
+   *  records and log messages. The calling thread passes them on to the real
+   *  operations and logger chunk by chunk, either in the order of the
+   *  content or in the order the chunks finish.
+   *  The callbacks are therefore only ever called by the calling thread and
+   *  one at a time.
+   *
+   *  The header must already have been parsed with p and operations so that
+   *  the newline behavior, the column count, the projection and the
+   *  predicates are settled. The records to skip are passed over without
+   *  being parsed, as in a sequential parse, before the content is divided.
+   *  The maximum number of records is applied as the records are
+   *  passed on.
+   *
+   *  As with parse in dsv_parser.cc, a failed parse is reported by throwing
+   *  std::system_error.
+   */
+  class parallel_parse {
+    public:
+      parallel_parse(const char *str, const unsigned char *data,
+        std::size_t len, std::size_t first_line, std::size_t threads,
+        bool ordered);
+
+      void run(parser &p, parse_operations &operations);
+
+    private:
+      /*
+          A part of the content and its parsed records
+       */
+      struct chunk {
+        std::size_t index;
+        const unsigned char *begin;
+        const unsigned char *end;
+        std::size_t line;
+
+        collected_parse parsed;
+
+        chunk(void) :index(0), begin(0), end(0), line(1) {}
+      };
+
+      // the smallest and largest chunks
+      enum {
+        min_chunk_bytes = 256*1024,
+        max_chunk_bytes = 16*1024*1024
+      };
+
+      std::string fname;
+      const unsigned char *content_end;
+      std::size_t threads;
+      bool ordered;
+      std::size_t chunk_bytes;
+
+      // how a chunk is parsed
+      parser_settings chunk_settings;
+      parse_operations chunk_operations;
+
+      // the parse state the header left that each chunk starts from
+      dsv_newline_behavior chunk_newline;
+      ssize_t chunk_columns;
+      bool chunk_columns_set;
+      std::vector<bool> chunk_mask;
+
+      std::mutex lock;
+      std::condition_variable changed;
+
+      // the start of the content left after the records to skip
+      const unsigned char *next;
+      std::size_t next_line;
+
+      // chunk i is [bounds[i],bounds[i+1]) and starts on line bound_lines[i]
+      std::vector<const unsigned char *> bounds;
+      std::vector<std::size_t> bound_lines;
+
+      // the number of chunks claimed and passed on and those parsed but not
+      // yet passed on by index, guarded by lock
+      std::size_t claimed;
+      std::size_t delivered;
+      std::map<std::size_t,std::unique_ptr<chunk> > finished;
+
+      bool stopping;
+
+      void locate_chunks(void);
+
+      void work(void);
+      bool claim(chunk &c);
+      bool all_claimed(void) const;
+      void parse_chunk(chunk &c);
+      void stop(std::vector<std::thread> &workers);
+
+      parallel_parse(const parallel_parse &);
+      parallel_parse & operator=(const parallel_parse &);
+  };
+
+  inline parallel_parse::parallel_parse(const char *str,
+    const unsigned char *data, std::size_t len, std::size_t first_line,
+    std::size_t n, bool in_order) :content_end(data+len), threads(n),
+    ordered(in_order), chunk_newline(dsv_newline_permissive),
+    chunk_columns(0), chunk_columns_set(false), next(data),
+    next_line(first_line), claimed(0), delivered(0),
+    stopping(false)
+  {
+    if(str)
+      fname = str;
+
+    if(!threads)
+      threads = std::max(1u,std::thread::hardware_concurrency());
+
+    chunk_bytes = std::min<std::size_t>(
+      std::max<std::size_t>(len/threads,min_chunk_bytes),max_chunk_bytes);
+  }
+
+  inline void parallel_parse::run(parser &p, parse_operations &operations)
+  {
+    chunk_settings = p.settings();
+    chunk_settings.zero_copy_fields(true);
+    chunk_settings.skip_records(0);
+    chunk_settings.max_records(0);
+
+    // the state the header established
+    chunk_newline = p.effective_newline();
+    chunk_columns = p.effective_field_columns();
+    chunk_columns_set = p.effective_field_columns_set();
+    chunk_mask = p.column_mask();
+
+    chunk_operations.projection = operations.projection;
+    chunk_operations.predicates = operations.predicates;
+    chunk_operations.predicate_mask = operations.predicate_mask;
+    chunk_operations.filtering = operations.filtering;
+
+    if(p.records_to_skip()) {
+      record_scan scan(chunk_newline,chunk_settings.delimiter(),
+        chunk_settings.escaped_binary_fields());
+
+      std::size_t skip = p.records_to_skip();
+      next += scan.scan(next,content_end-next,skip);
+      next_line += scan.lines();
+      p.records_to_skip(0);
+    }
+
+    locate_chunks();
+
+    std::vector<std::thread> workers;
+    try {
+      for(std::size_t i=0; i<threads; ++i)
+        workers.push_back(std::thread(&parallel_parse::work,this));
+    }
+    catch(std::system_error &) {
+      // make do with the threads that could be started
+      if(workers.empty())
+        throw std::system_error(EAGAIN,std::system_category());
+    }
+
+    int result = 1;
+    while(result > 0) {
+      std::unique_ptr<chunk> c;
+
+      {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while(true) {
+          if(ordered) {
+            auto found = finished.find(delivered);
+            if(found != finished.end()) {
+              c = std::move(found->second);
+              finished.erase(found);
+              break;
+            }
+          }
+          else if(!finished.empty()) {
+            c = std::move(finished.begin()->second);
+            finished.erase(finished.begin());
+            break;
+          }
+
+          if(all_claimed() && delivered == claimed)
+            break;
+
+          changed.wait(guard);
+        }
+      }
+
+      if(!c)
+        break;
+
+      try {
+        result = c->parsed.deliver(p,operations);
+      }
+      catch(...) {
+        stop(workers);
+        throw;
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        ++delivered;
+      }
+      changed.notify_all();
+    }
+
+    stop(workers);
+
+    if(result < 0)
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+  }
+
+  inline void parallel_parse::work(void)
+  {
+    while(true) {
+      std::unique_ptr<chunk> c;
+
+      try {
+        c.reset(new chunk);
+      }
+      catch(std::bad_alloc &) {
+        abort();
+      }
+
+      if(!claim(*c))
+        return;
+
+      parse_chunk(*c);
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        finished[c->index] = std::move(c);
+      }
+      changed.notify_all();
+    }
+  }
+
+  /*
+      Divide [next,content_end) into chunks that end at record boundaries
+   */
+  inline void parallel_parse::locate_chunks(void)
+  {
+    record_bounds located(next,content_end-next,next_line,chunk_newline,
+      chunk_settings.delimiter(),chunk_settings.escaped_binary_fields());
+    located.locate(chunk_bytes,threads);
+
+    bounds = located.bounds();
+    bound_lines = located.lines();
+  }
+
+  /*
+      Take the next chunk for c. Returns false if there is none or the parse
+      is stopping
+   */
+  inline bool parallel_parse::claim(chunk &c)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+
+    // bound the chunks held in memory
+    while(!stopping && !all_claimed() && claimed-delivered >= 2*threads)
+      changed.wait(guard);
+
+    if(stopping || all_claimed())
+      return false;
+
+    c.index = claimed;
+    c.begin = bounds[claimed];
+    c.end = bounds[claimed+1];
+    c.line = bound_lines[claimed];
+    ++claimed;
+
+    return true;
+  }
+
+  inline bool parallel_parse::all_claimed(void) const
+  {
+    return claimed+1 >= bounds.size();
+  }
+
+  inline void parallel_parse::parse_chunk(chunk &c)
+  {
+    try {
+      parser_settings settings(chunk_settings);
+      parse_operations operations(chunk_operations);
+      c.parsed.collect(settings,operations);
+
+      parser p(settings);
+      p.effective_newline(chunk_newline);
+      p.effective_field_columns(chunk_columns);
+      p.effective_field_columns_set(chunk_columns_set);
+      p.records_only(true);
+
+      std::vector<bool> mask(chunk_mask);
+      p.column_mask(mask);
+
+      scanner_state scanner(fname.c_str(),c.begin,c.end-c.begin);
+      p.arena().input(scanner.region());
+
+      std::unique_ptr<scanner_state> base_ctx;
+      std::shared_ptr<parser_pstate> pstate(parser_pstate_new(),
+        &parser_pstate_delete);
+      if(!pstate)
+        throw std::bad_alloc();
+
+      YYLTYPE lloc;
+      lloc.first_line = lloc.last_line = c.line;
+      lloc.first_column = lloc.last_column = 1;
+
+      int status = YYPUSH_MORE;
+      while(status == YYPUSH_MORE) {
+        YYSTYPE lval;
+        int token = parser_lex(&lval,&lloc,scanner,p);
+        status = parser_push_parse(pstate.get(),token,&lval,&lloc,scanner,p,
+          operations,base_ctx);
+      }
+
+      if(status == 2)
+        c.parsed.status(ENOMEM);
+      else if(status != 0)
+        c.parsed.status(-1);
+    }
+    catch(std::bad_alloc &) {
+      c.parsed.status(ENOMEM);
+    }
+    catch(...) {
+      abort();
+    }
+  }
+
+  inline void parallel_parse::stop(std::vector<std::thread> &workers)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    changed.notify_all();
+
+    for(std::size_t i=0; i<workers.size(); ++i)
+      workers[i].join();
+    workers.clear();
+  }
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_PARSE_MANY_H
+#define LIBDSV_PARSE_MANY_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "collected_parse.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <system_error>
+#include <new>
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace detail {
+
+  /**
+   *  Parse many files with several threads, each file on its own as by
+   *  dsv_parse.
+   *
+   *  The threads take the files in turn from a shared position so a thread
+   *  that finishes a small file moves straight on to the next one while the
+   *  others are still busy. Each file is parsed with its own parser state,
+   *  built from the shared settings, and its own copy of the operations in
+   *  which the contexts may be replaced by one for the file.
+   *
+   *  Unordered, the callbacks are called by the threads as each file is
+   *  parsed so the callbacks of different files may be called concurrently.
+   *  Ordered, each parse is collected and the calling thread passes the
+   *  files on one at a time in the order given, as parallel_parse does with
+   *  the parts of a single file.
+   *
+   *  The parse of a single file is left to parse_file, which returns the
+   *  result of dsv_parse for it.
+   */
+  class parse_many {
+    public:
+      typedef int (*parse_function)(const char *path, parser &p,
+        parse_operations &operations);
+
+      parse_many(const char * const paths[], void * const contexts[],
+        std::size_t n, std::size_t threads, bool ordered,
+        parse_function parse_file);
+
+      /*
+          Parse every file. The result for file i is stored in results[i]
+          if results is not zero. Returns the first result that is not zero
+          in the order of the files or 0 if all succeeded. Throws
+          std::system_error if no thread could be started
+       */
+      int run(const parser_settings &settings,
+        const parse_operations &operations, int results[]);
+
+    private:
+      const char * const *paths;
+      void * const *contexts;
+      std::size_t size;
+      std::size_t threads;
+      bool ordered;
+      parse_function parse_file;
+
+      const parser_settings *settings;
+      const parse_operations *operations;
+      std::vector<int> file_results;
+
+      std::mutex lock;
+      std::condition_variable changed;
+
+      // the number of files claimed and passed on and, ordered, whether
+      // each file has been parsed, guarded by lock
+      std::size_t claimed;
+      std::size_t delivered;
+      std::vector<char> finished;
+
+      // ordered, the collected parse of each file until it is passed on
+      std::vector<std::unique_ptr<collected_parse> > collected;
+
+      void work(void);
+      bool claim(std::size_t &index);
+      int parse_file_at(std::size_t index);
+
+      /*
+          The operations for file index with its context, if any
+       */
+      void file_operations(std::size_t index, parse_operations &ops) const;
+
+      int deliver(std::size_t index);
+
+      parse_many(const parse_many &);
+      parse_many & operator=(const parse_many &);
+  };
+
+  inline parse_many::parse_many(const char * const file_paths[],
+    void * const file_contexts[], std::size_t n, std::size_t nthreads,
+    bool in_order, parse_function fn) :paths(file_paths),
+    contexts(file_contexts), size(n), threads(nthreads), ordered(in_order),
+    parse_file(fn), settings(0), operations(0), file_results(n,0),
+    claimed(0), delivered(0), finished(in_order ? n : 0),
+    collected(in_order ? n : 0)
+  {
+    if(!threads)
+      threads = std::max(1u,std::thread::hardware_concurrency());
+
+    threads = std::min(threads,std::max<std::size_t>(size,1));
+  }
+
+  inline int parse_many::run(const parser_settings &s,
+    const parse_operations &ops, int results[])
+  {
+    settings = &s;
+    operations = &ops;
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+
+    try {
+      for(std::size_t i=0; i<threads; ++i)
+        workers.push_back(std::thread(&parse_many::work,this));
+    }
+    catch(std::system_error &) {
+      // make do with the threads that could be started
+      if(workers.empty())
+        throw std::system_error(EAGAIN,std::system_category());
+    }
+
+    while(ordered) {
+      std::size_t index;
+
+      {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while(delivered < size && !finished[delivered])
+          changed.wait(guard);
+
+        if(delivered == size)
+          break;
+
+        index = delivered;
+      }
+
+      if(collected[index])
+        file_results[index] = deliver(index);
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        ++delivered;
+      }
+      changed.notify_all();
+    }
+
+    for(std::size_t i=0; i<workers.size(); ++i)
+      workers[i].join();
+
+    int result = 0;
+    for(std::size_t i=0; i<size; ++i) {
+      if(results)
+        results[i] = file_results[i];
+      if(!result)
+        result = file_results[i];
+    }
+
+    return result;
+  }
+
+  inline void parse_many::work(void)
+  {
+    std::size_t index;
+    while(claim(index)) {
+      try {
+        file_results[index] = parse_file_at(index);
+      }
+      catch(std::bad_alloc &) {
+        file_results[index] = ENOMEM;
+      }
+
+      if(ordered) {
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          finished[index] = true;
+        }
+        changed.notify_all();
+      }
+    }
+  }
+
+  /*
+      Parse file index. Unordered, it is passed straight on. Ordered, it is
+      collected and the result of the parse kept with it
+   */
+  inline int parse_many::parse_file_at(std::size_t index)
+  {
+    parse_operations ops;
+    file_operations(index,ops);
+
+    if(!ordered) {
+      parser p(*settings);
+      return parse_file(paths[index],p,ops);
+    }
+
+    std::unique_ptr<collected_parse> parsed(new collected_parse);
+
+    parser_settings collecting(*settings);
+    parsed->collect(collecting,ops);
+
+    parser p(collecting);
+    parsed->status(parse_file(paths[index],p,ops));
+
+    collected[index] = std::move(parsed);
+
+    return 0;
+  }
+
+  /*
+      Take the next file. Ordered, the files parsed but not yet passed on
+      are bounded. Returns false once every file has been claimed
+   */
+  inline bool parse_many::claim(std::size_t &index)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(ordered && claimed < size && claimed-delivered >= 2*threads)
+      changed.wait(guard);
+
+    if(claimed == size)
+      return false;
+
+    index = claimed++;
+
+    return true;
+  }
+
+  inline void parse_many::file_operations(std::size_t index,
+    parse_operations &ops) const
+  {
+    ops = *operations;
+
+    if(contexts) {
+      ops.header_context = contexts[index];
+      ops.record_context = contexts[index];
+      ops.record_batch_context = contexts[index];
+      ops.column_batch_context = contexts[index];
+      ops.partition_context = contexts[index];
+    }
+  }
+
+  /*
+      Pass on the collected parse of file index and release it. Returns the
+      result for the file
+   */
+  inline int parse_many::deliver(std::size_t index)
+  {
+    std::unique_ptr<collected_parse> parsed(std::move(collected[index]));
+
+    try {
+      parser p(*settings);
+      parse_operations ops;
+      file_operations(index,ops);
+      ops.reset();
+
+      return (parsed->deliver(p,ops) < 0 ? -1 : 0);
+    }
+    catch(std::system_error &ex) {
+      return ex.code().value();
+    }
+    catch(std::bad_alloc &) {
+      return ENOMEM;
+    }
+  }
+
+}
+
+#endif
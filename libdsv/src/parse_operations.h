@@ -33,11 +33,45 @@
 
 
 #include "dsv_parser.h"
+#include "record_arena.h"
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <locale>
+#include <algorithm>
+#include <system_error>
+
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
 
 namespace detail {
 
+  /*
+      A hash of the fields of the columns keys of a record with size fields,
+      missing fields being empty. FNV-1a with the length of each field mixed
+      in so that the fields of the key cannot run into one another
+   */
+  inline std::uint64_t key_hash(const unsigned char * const fields[],
+    const std::size_t lengths[], std::size_t size, const std::size_t keys[],
+    std::size_t nkeys)
+  {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for(std::size_t k=0; k<nkeys; ++k) {
+      std::size_t len = (keys[k] < size ? lengths[keys[k]] : 0);
+      for(std::size_t i=0; i<len; ++i)
+        hash = (hash ^ fields[keys[k]][i]) * 1099511628211ULL;
+
+      hash = (hash ^ len) * 1099511628211ULL;
+    }
+
+    return hash;
+  }
+
   struct parse_operations {
     header_callback_t header_callback;
     void *header_context;
@@ -45,19 +79,667 @@ namespace detail {
     record_callback_t record_callback;
     void *record_context;
 
+    record_batch_callback_t record_batch_callback;
+    void *record_batch_context;
+
+    // limits on the number of records and field bytes in a batch. 0 is
+    // unlimited
+    std::size_t batch_size;
+    std::size_t batch_bytes;
+
     // storage cache for callback functions to avoid memory (re)allocation for each
     // call.
     std::vector<const unsigned char *> field_storage;
     std::vector<std::size_t> len_storage;
+    std::vector<std::size_t> offset_storage;
+
+    column_batch_callback_t column_batch_callback;
+    void *column_batch_context;
+
+    // the values of a column in the current column batch. offsets has one
+    // more entry than there are rows
+    struct column_buffer {
+      std::vector<unsigned char> data;
+      std::vector<int64_t> offsets;
+    };
+
+    std::vector<column_buffer> columns;
+    std::vector<dsv_column_t> column_storage;
+    std::size_t column_rows;
+
+    // the header fields of the current parse
+    std::vector<std::string> column_names;
+
+    // true while the current column batch is being passed on and has not
+    // been exported
+    bool column_batch_exportable;
+
+    // the columns passed on by number or by name. At most one is set
+    std::vector<std::size_t> projection_columns;
+    std::vector<std::string> projection_names;
+
+    // the columns passed on in the current parse. All if empty
+    std::vector<std::size_t> projection;
+
+    // a condition on the field of a column that a record must meet to be
+    // passed on
+    struct predicate {
+      enum kind_type {
+        equal,
+        prefix,
+        range
+      };
+
+      kind_type kind;
+      std::size_t column;
+
+      // equal and prefix
+      std::vector<unsigned char> value;
+
+      // range
+      double min;
+      double max;
+
+      predicate(void) :kind(equal), column(0), min(0), max(0) {}
+
+      bool passes(const unsigned char *data, std::size_t len) const;
+    };
+
+    std::vector<predicate> predicates;
+
+    // the columns with at least one predicate
+    std::vector<bool> predicate_mask;
+
+    // true once the records of the current parse are reached and there are
+    // predicates
+    bool filtering;
+
+    // a field of the record being parsed failed a predicate
+    bool record_rejected;
+
+    // field lists of the records parsed but not yet passed to
+    // record_batch_callback. Their content is kept in the arena until then
+    std::vector<record_arena::span> pending_records;
+    std::size_t pending_bytes;
+
+    // records are routed to one of partition_count partitions by a hash of
+    // the fields of the columns partition_keys in place of the callbacks.
+    // Partitioning is off if there are no keys
+    std::vector<std::size_t> partition_keys;
+    std::size_t partition_count;
+
+    // each partition is passed to partition_callback or, if it is not set,
+    // written to its file as delimited text
+    partition_callback_t partition_callback;
+    void *partition_context;
+    std::vector<FILE *> partition_files;
+    unsigned char partition_delimiter;
+
+    // shared by every copy of the operations made for the files or workers
+    // of a parse so that the header is written to the files once, when the
+    // first is passed on, and lines from several threads do not interleave
+    struct partition_file_state {
+      std::mutex lock;
+      bool header_written;
+
+      partition_file_state(void) :header_written(false) {}
+    };
+
+    std::shared_ptr<partition_file_state> partition_state;
+    std::vector<unsigned char> partition_buffer;
 
     parse_operations(void);
+
+    /*
+        Pass on the header with field list, which has already been projected,
+        to header_callback and keep the names of the columns for the column
+        batches. Returns the result of the callback. The arena is released
+     */
+    bool deliver_header(record_arena &arena, const record_arena::span &list);
+
+    /*
+        Pass on the record with field list, which has already been projected
+        and accepted, to whichever callback is set and return the result. The
+        arena is released unless the record is held in a batch
+     */
+    bool deliver_record(record_arena &arena, const record_arena::span &list);
+
+    /*
+        Add the record with field list to the current batch. Passes the
+        batch to record_batch_callback if it is full and returns the result
+     */
+    bool batch_record(record_arena &arena, const record_arena::span &list);
+
+    /*
+        Append the fields of the record with field list to the columns of
+        the current column batch. Passes the batch to column_batch_callback
+        if it is full and returns the result
+     */
+    bool column_record(const record_arena &arena,
+      const record_arena::span &list);
+
+    /*
+        Pass any records in the current batch to record_batch_callback or
+        column_batch_callback and return the result
+     */
+    bool flush_records(record_arena &arena);
+
+    /*
+        Drop any records in the current batch without passing them on
+     */
+    void discard_records(void);
+
+    /*
+        Route the record with field list to its partition and return the
+        result of the callback. A failed write is thrown as
+        std::system_error
+     */
+    bool partition_record(const record_arena &arena,
+      const record_arena::span &list);
+
+    /*
+        Format the fields as a line of delimited text in partition_buffer
+     */
+    void format_partition(const unsigned char * const fields[],
+      const std::size_t lengths[], std::size_t size);
+
+    /*
+        Write partition_buffer to the file of partition. The lock of
+        partition_state must be held
+     */
+    void write_partition(std::size_t partition);
+
+    /*
+        Send the header and records of a parse to header and record with
+        context in place of the callbacks, batches and partitions set. For
+        the parses that collect records in one thread to be passed on in
+        another. The projection and the predicates are kept
+     */
+    void redirect(header_callback_t header, record_callback_t record,
+      void *context);
+
+    /*
+        Prepare for a new parse
+     */
+    void reset(void);
+
+    void add_predicate(const predicate &pred);
+    bool has_predicate(std::size_t column) const;
+
+    /*
+        True if the field of column passes its predicates
+     */
+    bool field_passes(std::size_t column, const unsigned char *data,
+      std::size_t len) const;
+
+    /*
+        True if the record that was just parsed with fields fields is passed
+        on. Missing fields are empty. Resets the rejection for the next
+        record
+     */
+    bool accept_record(std::size_t fields);
+
+    bool batch_full(void) const;
+    bool flush_columns(void);
   };
 
   inline parse_operations::parse_operations(void) :header_callback(0), header_context(0),
-    record_callback(0), record_context(0)
+    record_callback(0), record_context(0), record_batch_callback(0),
+    record_batch_context(0), batch_size(1024), batch_bytes(1024*1024),
+    column_batch_callback(0), column_batch_context(0), column_rows(0),
+    column_batch_exportable(false), filtering(false), record_rejected(false),
+    pending_bytes(0), partition_count(0), partition_callback(0),
+    partition_context(0), partition_delimiter(',')
+  {
+  }
+
+  inline bool parse_operations::deliver_header(record_arena &arena,
+    const record_arena::span &list)
+  {
+    const record_arena::span *fields = arena.fields(list);
+
+    if(column_batch_callback) {
+      // names of the columns when exported
+      column_names.resize(list.len);
+      for(std::size_t i=0; i<list.len; ++i) {
+        const unsigned char *data = arena.data(fields[i]);
+        column_names[i].assign(data,data+fields[i].len);
+      }
+    }
+
+    bool keep_going = true;
+    if(header_callback && !list.len)
+      keep_going = header_callback(0,0,0,header_context);
+    else if(header_callback) {
+      field_storage.clear();
+      len_storage.clear();
+      field_storage.reserve(list.len);
+      len_storage.reserve(list.len);
+
+      for(std::size_t i=0; i<list.len; ++i) {
+        field_storage.push_back(arena.data(fields[i]));
+        len_storage.push_back(fields[i].len);
+      }
+
+      keep_going = header_callback(field_storage.data(),len_storage.data(),
+        field_storage.size(),header_context);
+    }
+
+    // every partition file starts with the header
+    if(keep_going && !partition_keys.empty() && !partition_callback) {
+      std::lock_guard<std::mutex> guard(partition_state->lock);
+
+      if(!partition_state->header_written) {
+        partition_state->header_written = true;
+
+        field_storage.clear();
+        len_storage.clear();
+
+        for(std::size_t i=0; i<list.len; ++i) {
+          field_storage.push_back(arena.data(fields[i]));
+          len_storage.push_back(fields[i].len);
+        }
+
+        format_partition(field_storage.data(),len_storage.data(),list.len);
+        for(std::size_t i=0; i<partition_files.size(); ++i)
+          write_partition(i);
+      }
+    }
+
+    arena.release();
+
+    return keep_going;
+  }
+
+  inline bool parse_operations::deliver_record(record_arena &arena,
+    const record_arena::span &list)
+  {
+    if(!partition_keys.empty()) {
+      bool keep_going = partition_record(arena,list);
+      arena.release();
+      return keep_going;
+    }
+
+    if(column_batch_callback) {
+      bool keep_going = column_record(arena,list);
+      arena.release();
+      return keep_going;
+    }
+
+    // the arena keeps the content of batched records until the batch is
+    // passed on
+    if(record_batch_callback)
+      return batch_record(arena,list);
+
+    bool keep_going = true;
+    if(record_callback) {
+      if(!list.len)
+        keep_going = record_callback(0,0,0,record_context);
+      else {
+        const record_arena::span *fields = arena.fields(list);
+
+        field_storage.clear();
+        len_storage.clear();
+        field_storage.reserve(list.len);
+        len_storage.reserve(list.len);
+
+        for(size_t i=0; i<list.len; ++i) {
+          field_storage.push_back(arena.data(fields[i]));
+          len_storage.push_back(fields[i].len);
+        }
+
+        keep_going = record_callback(field_storage.data(),len_storage.data(),
+          field_storage.size(),record_context);
+      }
+    }
+
+    arena.release();
+
+    return keep_going;
+  }
+
+  inline bool parse_operations::batch_record(record_arena &arena,
+    const record_arena::span &list)
+  {
+    const record_arena::span *fields = arena.fields(list);
+    for(std::size_t i=0; i<list.len; ++i)
+      pending_bytes += fields[i].len;
+
+    pending_records.push_back(list);
+
+    if(batch_full())
+      return flush_records(arena);
+
+    return true;
+  }
+
+  inline bool parse_operations::column_record(const record_arena &arena,
+    const record_arena::span &list)
   {
+    if(columns.size() < list.len) {
+      // a column first seen in this row is empty in all previous rows
+      std::size_t first = columns.size();
+      columns.resize(list.len);
+      for(std::size_t i=first; i<columns.size(); ++i)
+        columns[i].offsets.assign(column_rows+1,0);
+    }
+
+    const record_arena::span *fields = arena.fields(list);
+    for(std::size_t i=0; i<list.len; ++i) {
+      column_buffer &column = columns[i];
+      const unsigned char *data = arena.data(fields[i]);
+
+      column.data.insert(column.data.end(),data,data+fields[i].len);
+      column.offsets.push_back(column.data.size());
+      pending_bytes += fields[i].len;
+    }
+
+    // and a short row is empty in the remaining columns
+    for(std::size_t i=list.len; i<columns.size(); ++i)
+      columns[i].offsets.push_back(columns[i].data.size());
+
+    ++column_rows;
+
+    if(batch_full())
+      return flush_columns();
+
+    return true;
   }
 
+  inline bool parse_operations::flush_records(record_arena &arena)
+  {
+    if(column_batch_callback)
+      return flush_columns();
+
+    if(pending_records.empty())
+      return true;
+
+    field_storage.clear();
+    len_storage.clear();
+    offset_storage.clear();
+    offset_storage.reserve(pending_records.size()+1);
+
+    offset_storage.push_back(0);
+    for(std::size_t r=0; r<pending_records.size(); ++r) {
+      const record_arena::span &list = pending_records[r];
+      const record_arena::span *fields = arena.fields(list);
+
+      for(std::size_t i=0; i<list.len; ++i) {
+        field_storage.push_back(arena.data(fields[i]));
+        len_storage.push_back(fields[i].len);
+      }
+
+      offset_storage.push_back(field_storage.size());
+    }
+
+    std::size_t size = pending_records.size();
+    discard_records();
+
+    bool keep_going = record_batch_callback(field_storage.data(),
+      len_storage.data(),offset_storage.data(),size,record_batch_context);
+
+    arena.release();
+
+    return keep_going;
+  }
+
+  inline void parse_operations::discard_records(void)
+  {
+    pending_records.clear();
+    pending_bytes = 0;
+
+    // keep the capacity of the column buffers for the next batch
+    for(std::size_t i=0; i<columns.size(); ++i) {
+      columns[i].data.clear();
+      columns[i].offsets.assign(1,0);
+    }
+    column_rows = 0;
+  }
+
+  inline bool parse_operations::partition_record(const record_arena &arena,
+    const record_arena::span &list)
+  {
+    const record_arena::span *fields = arena.fields(list);
+
+    field_storage.clear();
+    len_storage.clear();
+
+    for(std::size_t i=0; i<list.len; ++i) {
+      field_storage.push_back(arena.data(fields[i]));
+      len_storage.push_back(fields[i].len);
+    }
+
+    std::size_t partition = key_hash(field_storage.data(),len_storage.data(),
+      list.len,partition_keys.data(),partition_keys.size()) % partition_count;
+
+    if(partition_callback) {
+      return partition_callback(partition,
+        (list.len ? field_storage.data() : 0),
+        (list.len ? len_storage.data() : 0),list.len,partition_context);
+    }
+
+    format_partition(field_storage.data(),len_storage.data(),list.len);
+
+    std::lock_guard<std::mutex> guard(partition_state->lock);
+    write_partition(partition);
+
+    return true;
+  }
+
+  inline void parse_operations::format_partition(
+    const unsigned char * const fields[], const std::size_t lengths[],
+    std::size_t size)
+  {
+    std::vector<unsigned char> &line = partition_buffer;
+    line.clear();
+
+    for(std::size_t i=0; i<size; ++i) {
+      if(i)
+        line.push_back(partition_delimiter);
+
+      const unsigned char *begin = fields[i];
+      const unsigned char *end = begin+lengths[i];
+
+      bool escaped = false;
+      for(const unsigned char *cur=begin; cur!=end && !escaped; ++cur) {
+        escaped = (*cur == partition_delimiter || *cur == '"' || *cur == '\r'
+          || *cur == '\n');
+      }
+
+      if(!escaped) {
+        line.insert(line.end(),begin,end);
+        continue;
+      }
+
+      line.push_back('"');
+      for(const unsigned char *cur=begin; cur!=end; ++cur) {
+        if(*cur == '"')
+          line.push_back('"');
+        line.push_back(*cur);
+      }
+      line.push_back('"');
+    }
+
+    line.push_back('\r');
+    line.push_back('\n');
+  }
+
+  inline void parse_operations::write_partition(std::size_t partition)
+  {
+    const std::vector<unsigned char> &line = partition_buffer;
+
+    errno = 0;
+    FILE *out = partition_files[partition];
+    if(std::fwrite(line.data(),1,line.size(),out) != line.size())
+      throw std::system_error((errno ? errno : EIO),std::system_category());
+  }
+
+  inline void parse_operations::redirect(header_callback_t header,
+    record_callback_t record, void *context)
+  {
+    header_callback = header;
+    header_context = context;
+    record_callback = record;
+    record_context = context;
+    record_batch_callback = 0;
+    record_batch_context = 0;
+    column_batch_callback = 0;
+    column_batch_context = 0;
+
+    partition_keys.clear();
+    partition_callback = 0;
+    partition_context = 0;
+    partition_files.clear();
+    partition_state.reset();
+  }
+
+  inline void parse_operations::reset(void)
+  {
+    discard_records();
+    columns.clear();
+    column_names.clear();
+
+    // names are resolved with the header
+    projection = projection_columns;
+
+    filtering = false;
+    record_rejected = false;
+  }
+
+  inline bool parse_operations::predicate::passes(const unsigned char *data,
+    std::size_t len) const
+  {
+    // a missing or empty field has no bytes to compare and data may be null
+    if(len == 0)
+      return kind != range && value.empty();
+
+    switch(kind) {
+      case equal:
+        return len == value.size() && std::equal(data,data+len,value.begin());
+
+      case prefix:
+        return len >= value.size()
+          && std::equal(value.begin(),value.end(),data);
+
+      case range: {
+        // only a plain decimal number: an optional sign, digits with an
+        // optional fraction and an optional exponent. Unlike strtod, this
+        // excludes whitespace, inf, nan and hexadecimal
+        const unsigned char *cur = data;
+        const unsigned char *end = data+len;
+
+        if(*cur == '+' || *cur == '-')
+          ++cur;
+
+        std::size_t digits = 0;
+        for(; cur != end && *cur >= '0' && *cur <= '9'; ++cur)
+          ++digits;
+        if(cur != end && *cur == '.') {
+          for(++cur; cur != end && *cur >= '0' && *cur <= '9'; ++cur)
+            ++digits;
+        }
+        if(!digits)
+          return false;
+
+        if(cur != end && (*cur == 'e' || *cur == 'E')) {
+          ++cur;
+          if(cur != end && (*cur == '+' || *cur == '-'))
+            ++cur;
+          if(cur == end || *cur < '0' || *cur > '9')
+            return false;
+          while(cur != end && *cur >= '0' && *cur <= '9')
+            ++cur;
+        }
+
+        if(cur != end)
+          return false;
+
+        // convert with the classic locale so that the decimal point is '.'
+        // whatever the global locale
+        std::istringstream in(std::string(data,end));
+        in.imbue(std::locale::classic());
+
+        double val;
+        if(!(in >> val))
+          return false;
+
+        return val >= min && val <= max;
+      }
+    }
+
+    return false;
+  }
+
+  inline void parse_operations::add_predicate(const predicate &pred)
+  {
+    predicates.push_back(pred);
+
+    if(predicate_mask.size() <= pred.column)
+      predicate_mask.resize(pred.column+1,false);
+    predicate_mask[pred.column] = true;
+  }
+
+  inline bool parse_operations::has_predicate(std::size_t column) const
+  {
+    return column < predicate_mask.size() && predicate_mask[column];
+  }
+
+  inline bool parse_operations::field_passes(std::size_t column,
+    const unsigned char *data, std::size_t len) const
+  {
+    for(std::size_t i=0; i<predicates.size(); ++i) {
+      if(predicates[i].column == column && !predicates[i].passes(data,len))
+        return false;
+    }
+
+    return true;
+  }
+
+  inline bool parse_operations::accept_record(std::size_t fields)
+  {
+    if(!filtering)
+      return true;
+
+    bool accepted = !record_rejected;
+    for(std::size_t i=0; accepted && i<predicates.size(); ++i) {
+      if(predicates[i].column >= fields)
+        accepted = predicates[i].passes(0,0);
+    }
+
+    record_rejected = false;
+
+    return accepted;
+  }
+
+  inline bool parse_operations::batch_full(void) const
+  {
+    std::size_t rows = (column_batch_callback ? column_rows
+      : pending_records.size());
+
+    return (batch_size && rows >= batch_size)
+      || (batch_bytes && pending_bytes >= batch_bytes);
+  }
+
+  inline bool parse_operations::flush_columns(void)
+  {
+    if(!column_rows)
+      return true;
+
+    column_storage.resize(columns.size());
+    for(std::size_t i=0; i<columns.size(); ++i) {
+      column_storage[i].data = columns[i].data.data();
+      column_storage[i].offsets = columns[i].offsets.data();
+    }
+
+    column_batch_exportable = true;
+    bool keep_going = column_batch_callback(column_storage.data(),
+      column_storage.size(),column_rows,column_batch_context);
+    column_batch_exportable = false;
+
+    discard_records();
+
+    return keep_going;
+  }
 
 }
 
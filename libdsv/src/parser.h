@@ -32,9 +32,12 @@
 #define LIBDSV_PARSER_H
 
 #include "dsv_parser.h"
+#include "record_arena.h"
+#include "record_scan.h"
 
 #include <string>
 #include <list>
+#include <vector>
 #include <utility>
 
 #include <iostream>
@@ -89,14 +92,14 @@ inline log_description::const_param_iterator log_description::param_end(void) co
 
 
 
-class parser {
-  private:
-    typedef std::list<std::pair<dsv_log_level,log_description> > log_list_type;
-
+/*
+    The settings of a dsv_parser_t. A parse only reads them, through the copy
+    held by its parser, so one parser_settings may be shared by any number of
+    concurrent parses as long as it is not changed while they start.
+ */
+class parser_settings {
   public:
-    typedef log_list_type::const_iterator const_log_iterator;
-
-    parser(void);
+    parser_settings(void);
 
     log_callback_t log_callback(void) const;
     log_callback_t log_callback(log_callback_t fn);
@@ -107,13 +110,6 @@ class parser {
     dsv_log_level log_level(void) const;
     dsv_log_level log_level(dsv_log_level level);
 
-    std::size_t log_size(void) const;
-    const_log_iterator log_begin(void) const;
-    const_log_iterator log_end(void) const;
-
-    void append_log(dsv_log_level level, const log_description &desc);
-
-    /* exposed behaviors */
     unsigned char delimiter(void) const;
     unsigned char delimiter(unsigned char d);
 
@@ -126,83 +122,304 @@ class parser {
     bool escaped_binary_fields(void) const;
     bool escaped_binary_fields(bool flag);
 
+    bool zero_copy_fields(void) const;
+    bool zero_copy_fields(bool flag);
 
-    /* non-exposed behaviors */
-    dsv_newline_behavior effective_newline(void) const;
-    dsv_newline_behavior effective_newline(dsv_newline_behavior val);
-
-    bool escaped_field(void) const;
-    bool escaped_field(bool val);
+    std::size_t skip_records(void) const;
+    std::size_t skip_records(std::size_t n);
 
-    ssize_t effective_field_columns(void) const;
-    ssize_t effective_field_columns(ssize_t num_cols);
-
-    bool effective_field_columns_set(void) const;
-    bool effective_field_columns_set(bool flag);
-
-    void reset(void);
+    std::size_t max_records(void) const;
+    std::size_t max_records(std::size_t n);
 
   private:
     log_callback_t _log_callback;
     void *_log_context;
     dsv_log_level _log_level;
 
-    log_list_type log_list;
-
     unsigned char _delimiter;
     dsv_newline_behavior _newline_behavior;
     ssize_t _field_columns;
     bool _escaped_binary_fields;
-
-    dsv_newline_behavior _effective_newline;
-    bool _escaped_field;
-    ssize_t _effective_field_columns;
-    bool _effective_field_columns_set;
-
+    bool _zero_copy_fields;
+    std::size_t _skip_records;
+    std::size_t _max_records;
 };
 
-inline parser::parser(void) :_log_callback(0), _log_context(0),
-  _log_level(dsv_log_none),
-  _delimiter(','), _field_columns(0), _escaped_binary_fields(false),
-  _escaped_field(false), _effective_field_columns(0),
-  _effective_field_columns_set(false)
+inline parser_settings::parser_settings(void) :_log_callback(0),
+  _log_context(0), _log_level(dsv_log_none), _delimiter(','),
+  _newline_behavior(dsv_newline_permissive), _field_columns(0),
+  _escaped_binary_fields(false), _zero_copy_fields(false), _skip_records(0),
+  _max_records(0)
 {
-  newline_behavior(dsv_newline_permissive);
 }
 
-inline log_callback_t parser::log_callback(void) const
+inline log_callback_t parser_settings::log_callback(void) const
 {
   return _log_callback;
 }
 
-inline log_callback_t parser::log_callback(log_callback_t fn)
+inline log_callback_t parser_settings::log_callback(log_callback_t fn)
 {
   std::swap(fn,_log_callback);
   return fn;
 }
 
-inline void * parser::log_context(void) const
+inline void * parser_settings::log_context(void) const
 {
   return _log_context;
 }
 
-inline void * parser::log_context(void *context)
+inline void * parser_settings::log_context(void *context)
 {
   std::swap(context,_log_context);
   return context;
 }
 
-inline dsv_log_level parser::log_level(void) const
+inline dsv_log_level parser_settings::log_level(void) const
 {
   return _log_level;
 }
 
-inline dsv_log_level parser::log_level(dsv_log_level level)
+inline dsv_log_level parser_settings::log_level(dsv_log_level level)
 {
   std::swap(level,_log_level);
   return level;
 }
 
+inline unsigned char parser_settings::delimiter(void) const
+{
+  return _delimiter;
+}
+
+inline unsigned char parser_settings::delimiter(unsigned char d)
+{
+  std::swap(d,_delimiter);
+  return d;
+}
+
+inline const dsv_newline_behavior &
+parser_settings::newline_behavior(void) const
+{
+  return _newline_behavior;
+}
+
+inline dsv_newline_behavior
+parser_settings::newline_behavior(dsv_newline_behavior behavior)
+{
+  std::swap(behavior,_newline_behavior);
+  return behavior;
+}
+
+inline ssize_t parser_settings::field_columns(void) const
+{
+  return _field_columns;
+}
+
+inline ssize_t parser_settings::field_columns(ssize_t cols)
+{
+  std::swap(cols,_field_columns);
+  return cols;
+}
+
+inline bool parser_settings::escaped_binary_fields(void) const
+{
+  return _escaped_binary_fields;
+}
+
+inline bool parser_settings::escaped_binary_fields(bool flag)
+{
+  std::swap(flag,_escaped_binary_fields);
+  return flag;
+}
+
+inline bool parser_settings::zero_copy_fields(void) const
+{
+  return _zero_copy_fields;
+}
+
+inline bool parser_settings::zero_copy_fields(bool flag)
+{
+  std::swap(flag,_zero_copy_fields);
+  return flag;
+}
+
+inline std::size_t parser_settings::skip_records(void) const
+{
+  return _skip_records;
+}
+
+inline std::size_t parser_settings::skip_records(std::size_t n)
+{
+  std::swap(n,_skip_records);
+  return n;
+}
+
+inline std::size_t parser_settings::max_records(void) const
+{
+  return _max_records;
+}
+
+inline std::size_t parser_settings::max_records(std::size_t n)
+{
+  std::swap(n,_max_records);
+  return n;
+}
+
+
+
+/*
+    The state of one parse. It starts from a copy of the settings, so
+    changing them has no effect on a parse already underway, and is used by
+    a single thread at a time.
+ */
+class parser {
+  private:
+    typedef std::list<std::pair<dsv_log_level,log_description> > log_list_type;
+
+  public:
+    typedef log_list_type::const_iterator const_log_iterator;
+
+    explicit parser(const parser_settings &settings);
+
+    const parser_settings & settings(void) const;
+
+    log_callback_t log_callback(void) const;
+    void * log_context(void) const;
+    dsv_log_level log_level(void) const;
+
+    std::size_t log_size(void) const;
+    const_log_iterator log_begin(void) const;
+    const_log_iterator log_end(void) const;
+
+    void append_log(dsv_log_level level, const log_description &desc);
+
+    /* exposed behaviors */
+    unsigned char delimiter(void) const;
+    const dsv_newline_behavior & newline_behavior(void) const;
+    ssize_t field_columns(void) const;
+    bool escaped_binary_fields(void) const;
+    bool zero_copy_fields(void) const;
+    std::size_t skip_records(void) const;
+    std::size_t max_records(void) const;
+
+    /* non-exposed behaviors */
+    dsv_newline_behavior effective_newline(void) const;
+    dsv_newline_behavior effective_newline(dsv_newline_behavior val);
+
+    bool escaped_field(void) const;
+    bool escaped_field(bool val);
+
+    ssize_t effective_field_columns(void) const;
+    ssize_t effective_field_columns(ssize_t num_cols);
+
+    bool effective_field_columns_set(void) const;
+    bool effective_field_columns_set(bool flag);
+
+    /*
+        Only check the content. No field content is kept and records are
+        neither skipped nor limited
+     */
+    bool validating(void) const;
+    bool validating(bool flag);
+
+    /*
+        The content starts at a record rather than with a header, as when
+        parsing a part of a file whose header has already been parsed
+     */
+    bool records_only(void) const;
+    bool records_only(bool flag);
+
+    /*
+        The number of errors found by the parse
+     */
+    void count_error(void);
+    std::size_t errors(void) const;
+
+    /*
+        The columns whose content the scanner keeps or an empty mask for all.
+        The column of the field being scanned is tracked by the scanner with
+        next_field() and next_record(). skip_record() drops the content of
+        the remaining fields of the record being scanned
+     */
+    void column_mask(std::vector<bool> &mask);
+    const std::vector<bool> & column_mask(void) const;
+    bool field_selected(void) const;
+    std::size_t field_index(void) const;
+    void next_field(void);
+    void next_record(void);
+    void skip_record(void);
+
+    /*
+        The number of records after the header still to be passed over
+        without parsing and the scan that locates them
+     */
+    std::size_t records_to_skip(void) const;
+    std::size_t records_to_skip(std::size_t n);
+    record_scan & skip_scan(void);
+
+    /*
+        Count a record passed on to the operations and whether max_records()
+        have been
+     */
+    void record_passed(void);
+    bool record_limit_reached(void) const;
+
+    record_arena & arena(void);
+
+  private:
+    const parser_settings _settings;
+
+    log_list_type log_list;
+
+    dsv_newline_behavior _effective_newline;
+    bool _escaped_field;
+    ssize_t _effective_field_columns;
+    bool _effective_field_columns_set;
+    bool _validating;
+    bool _records_only;
+    std::size_t _errors;
+    std::vector<bool> _column_mask;
+    std::size_t _field_index;
+    bool _skip_record;
+    std::size_t _records_to_skip;
+    record_scan _skip_scan;
+    std::size_t _records_passed;
+
+    record_arena _arena;
+
+    parser(const parser &);
+    parser & operator=(const parser &);
+};
+
+inline parser::parser(const parser_settings &settings) :_settings(settings),
+  _effective_newline(settings.newline_behavior()), _escaped_field(false),
+  _effective_field_columns(settings.field_columns()),
+  _effective_field_columns_set(settings.field_columns() > 0),
+  _validating(false), _records_only(false), _errors(0), _field_index(0),
+  _skip_record(false), _records_to_skip(0), _records_passed(0)
+{
+}
+
+inline const parser_settings & parser::settings(void) const
+{
+  return _settings;
+}
+
+inline log_callback_t parser::log_callback(void) const
+{
+  return _settings.log_callback();
+}
+
+inline void * parser::log_context(void) const
+{
+  return _settings.log_context();
+}
+
+inline dsv_log_level parser::log_level(void) const
+{
+  return _settings.log_level();
+}
+
 inline std::size_t parser::log_size(void) const
 {
   return log_list.size();
@@ -225,57 +442,39 @@ inline void parser::append_log(dsv_log_level level, const log_description &desc)
 
 inline unsigned char parser::delimiter(void) const
 {
-  return _delimiter;
+  return _settings.delimiter();
 }
 
-inline unsigned char parser::delimiter(unsigned char d)
+inline const dsv_newline_behavior & parser::newline_behavior(void) const
 {
-  std::swap(d,_delimiter);
-  return d;
+  return _settings.newline_behavior();
 }
 
-inline const dsv_newline_behavior &
-parser::newline_behavior(void) const
+inline ssize_t parser::field_columns(void) const
 {
-  return _newline_behavior;
+  return _settings.field_columns();
 }
 
-inline dsv_newline_behavior
-parser::newline_behavior(dsv_newline_behavior behavior)
+inline bool parser::escaped_binary_fields(void) const
 {
-  std::swap(behavior,_newline_behavior);
-  _effective_newline = _newline_behavior;
-
-  return behavior;
+  return _settings.escaped_binary_fields();
 }
 
-inline ssize_t parser::field_columns(void) const
+inline bool parser::zero_copy_fields(void) const
 {
-  return _field_columns;
+  return _settings.zero_copy_fields();
 }
 
-inline ssize_t parser::field_columns(ssize_t cols)
+inline std::size_t parser::skip_records(void) const
 {
-  std::swap(cols,_field_columns);
-  _effective_field_columns = _field_columns;
-  _effective_field_columns_set = (cols > 0);
-
-  return cols;
+  return _settings.skip_records();
 }
 
-inline bool parser::escaped_binary_fields(void) const
+inline std::size_t parser::max_records(void) const
 {
-  return _escaped_binary_fields;
+  return _settings.max_records();
 }
 
-inline bool parser::escaped_binary_fields(bool flag)
-{
-  std::swap(flag,_escaped_binary_fields);
-  return flag;
-}
-
-
-
 inline dsv_newline_behavior parser::effective_newline(void) const
 {
   return _effective_newline;
@@ -320,14 +519,104 @@ inline bool parser::effective_field_columns_set(bool flag)
   return flag;
 }
 
+inline bool parser::validating(void) const
+{
+  return _validating;
+}
+
+inline bool parser::validating(bool flag)
+{
+  std::swap(flag,_validating);
+  return flag;
+}
+
+inline bool parser::records_only(void) const
+{
+  return _records_only;
+}
+
+inline bool parser::records_only(bool flag)
+{
+  std::swap(flag,_records_only);
+  return flag;
+}
+
+inline void parser::count_error(void)
+{
+  ++_errors;
+}
+
+inline std::size_t parser::errors(void) const
+{
+  return _errors;
+}
+
+inline void parser::column_mask(std::vector<bool> &mask)
+{
+  _column_mask.swap(mask);
+}
+
+inline const std::vector<bool> & parser::column_mask(void) const
+{
+  return _column_mask;
+}
+
+inline bool parser::field_selected(void) const
+{
+  return !_skip_record && !_validating && (_column_mask.empty()
+    || (_field_index < _column_mask.size() && _column_mask[_field_index]));
+}
+
+inline std::size_t parser::field_index(void) const
+{
+  return _field_index;
+}
+
+inline void parser::next_field(void)
+{
+  ++_field_index;
+}
+
+inline void parser::next_record(void)
+{
+  _field_index = 0;
+  _skip_record = false;
+}
+
+inline void parser::skip_record(void)
+{
+  _skip_record = true;
+}
+
+inline std::size_t parser::records_to_skip(void) const
+{
+  return _records_to_skip;
+}
+
+inline std::size_t parser::records_to_skip(std::size_t n)
+{
+  std::swap(n,_records_to_skip);
+  return n;
+}
+
+inline record_scan & parser::skip_scan(void)
+{
+  return _skip_scan;
+}
+
+inline void parser::record_passed(void)
+{
+  ++_records_passed;
+}
+
+inline bool parser::record_limit_reached(void) const
+{
+  return !_validating && max_records() && _records_passed >= max_records();
+}
 
-inline void parser::reset(void)
+inline record_arena & parser::arena(void)
 {
-  log_list.clear();
-  _effective_newline = _newline_behavior;
-  _escaped_field = false;
-  _effective_field_columns = _field_columns;
-  _effective_field_columns_set = (_field_columns > 0);
+  return _arena;
 }
 
 
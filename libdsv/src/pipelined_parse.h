@@ -0,0 +1,393 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_PIPELINED_PARSE_H
+#define LIBDSV_PIPELINED_PARSE_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "scanner_state.h"
+#include "collected_parse.h"
+#include "spsc_ring.h"
+#include "dsv_grammar.hh"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <system_error>
+#include <new>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+namespace detail {
+
+  /**
+   *  Parse a stream with reading, parsing and passing on the records each
+   *  done by a thread of its own so that none of them waits for the others.
+   *
+   *  A reader thread reads the stream in large blocks and passes them to a
+   *  parsing thread through a ring. The parsing thread scans the blocks as
+   *  they arrive and collects the header, records and log messages in
+   *  batches, which go through a second ring to the calling thread. The
+   *  calling thread passes each batch on to the real operations and logger
+   *  as parallel_parse does with its chunks so the callbacks are only ever
+   *  called by the calling thread, one at a time and in the order of the
+   *  stream. Empty blocks go back to the reader through a third ring so that
+   *  only a few blocks are ever allocated.
+   *
+   *  The records to skip and the maximum number of records are applied by
+   *  the parsing thread as in a sequential parse and the maximum again as
+   *  the records are passed on. Once it is reached or a callback asks to
+   *  stop, the rings are closed and the other threads give up.
+   *
+   *  As with parse in dsv_parser.cc, a failed parse is reported by throwing
+   *  std::system_error.
+   */
+  class pipelined_parse {
+    public:
+      /*
+          Read from the stream in. If in is zero, open the file named by str.
+          A stream supplied by the caller is not closed
+       */
+      pipelined_parse(const char *str, FILE *in);
+
+      void run(parser &p, parse_operations &operations);
+
+    private:
+      static const std::size_t block_size = 1024*1024;
+      static const std::size_t block_count = 4;
+
+      // a batch is passed on once it holds this many records or bytes
+      static const std::size_t batch_records = 4096;
+      static const std::size_t batch_bytes = 1024*1024;
+      static const std::size_t batch_count = 4;
+
+      /*
+          The len bytes read into bytes and the errno value of a failed read
+          that followed them, if any
+       */
+      struct block {
+        std::vector<unsigned char> bytes;
+        std::size_t len;
+        int error;
+
+        block(void) :bytes(block_size), len(0), error(0) {}
+      };
+
+      /*
+          The blocks of the reader as the input of the parsing thread's
+          scanner
+       */
+      class block_input : public scanner_state::input_source {
+        public:
+          explicit block_input(pipelined_parse &pipeline);
+
+          std::size_t read(unsigned char *buf, std::size_t len);
+
+        private:
+          pipelined_parse &pipeline;
+          std::unique_ptr<block> current;
+          std::size_t pos;
+      };
+
+      std::string fname;
+      std::shared_ptr<FILE> stream;
+
+      spsc_ring<std::unique_ptr<block> > free_blocks;
+      spsc_ring<std::unique_ptr<block> > full_blocks;
+      spsc_ring<std::unique_ptr<collected_parse> > batches;
+
+      // used only by the parsing thread
+      parser_settings lex_settings;
+      parse_operations lex_operations;
+      std::unique_ptr<collected_parse> current;
+
+      void read_blocks(void);
+      void lex_blocks(void);
+
+      /*
+          Pass the current batch on to the calling thread and start another.
+          Returns false if the calling thread has stopped taking them
+       */
+      bool hand_off(void);
+
+      void stop(std::vector<std::thread> &threads);
+
+      static int collect_header(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      static int collect_record(const unsigned char *fields[],
+        const size_t lengths[], size_t size, void *context);
+
+      static int collect_log(dsv_log_code code, dsv_log_level level,
+        const char *params[], size_t size, void *context);
+
+      pipelined_parse(const pipelined_parse &);
+      pipelined_parse & operator=(const pipelined_parse &);
+  };
+
+  inline pipelined_parse::pipelined_parse(const char *str, FILE *in)
+    :free_blocks(block_count), full_blocks(block_count),
+    batches(batch_count)
+  {
+    if(str)
+      fname = str;
+
+    if(!in) {
+      errno = 0;
+      in = fopen(str,"rb");
+      if(!in)
+        throw std::system_error(errno,std::system_category());
+
+      stream = std::shared_ptr<FILE>(in,&fclose);
+    }
+    else
+      stream = std::shared_ptr<FILE>(in,[](FILE *){});
+  }
+
+  inline void pipelined_parse::run(parser &p, parse_operations &operations)
+  {
+    lex_settings = p.settings();
+    lex_settings.log_callback(&collect_log);
+    lex_settings.log_context(this);
+
+    lex_operations = operations;
+    lex_operations.redirect(&collect_header,&collect_record,this);
+
+    current.reset(new collected_parse);
+
+    for(std::size_t i=0; i<block_count; ++i) {
+      std::unique_ptr<block> b(new block);
+      free_blocks.push(b);
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(2);
+
+    try {
+      threads.push_back(std::thread(&pipelined_parse::read_blocks,this));
+      threads.push_back(std::thread(&pipelined_parse::lex_blocks,this));
+    }
+    catch(std::system_error &) {
+      stop(threads);
+      throw std::system_error(EAGAIN,std::system_category());
+    }
+
+    int result = 1;
+    while(result > 0) {
+      std::unique_ptr<collected_parse> batch;
+      if(!batches.pop(batch))
+        break;
+
+      try {
+        result = batch->deliver(p,operations);
+      }
+      catch(...) {
+        stop(threads);
+        throw;
+      }
+    }
+
+    stop(threads);
+
+    if(result < 0)
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+  }
+
+  inline void pipelined_parse::read_blocks(void)
+  {
+    std::unique_ptr<block> b;
+    while(free_blocks.pop(b)) {
+      b->len = 0;
+      b->error = 0;
+
+      // code adapted from flex non-posix fread
+      while(b->len < b->bytes.size()) {
+        errno = 0;
+        std::size_t len = std::fread(b->bytes.data()+b->len,1,
+          b->bytes.size()-b->len,stream.get());
+        b->len += len;
+
+        if(len == 0) {
+          if(!std::ferror(stream.get()))
+            break;
+
+          if(errno != EINTR) {
+            b->error = (errno ? errno : EIO);
+            break;
+          }
+
+          std::clearerr(stream.get());
+        }
+      }
+
+      // a short block is the last one
+      bool last = (b->len < b->bytes.size());
+      if(!full_blocks.push(b) || last)
+        break;
+    }
+
+    full_blocks.close();
+  }
+
+  inline void pipelined_parse::lex_blocks(void)
+  {
+    int status = 0;
+
+    try {
+      block_input input(*this);
+      scanner_state scanner(fname.c_str(),input,block_size);
+
+      parser lp(lex_settings);
+      lex_operations.reset();
+
+      std::unique_ptr<scanner_state> base_ctx;
+      int err = parser_parse(scanner,lp,lex_operations,base_ctx);
+      if(err == 2)
+        status = ENOMEM;
+      else if(err != 0)
+        status = -1;
+    }
+    catch(std::system_error &ex) {
+      // a failed read
+      if(ex.code().category() == std::system_category())
+        status = ex.code().value();
+      else
+        status = -1;
+    }
+    catch(std::bad_alloc &) {
+      status = ENOMEM;
+    }
+    catch(...) {
+      abort();
+    }
+
+    current->status(status);
+    batches.push(current);
+    batches.close();
+
+    // the reader may still be waiting to give or take a block
+    full_blocks.close();
+    free_blocks.close();
+  }
+
+  inline bool pipelined_parse::hand_off(void)
+  {
+    std::unique_ptr<collected_parse> next(new collected_parse);
+    if(!batches.push(current))
+      return false;
+
+    current = std::move(next);
+
+    return true;
+  }
+
+  inline void pipelined_parse::stop(std::vector<std::thread> &threads)
+  {
+    batches.close();
+    full_blocks.close();
+    free_blocks.close();
+
+    for(std::size_t i=0; i<threads.size(); ++i)
+      threads[i].join();
+    threads.clear();
+  }
+
+  inline int pipelined_parse::collect_header(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    pipelined_parse &pipeline = *static_cast<pipelined_parse*>(context);
+    pipeline.current->add_header(fields,lengths,size);
+
+    return 1;
+  }
+
+  inline int pipelined_parse::collect_record(const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *context)
+  {
+    pipelined_parse &pipeline = *static_cast<pipelined_parse*>(context);
+    pipeline.current->add_record(fields,lengths,size);
+
+    if(pipeline.current->size() < batch_records
+      && pipeline.current->bytes() < batch_bytes)
+    {
+      return 1;
+    }
+
+    return pipeline.hand_off();
+  }
+
+  inline int pipelined_parse::collect_log(dsv_log_code code,
+    dsv_log_level level, const char *params[], size_t size, void *context)
+  {
+    pipelined_parse &pipeline = *static_cast<pipelined_parse*>(context);
+    pipeline.current->add_log(code,level,params,size);
+
+    return 1;
+  }
+
+  inline pipelined_parse::block_input::block_input(pipelined_parse &p)
+    :pipeline(p), pos(0)
+  {
+  }
+
+  inline std::size_t pipelined_parse::block_input::read(unsigned char *buf,
+    std::size_t len)
+  {
+    while(!current || pos == current->len) {
+      if(current) {
+        if(current->error)
+          throw std::system_error(current->error,std::system_category());
+
+        pipeline.free_blocks.push(current);
+        current.reset();
+      }
+
+      if(!pipeline.full_blocks.pop(current))
+        return 0;
+
+      pos = 0;
+    }
+
+    std::size_t n = std::min(len,current->len-pos);
+    std::memcpy(buf,current->bytes.data()+pos,n);
+    pos += n;
+
+    return n;
+  }
+
+}
+
+#endif
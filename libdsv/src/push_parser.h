@@ -0,0 +1,185 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_PUSH_PARSER_H
+#define LIBDSV_PUSH_PARSER_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "scanner_state.h"
+#include "dsv_grammar.hh"
+
+#include <memory>
+#include <new>
+#include <system_error>
+
+#include <cerrno>
+
+namespace detail {
+
+  /**
+   *  State of a parse whose input is supplied in pieces.
+   *
+   *  Each call to feed() appends the bytes to the scanner and drives the
+   *  Bison push parser with every token that can be completed. A token split
+   *  across two calls is rescanned once the rest of it arrives. finish()
+   *  delivers end of input.
+   *
+   *  Callers that need to regain control after each record can instead use
+   *  append() and end_input() to supply input and step() to parse one token
+   *  at a time.
+   *
+   *  As with parse in dsv_parser.cc, a failed parse is reported by throwing
+   *  std::system_error.
+   */
+  class push_parser {
+    public:
+      explicit push_parser(const char *str=0);
+      ~push_parser(void);
+
+      void feed(const unsigned char *data, std::size_t len, parser &p,
+        parse_operations &operations);
+
+      void finish(parser &p, parse_operations &operations);
+
+      void append(const unsigned char *data, std::size_t len);
+      void end_input(void);
+
+      /*
+          Scan and parse the next token. Returns false if the parse is
+          complete or more input is needed to complete the token.
+       */
+      bool step(parser &p, parse_operations &operations);
+
+      /*
+          True once the end of input has been accepted
+       */
+      bool complete(void) const;
+
+    private:
+      scanner_state scanner;
+      parser_pstate *pstate;
+      YYLTYPE lloc;
+      int status;
+
+      // unused but required by the grammar
+      std::unique_ptr<scanner_state> base_ctx;
+
+      void run(parser &p, parse_operations &operations);
+
+      push_parser(const push_parser &);
+      push_parser & operator=(const push_parser &);
+  };
+
+  inline push_parser::push_parser(const char *str)
+    :scanner(str,scanner_state::incremental_input()), pstate(parser_pstate_new()),
+    status(YYPUSH_MORE)
+  {
+    if(!pstate)
+      throw std::bad_alloc();
+
+    lloc.first_line = lloc.last_line = 1;
+    lloc.first_column = lloc.last_column = 1;
+  }
+
+  inline push_parser::~push_parser(void)
+  {
+    parser_pstate_delete(pstate);
+  }
+
+  inline void push_parser::feed(const unsigned char *data, std::size_t len,
+    parser &p, parse_operations &operations)
+  {
+    if(complete())
+      return;
+
+    append(data,len);
+    run(p,operations);
+  }
+
+  inline void push_parser::finish(parser &p, parse_operations &operations)
+  {
+    end_input();
+    run(p,operations);
+  }
+
+  inline void push_parser::append(const unsigned char *data, std::size_t len)
+  {
+    // once the parse has stopped, as at the record limit, nothing consumes
+    // the input so it must not be kept
+    if(complete())
+      return;
+
+    scanner.append(data,len);
+  }
+
+  inline void push_parser::end_input(void)
+  {
+    scanner.finish();
+  }
+
+  inline bool push_parser::step(parser &p, parse_operations &operations)
+  {
+    if(complete())
+      return false;
+
+    YYSTYPE lval;
+    int token = parser_lex(&lval,&lloc,scanner,p);
+    if(token == NEED_INPUT)
+      return false;
+
+    status = parser_push_parse(pstate,token,&lval,&lloc,scanner,p,
+      operations,base_ctx);
+
+    if(status == 2)
+      throw std::system_error(ENOMEM,std::system_category());
+    if(status == 1) {
+      // records that were complete before the failure are still delivered
+      operations.flush_records(p.arena());
+      throw std::system_error(-1,std::generic_category(),"Parse failed");
+    }
+
+    return !complete();
+  }
+
+  inline bool push_parser::complete(void) const
+  {
+    return status == 0;
+  }
+
+  inline void push_parser::run(parser &p, parse_operations &operations)
+  {
+    while(step(p,operations))
+      ;
+  }
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LIBDSV_RANGE_COPY_H
+#define LIBDSV_RANGE_COPY_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <vector>
+#include <algorithm>
+#include <system_error>
+
+#include <cstddef>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace detail {
+
+  /**
+   *  Copy ranges of bytes of a file to the end of another.
+   *
+   *  Where the system supports it the bytes are copied with copy_file_range
+   *  so that they stay in the kernel and the filesystem may share or clone
+   *  them. Once the system refuses it for the pair of files, such as across
+   *  filesystems, the bytes are read and written instead.
+   *
+   *  Failures are reported by throwing std::system_error.
+   */
+  class range_copy {
+    public:
+      explicit range_copy(const char *filename);
+      ~range_copy(void);
+
+      /*
+          Create or truncate the file named filename to receive the copies
+          that follow, closing any previous one
+       */
+      void open(const char *filename);
+      void close(void);
+
+      void copy(std::size_t offset, std::size_t len);
+
+    private:
+      enum {
+        buffer_bytes = 1024*1024
+      };
+
+      int in;
+      int out;
+      bool kernel_copy;
+
+      std::vector<unsigned char> buffer;
+
+      void read_write(std::size_t offset, std::size_t len);
+
+      range_copy(const range_copy &);
+      range_copy & operator=(const range_copy &);
+  };
+
+  inline range_copy::range_copy(const char *filename) :in(-1), out(-1),
+    kernel_copy(true)
+  {
+    in = ::open(filename,O_RDONLY);
+    if(in < 0)
+      throw std::system_error(errno,std::system_category());
+  }
+
+  inline range_copy::~range_copy(void)
+  {
+    if(out >= 0)
+      ::close(out);
+
+    ::close(in);
+  }
+
+  inline void range_copy::open(const char *filename)
+  {
+    close();
+
+    out = ::open(filename,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(out < 0)
+      throw std::system_error(errno,std::system_category());
+  }
+
+  inline void range_copy::close(void)
+  {
+    if(out < 0)
+      return;
+
+    // the last chance to hear of a failed write
+    int result = ::close(out);
+    out = -1;
+    if(result != 0 && errno != EINTR)
+      throw std::system_error(errno,std::system_category());
+  }
+
+  inline void range_copy::copy(std::size_t offset, std::size_t len)
+  {
+#ifdef HAVE_COPY_FILE_RANGE
+    while(len && kernel_copy) {
+      loff_t from = offset;
+      ssize_t n = copy_file_range(in,&from,out,0,len,0);
+      if(n > 0) {
+        offset += n;
+        len -= n;
+      }
+      else if(n == 0)
+        break;
+      else if(errno == EXDEV || errno == EINVAL || errno == ENOSYS
+        || errno == EOPNOTSUPP || errno == EPERM)
+      {
+        kernel_copy = false;
+      }
+      else if(errno != EINTR)
+        throw std::system_error(errno,std::system_category());
+    }
+#endif
+
+    read_write(offset,len);
+  }
+
+  inline void range_copy::read_write(std::size_t offset, std::size_t len)
+  {
+    // grow as needed so that a short first copy, such as the header, does
+    // not leave every later copy in chunks of its size
+    std::size_t want = std::min<std::size_t>(len,buffer_bytes);
+    if(buffer.size() < want)
+      buffer.resize(want);
+
+    while(len) {
+      ssize_t n = pread(in,buffer.data(),std::min(len,buffer.size()),offset);
+      if(n < 0) {
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno,std::system_category());
+      }
+
+      // the file became shorter
+      if(n == 0)
+        throw std::system_error(EIO,std::system_category());
+
+      for(ssize_t written=0; written<n;) {
+        ssize_t w = write(out,buffer.data()+written,n-written);
+        if(w < 0) {
+          if(errno == EINTR)
+            continue;
+          throw std::system_error(errno,std::system_category());
+        }
+
+        written += w;
+      }
+
+      offset += n;
+      len -= n;
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_READER_H
+#define LIBDSV_READER_H
+
+#include "parser.h"
+#include "parse_operations.h"
+#include "push_parser.h"
+
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <system_error>
+#include <exception>
+
+#include <cerrno>
+
+namespace detail {
+
+  /**
+   *  Record at a time access to a parse.
+   *
+   *  The reader drives a push_parser itself, one token at a time, and stops
+   *  as soon as a header or record has been delivered. The fields of the
+   *  record therefore remain in the parser's record_arena until the next
+   *  call to next(). The header is copied since it is expected to outlive the
+   *  records.
+   *
+   *  As with parse in dsv_parser.cc, a failed parse is reported by throwing
+   *  std::system_error.
+   */
+  class reader {
+    public:
+      /*
+          Read from the stream in. If in is zero, open the file named by str.
+          A stream supplied by the caller is not closed by the reader. The
+          parse uses a copy of settings.
+       */
+      reader(const char *str, FILE *in, const parser_settings &settings);
+
+      /*
+          Obtain the header. Returns false if the content is empty
+       */
+      bool header(const unsigned char * const *&fields,
+        const std::size_t *&lengths, std::size_t &size);
+
+      /*
+          Obtain the next record. Returns false if there are no more records
+       */
+      bool next(const unsigned char * const *&fields,
+        const std::size_t *&lengths, std::size_t &size);
+
+    private:
+      typedef std::vector<unsigned char> char_buff_type;
+
+      parser _parser;
+      parse_operations operations;
+      push_parser push;
+
+      std::shared_ptr<FILE> stream;
+      std::vector<unsigned char> read_buff;
+
+      bool header_seen;
+      std::vector<char_buff_type> header_buffs;
+      std::vector<const unsigned char *> header_fields;
+      std::vector<std::size_t> header_lengths;
+
+      // failure that occurred while delivering the pending record
+      std::exception_ptr deferred_error;
+
+      bool record_pending;
+      const unsigned char * const *record_fields;
+      const std::size_t *record_lengths;
+      std::size_t record_size;
+
+      /*
+          Parse until a header or record is delivered. Returns false if the
+          end of the content was reached first
+       */
+      bool pull(void);
+
+      static int header_callback(const unsigned char *fields[],
+        const std::size_t lengths[], std::size_t size, void *context);
+      static int record_callback(const unsigned char *fields[],
+        const std::size_t lengths[], std::size_t size, void *context);
+
+      reader(const reader &);
+      reader & operator=(const reader &);
+  };
+
+  inline reader::reader(const char *str, FILE *in,
+    const parser_settings &settings) :_parser(settings),
+    push(str), read_buff(BUFSIZ), header_seen(false), record_pending(false),
+    record_fields(0), record_lengths(0), record_size(0)
+  {
+    if(!in) {
+      errno = 0;
+      in = fopen(str,"rb");
+      if(!in) {
+        throw std::system_error(errno,std::system_category());
+      }
+
+      stream = std::shared_ptr<FILE>(in,&fclose);
+    }
+    else
+      stream = std::shared_ptr<FILE>(in,[](FILE *){});
+
+    operations.header_callback = header_callback;
+    operations.header_context = this;
+    operations.record_callback = record_callback;
+    operations.record_context = this;
+  }
+
+  inline bool reader::header(const unsigned char * const *&fields,
+    const std::size_t *&lengths, std::size_t &size)
+  {
+    // the header is delivered before any record
+    while(!header_seen && !record_pending && pull())
+      ;
+
+    if(!header_seen)
+      return false;
+
+    fields = header_fields.data();
+    lengths = header_lengths.data();
+    size = header_fields.size();
+
+    return true;
+  }
+
+  inline bool reader::next(const unsigned char * const *&fields,
+    const std::size_t *&lengths, std::size_t &size)
+  {
+    while(!record_pending) {
+      if(!pull())
+        return false;
+    }
+
+    record_pending = false;
+
+    fields = record_fields;
+    lengths = record_lengths;
+    size = record_size;
+
+    return true;
+  }
+
+  inline bool reader::pull(void)
+  {
+    if(deferred_error)
+      std::rethrow_exception(deferred_error);
+
+    const bool seen = header_seen;
+    while(true) {
+      bool more;
+      try {
+        more = push.step(_parser,operations);
+      }
+      catch(...) {
+        // the token that fails the parse may also complete a record. Report
+        // the failure once that record has been returned
+        if(!record_pending)
+          throw;
+
+        deferred_error = std::current_exception();
+        return true;
+      }
+
+      // the final record may be delivered by the step that completes the
+      // parse
+      if(record_pending || header_seen != seen)
+        return true;
+
+      if(more)
+        continue;
+
+      if(push.complete())
+        return false;
+
+      errno = 0;
+      std::size_t len;
+      while((len = std::fread(read_buff.data(),1,read_buff.size(),
+        stream.get())) == 0 && std::ferror(stream.get()))
+      {
+        if(errno != EINTR)
+          throw std::system_error(errno,std::system_category());
+
+        errno = 0;
+        std::clearerr(stream.get());
+      }
+
+      if(len)
+        push.append(read_buff.data(),len);
+      else
+        push.end_input();
+    }
+  }
+
+  inline int reader::header_callback(const unsigned char *fields[],
+    const std::size_t lengths[], std::size_t size, void *context)
+  {
+    reader &self = *static_cast<reader*>(context);
+
+    self.header_buffs.resize(size);
+    self.header_fields.resize(size);
+    self.header_lengths.assign(lengths,lengths+size);
+    for(std::size_t i=0; i<size; ++i) {
+      self.header_buffs[i].assign(fields[i],fields[i]+lengths[i]);
+      self.header_fields[i] = self.header_buffs[i].data();
+    }
+
+    self.header_seen = true;
+
+    return 1;
+  }
+
+  inline int reader::record_callback(const unsigned char *fields[],
+    const std::size_t lengths[], std::size_t size, void *context)
+  {
+    reader &self = *static_cast<reader*>(context);
+
+    self.record_fields = fields;
+    self.record_lengths = lengths;
+    self.record_size = size;
+    self.record_pending = true;
+
+    return 1;
+  }
+
+}
+
+#endif
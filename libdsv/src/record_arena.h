@@ -0,0 +1,286 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_RECORD_ARENA_H
+#define LIBDSV_RECORD_ARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace detail {
+
+  /**
+   *  Storage for the content of the record currently being parsed.
+   *
+   *  Field bytes are appended to a single byte buffer and the fields of a
+   *  record to a single span buffer. The semantic values of the grammar are
+   *  spans (offset and length) into these buffers which keeps them trivially
+   *  copyable as the Bison push parser requires and avoids any per-token
+   *  allocation. Both buffers keep their capacity when reset so once they
+   *  have grown to fit the widest record, parsing allocates nothing.
+   *
+   *  Resetting is deferred: release() only marks the arena and the buffers
+   *  are emptied by the next call that starts a new span. The fields of the
+   *  last processed record therefore stay valid until parsing of the next
+   *  record begins.
+   *
+   *  If the input is a region of memory that stays valid for the whole
+   *  parse, it can be registered with input(). Spans created with
+   *  input_span() then refer to the input directly and their bytes are only
+   *  copied into the arena if they must be joined with bytes that are not
+   *  adjacent in the input.
+   */
+  class record_arena {
+    public:
+      struct span {
+        std::size_t off;
+        std::size_t len;
+
+        // off is relative to the registered input rather than the arena
+        bool in_input;
+      };
+
+      record_arena(void);
+
+      /*
+          Register the region at base as the input or unregister with 0.
+          Not affected by clear()
+       */
+      void input(const unsigned char *base);
+      bool has_input(void) const;
+
+      /*
+          Start an empty span of bytes at the end of the byte buffer
+       */
+      span begin(void);
+
+      /*
+          The len bytes at offset off of the registered input
+       */
+      span input_span(std::size_t off, std::size_t len) const;
+
+      /*
+          Append len bytes at data to s. s must be the last span started or
+          an input span in which case data must immediately follow it in the
+          input
+       */
+      void extend(span &s, const unsigned char *data, std::size_t len);
+
+      /*
+          Remove s from the byte buffer. s must be the last span started
+       */
+      void discard(const span &s);
+
+      span append(const unsigned char *data, std::size_t len);
+
+      /*
+          A span containing the bytes of a followed by the bytes of b. No
+          bytes are copied if b immediately follows a and only those of b
+          if a ends the buffer.
+       */
+      span concat(const span &a, const span &b);
+
+      const unsigned char * data(const span &s) const;
+
+      /*
+          Start an empty list of fields at the end of the span buffer
+       */
+      span begin_list(void);
+
+      /*
+          Append field to list
+       */
+      void push_field(span &list, const span &field);
+
+      const span * fields(const span &list) const;
+
+      /*
+          Mark the content as no longer needed. See class description.
+       */
+      void release(void);
+
+      /*
+          Empty both buffers immediately
+       */
+      void clear(void);
+
+    private:
+      std::vector<unsigned char> bytes;
+      std::vector<span> spans;
+
+      const unsigned char *input_base;
+
+      bool released;
+
+      void prepare(void);
+      void copy_to_end(const span &s);
+  };
+
+  inline record_arena::record_arena(void) :input_base(0), released(false)
+  {
+  }
+
+  inline void record_arena::input(const unsigned char *base)
+  {
+    input_base = base;
+  }
+
+  inline bool record_arena::has_input(void) const
+  {
+    return input_base;
+  }
+
+  inline record_arena::span record_arena::begin(void)
+  {
+    prepare();
+
+    span result = {bytes.size(),0,false};
+    return result;
+  }
+
+  inline record_arena::span record_arena::input_span(std::size_t off,
+    std::size_t len) const
+  {
+    span result = {off,len,true};
+    return result;
+  }
+
+  inline void record_arena::extend(span &s, const unsigned char *data,
+    std::size_t len)
+  {
+    if(!s.in_input)
+      bytes.insert(bytes.end(),data,data+len);
+    s.len += len;
+  }
+
+  inline void record_arena::discard(const span &s)
+  {
+    if(!s.in_input)
+      bytes.resize(s.off);
+  }
+
+  inline record_arena::span record_arena::append(const unsigned char *data,
+    std::size_t len)
+  {
+    span result = begin();
+    extend(result,data,len);
+    return result;
+  }
+
+  inline record_arena::span record_arena::concat(const span &a,
+    const span &b)
+  {
+    if(a.in_input == b.in_input && a.off + a.len == b.off) {
+      span result = {a.off,a.len+b.len,a.in_input};
+      return result;
+    }
+
+    // a is already at the end of the buffer, as when the pieces of a long
+    // escaped field are joined one after another, so only b is copied
+    if(!released && !a.in_input && a.off + a.len == bytes.size()) {
+      copy_to_end(b);
+
+      span result = {a.off,a.len+b.len,false};
+      return result;
+    }
+
+    span result = begin();
+    copy_to_end(a);
+    copy_to_end(b);
+    result.len = a.len+b.len;
+
+    return result;
+  }
+
+  inline const unsigned char * record_arena::data(const span &s) const
+  {
+    return (s.in_input ? input_base : bytes.data()) + s.off;
+  }
+
+  inline record_arena::span record_arena::begin_list(void)
+  {
+    prepare();
+
+    span result = {spans.size(),0,false};
+    return result;
+  }
+
+  inline void record_arena::push_field(span &list, const span &field)
+  {
+    if(list.off + list.len != spans.size()) {
+      // not the last list started, move it to the end first
+      std::size_t off = spans.size();
+      spans.resize(off+list.len);
+      std::copy(spans.begin()+list.off,spans.begin()+list.off+list.len,
+        spans.begin()+off);
+      list.off = off;
+    }
+
+    spans.push_back(field);
+    ++list.len;
+  }
+
+  inline const record_arena::span * record_arena::fields(const span &list) const
+  {
+    return spans.data() + list.off;
+  }
+
+  inline void record_arena::release(void)
+  {
+    released = true;
+  }
+
+  inline void record_arena::clear(void)
+  {
+    bytes.clear();
+    spans.clear();
+    released = false;
+  }
+
+  inline void record_arena::prepare(void)
+  {
+    if(released)
+      clear();
+  }
+
+  inline void record_arena::copy_to_end(const span &s)
+  {
+    std::size_t off = bytes.size();
+    bytes.resize(off+s.len);
+
+    // copy by offset as the buffer may have moved while growing
+    const unsigned char *src = data(s);
+    std::copy(src,src+s.len,bytes.begin()+off);
+  }
+
+}
+
+#endif
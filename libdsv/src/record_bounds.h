@@ -0,0 +1,274 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LIBDSV_RECORD_BOUNDS_H
+#define LIBDSV_RECORD_BOUNDS_H
+
+#include "dsv_parser.h"
+#include "record_scan.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <system_error>
+
+#include <cstddef>
+
+namespace detail {
+
+  /**
+   *  Divide content held in memory, such as a mapped file, into parts of
+   *  about equal size that begin and end at record boundaries so a newline
+   *  in an escaped field never splits a record.
+   *
+   *  Whether a point in the content is inside an escaped field depends on
+   *  every DQUOTE before it so the boundaries are found in two passes. The
+   *  content is first cut into blocks of equal size and the threads scan the
+   *  blocks concurrently, each counting its DQUOTE and locating its first
+   *  record end for both of the quote states it may start in. The parity of
+   *  the counts then gives the true starting state of every block in order
+   *  and so the record end that actually bounds each part. A record that
+   *  spans whole blocks merges their parts so there may be fewer parts than
+   *  blocks.
+   *
+   *  The content must begin at a record boundary outside of an escaped
+   *  field. Newlines are recognized according to the newline behavior which
+   *  should already be settled, such as by the header.
+   */
+  class record_bounds {
+    public:
+      record_bounds(const unsigned char *data, std::size_t len,
+        std::size_t first_line, dsv_newline_behavior newline,
+        unsigned char delimiter, bool escaped_binary);
+
+      /*
+          Locate the parts for blocks of block_bytes using up to threads
+          threads including the calling one
+       */
+      void locate(std::size_t block_bytes, std::size_t threads);
+
+      /*
+          Part i is [bounds()[i],bounds()[i+1]) and starts on line lines()[i]
+       */
+      const std::vector<const unsigned char *> & bounds(void) const;
+      const std::vector<std::size_t> & lines(void) const;
+
+    private:
+      /*
+          What the first pass learns of the block of content [begin,end)
+          without knowing its starting quote state. For each state s,
+          record_end[s] is just past the first record that ends in the block
+          or 0 if none does, and record_lines[s] the number of newlines from
+          begin to there. lines is the number of newlines in the block and
+          parity whether it holds an odd number of DQUOTE.
+       */
+      struct block {
+        const unsigned char *begin;
+        const unsigned char *end;
+        const unsigned char *record_end[2];
+        std::size_t record_lines[2];
+        std::size_t lines;
+        bool parity;
+
+        block(void) :begin(0), end(0), lines(0), parity(false) {
+          record_end[0] = record_end[1] = 0;
+          record_lines[0] = record_lines[1] = 0;
+        }
+      };
+
+      const unsigned char *content_begin;
+      const unsigned char *content_end;
+      std::size_t first_line;
+
+      dsv_newline_behavior newline;
+      unsigned char delimiter;
+      bool escaped_binary;
+
+      // the blocks of the first pass and the next to be scanned, guarded by
+      // lock
+      std::mutex lock;
+      std::vector<block> blocks;
+      std::size_t next_block;
+
+      std::vector<const unsigned char *> part_bounds;
+      std::vector<std::size_t> part_lines;
+
+      void scan_blocks(void);
+      void scan_block(block &b);
+
+      record_bounds(const record_bounds &);
+      record_bounds & operator=(const record_bounds &);
+  };
+
+  inline record_bounds::record_bounds(const unsigned char *data,
+    std::size_t len, std::size_t line, dsv_newline_behavior behavior,
+    unsigned char delim, bool binary) :content_begin(data),
+    content_end(data+len), first_line(line), newline(behavior),
+    delimiter(delim), escaped_binary(binary), next_block(0)
+  {
+  }
+
+  inline void record_bounds::locate(std::size_t block_bytes,
+    std::size_t threads)
+  {
+    block_bytes = std::max<std::size_t>(block_bytes,1);
+
+    std::size_t len = content_end-content_begin;
+    for(std::size_t off=0; off<len; off+=block_bytes) {
+      blocks.push_back(block());
+      blocks.back().begin = content_begin + off;
+      blocks.back().end = content_begin + std::min(len-off,block_bytes) + off;
+    }
+
+    // the first pass, with the calling thread doing its share
+    std::vector<std::thread> scanners;
+    try {
+      for(std::size_t i=1; i<threads && i<blocks.size(); ++i)
+        scanners.push_back(std::thread(&record_bounds::scan_blocks,this));
+    }
+    catch(std::system_error &) {
+    }
+
+    scan_blocks();
+
+    for(std::size_t i=0; i<scanners.size(); ++i)
+      scanners[i].join();
+
+    /*
+        The first block starts at a record boundary outside of an escaped
+        field. Each following block starts in the state the parity of those
+        before it leaves, which selects where its part starts
+     */
+    std::vector<const unsigned char *> starts(blocks.size()+1,content_end);
+    std::vector<std::size_t> lines(blocks.size()+1,0);
+
+    bool quoted = false;
+    std::size_t line = first_line;
+    for(std::size_t i=0; i<blocks.size(); ++i) {
+      const block &b = blocks[i];
+
+      if(i == 0) {
+        starts[i] = b.begin;
+        lines[i] = line;
+      }
+      else if(b.record_end[quoted]) {
+        starts[i] = b.record_end[quoted];
+        lines[i] = line + b.record_lines[quoted];
+      }
+      else
+        starts[i] = 0;
+
+      quoted = (quoted != b.parity);
+      line += b.lines;
+    }
+    lines[blocks.size()] = line;
+
+    // a record that spans a block starts the part of a later one
+    for(std::size_t i=blocks.size(); i>0; --i) {
+      if(!starts[i-1]) {
+        starts[i-1] = starts[i];
+        lines[i-1] = lines[i];
+      }
+    }
+
+    part_bounds.clear();
+    part_lines.clear();
+    for(std::size_t i=0; i<starts.size(); ++i) {
+      if(part_bounds.empty() || starts[i] != part_bounds.back()) {
+        part_bounds.push_back(starts[i]);
+        part_lines.push_back(lines[i]);
+      }
+    }
+
+    blocks.clear();
+    next_block = 0;
+  }
+
+  inline const std::vector<const unsigned char *> &
+  record_bounds::bounds(void) const
+  {
+    return part_bounds;
+  }
+
+  inline const std::vector<std::size_t> & record_bounds::lines(void) const
+  {
+    return part_lines;
+  }
+
+  inline void record_bounds::scan_blocks(void)
+  {
+    while(true) {
+      block *b = 0;
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(next_block == blocks.size())
+          return;
+
+        b = &blocks[next_block++];
+      }
+
+      scan_block(*b);
+    }
+  }
+
+  inline void record_bounds::scan_block(block &b)
+  {
+    // a CR that ends the previous block may begin a CRLF. It is not a
+    // DQUOTE so starting with it changes neither the state nor the parity
+    const unsigned char *from = b.begin;
+    if(from != content_begin && from[-1] == 0x0D)
+      --from;
+
+    std::size_t len = b.end-from;
+
+    record_scan scan(newline,delimiter,escaped_binary);
+
+    std::size_t all = len;
+    scan.scan(from,len,all);
+    b.lines = scan.lines();
+    b.parity = scan.quoted();
+
+    for(int state=0; state<2; ++state) {
+      scan.reset();
+      scan.quoted(state != 0);
+
+      std::size_t one = 1;
+      std::size_t found = scan.scan(from,len,one);
+      if(!one) {
+        b.record_end[state] = from + found;
+        b.record_lines[state] = scan.lines();
+      }
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LIBDSV_RECORD_INDEX_H
+#define LIBDSV_RECORD_INDEX_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dsv_parser.h"
+#include "parser.h"
+#include "record_scan.h"
+
+#include <vector>
+#include <algorithm>
+#include <system_error>
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace detail {
+
+  /**
+   *  The offsets of every stride-th record of a file so that a parse can
+   *  start at any record after scanning fewer than stride records.
+   *
+   *  A record always starts outside of an escaped field so the quote state
+   *  at an indexed offset is known without being kept. The line of each
+   *  indexed record is kept for the locations of log messages. Records are
+   *  counted from 0 after the header and end as record_scan ends them with
+   *  the delimiter, escaped binary and newline settings the index was built
+   *  with, which are kept to check that a parse reads the records the same
+   *  way. The size, modification time to the nanosecond where the system
+   *  records it, device and inode of the file are kept to detect an index
+   *  that is out of date, including one for a file rewritten with the same
+   *  size within a second or replaced by another.
+   *
+   *  The sidecar file holds a fixed header followed by an entry of fixed
+   *  size per indexed record, each number as 8 bytes in little-endian
+   *  order, so that a single entry can be read without reading the rest.
+   *
+   *  Failures are reported by throwing std::system_error. A file that is not
+   *  an index is EINVAL.
+   */
+  class record_index {
+    public:
+      record_index(void);
+
+      /*
+          Index the len bytes at data, holding a header and records, with
+          the delimiter, escaped binary and newline settings of settings
+       */
+      void build(const unsigned char *data, std::size_t len,
+        std::size_t stride, const parser_settings &settings);
+
+      /*
+          Write the index of the file with status st to the file named path
+       */
+      void save(const char *path, const struct stat &st) const;
+
+      /*
+          Read the index in the file named path, keeping only the entry that
+          locate needs for record
+       */
+      void load(const char *path, std::size_t record);
+
+      /*
+          True if the index was built for the file with status st
+       */
+      bool current(const struct stat &st) const;
+
+      /*
+          True if settings read records as the index does
+       */
+      bool compatible(const parser_settings &settings) const;
+
+      std::size_t header_length(void) const;
+      std::size_t records(void) const;
+      dsv_newline_behavior newline(void) const;
+
+      /*
+          The offset and line of the nearest indexed record at or before
+          record. Returns the number of records from there to record.
+          record must be less than records()
+       */
+      std::size_t locate(std::size_t record, std::size_t &offset,
+        std::size_t &line) const;
+
+    private:
+      struct entry {
+        std::uint64_t offset;
+        std::uint64_t line;
+      };
+
+      // the header of the sidecar file
+      enum {
+        magic_bytes = 8,
+        header_fields = 12,
+        header_bytes = magic_bytes + 8*header_fields,
+        entry_bytes = 16,
+        version = 2
+      };
+
+      static const unsigned char * magic(void);
+
+      std::uint64_t file_size;
+      std::uint64_t file_mtime;
+      std::uint64_t file_mtime_nsec;
+      std::uint64_t file_dev;
+      std::uint64_t file_ino;
+      std::uint64_t stride;
+      std::uint64_t record_count;
+      std::uint64_t header_len;
+      std::uint64_t delimiter;
+      std::uint64_t escaped_binary;
+      std::uint64_t newline_behavior;
+
+      // entries holds the entry for record first_entry*stride and those after
+      std::vector<entry> entries;
+      std::size_t first_entry;
+
+      static std::uint64_t mtime_nsec(const struct stat &st);
+
+      static void put(std::vector<unsigned char> &buf, std::uint64_t value);
+      static std::uint64_t get(const unsigned char *buf);
+
+      static void read_at(int fd, unsigned char *buf, std::size_t len,
+        std::size_t offset);
+  };
+
+  inline record_index::record_index(void) :file_size(0), file_mtime(0),
+    file_mtime_nsec(0), file_dev(0), file_ino(0), stride(1),
+    record_count(0), header_len(0), delimiter(','), escaped_binary(0),
+    newline_behavior(dsv_newline_permissive), first_entry(0)
+  {
+  }
+
+  inline void record_index::build(const unsigned char *data, std::size_t len,
+    std::size_t n, const parser_settings &settings)
+  {
+    stride = (n ? n : 1);
+    delimiter = settings.delimiter();
+    escaped_binary = settings.escaped_binary_fields();
+
+    entries.clear();
+    first_entry = 0;
+    record_count = 0;
+
+    record_scan scan(settings.newline_behavior(),settings.delimiter(),
+      settings.escaped_binary_fields());
+
+    std::size_t one = 1;
+    std::size_t pos = scan.scan(data,len,one);
+    header_len = pos;
+
+    // an unterminated last record is a record as well
+    while(pos < len) {
+      if(record_count % stride == 0) {
+        entry e = {pos,scan.lines()+1};
+        entries.push_back(e);
+      }
+
+      one = 1;
+      pos += scan.scan(data+pos,len-pos,one);
+      ++record_count;
+    }
+
+    newline_behavior = scan.newline();
+  }
+
+  inline void record_index::save(const char *path, const struct stat &st) const
+  {
+    std::vector<unsigned char> buf(magic(),magic()+magic_bytes);
+    buf.reserve(header_bytes + entry_bytes*entries.size());
+
+    put(buf,version);
+    put(buf,st.st_size);
+    put(buf,st.st_mtime);
+    put(buf,mtime_nsec(st));
+    put(buf,st.st_dev);
+    put(buf,st.st_ino);
+    put(buf,stride);
+    put(buf,record_count);
+    put(buf,header_len);
+    put(buf,delimiter);
+    put(buf,escaped_binary);
+    put(buf,newline_behavior);
+
+    for(std::size_t i=0; i<entries.size(); ++i) {
+      put(buf,entries[i].offset);
+      put(buf,entries[i].line);
+    }
+
+    int fd = ::open(path,O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd < 0)
+      throw std::system_error(errno,std::system_category());
+
+    for(std::size_t written=0; written<buf.size();) {
+      ssize_t n = write(fd,buf.data()+written,buf.size()-written);
+      if(n < 0) {
+        if(errno == EINTR)
+          continue;
+
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err,std::system_category());
+      }
+
+      written += n;
+    }
+
+    if(::close(fd) != 0 && errno != EINTR)
+      throw std::system_error(errno,std::system_category());
+  }
+
+  inline void record_index::load(const char *path, std::size_t record)
+  {
+    int fd = ::open(path,O_RDONLY);
+    if(fd < 0)
+      throw std::system_error(errno,std::system_category());
+
+    try {
+      unsigned char buf[header_bytes];
+      read_at(fd,buf,header_bytes,0);
+
+      if(!std::equal(magic(),magic()+magic_bytes,buf)
+        || get(buf+magic_bytes) != version)
+      {
+        throw std::system_error(EINVAL,std::system_category());
+      }
+
+      const unsigned char *field = buf+magic_bytes+8;
+      file_size = get(field);
+      file_mtime = get(field+8);
+      file_mtime_nsec = get(field+16);
+      file_dev = get(field+24);
+      file_ino = get(field+32);
+      stride = get(field+40);
+      record_count = get(field+48);
+      header_len = get(field+56);
+      delimiter = get(field+64);
+      escaped_binary = get(field+72);
+      newline_behavior = get(field+80);
+
+      if(!stride)
+        throw std::system_error(EINVAL,std::system_category());
+
+      entries.clear();
+      first_entry = 0;
+      if(record < record_count) {
+        first_entry = record/stride;
+
+        unsigned char e[entry_bytes];
+        read_at(fd,e,entry_bytes,header_bytes + entry_bytes*first_entry);
+
+        entry found = {get(e),get(e+8)};
+        entries.push_back(found);
+      }
+    }
+    catch(...) {
+      ::close(fd);
+      throw;
+    }
+
+    ::close(fd);
+  }
+
+  inline bool record_index::current(const struct stat &st) const
+  {
+    return file_size == static_cast<std::uint64_t>(st.st_size)
+      && file_mtime == static_cast<std::uint64_t>(st.st_mtime)
+      && file_mtime_nsec == mtime_nsec(st)
+      && file_dev == static_cast<std::uint64_t>(st.st_dev)
+      && file_ino == static_cast<std::uint64_t>(st.st_ino);
+  }
+
+  inline bool record_index::compatible(const parser_settings &settings) const
+  {
+    return delimiter == settings.delimiter()
+      && escaped_binary == settings.escaped_binary_fields()
+      && (settings.newline_behavior() == dsv_newline_permissive
+        || newline_behavior == dsv_newline_permissive
+        || settings.newline_behavior() == newline_behavior);
+  }
+
+  inline std::size_t record_index::header_length(void) const
+  {
+    return header_len;
+  }
+
+  inline std::size_t record_index::records(void) const
+  {
+    return record_count;
+  }
+
+  inline dsv_newline_behavior record_index::newline(void) const
+  {
+    return static_cast<dsv_newline_behavior>(newline_behavior);
+  }
+
+  inline std::size_t record_index::locate(std::size_t record,
+    std::size_t &offset, std::size_t &line) const
+  {
+    const entry &e = entries[record/stride - first_entry];
+    offset = e.offset;
+    line = e.line;
+
+    return record % stride;
+  }
+
+  inline const unsigned char * record_index::magic(void)
+  {
+    static const unsigned char bytes[magic_bytes] =
+      {'l','i','b','d','s','v','i','x'};
+
+    return bytes;
+  }
+
+  /*
+      The nanoseconds of the modification time or 0 where the system does
+      not record them
+   */
+  inline std::uint64_t record_index::mtime_nsec(const struct stat &st)
+  {
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+    return st.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+    return st.st_mtimespec.tv_nsec;
+#else
+    return 0;
+#endif
+  }
+
+  inline void record_index::put(std::vector<unsigned char> &buf,
+    std::uint64_t value)
+  {
+    for(int i=0; i<8; ++i)
+      buf.push_back(static_cast<unsigned char>(value >> (8*i)));
+  }
+
+  inline std::uint64_t record_index::get(const unsigned char *buf)
+  {
+    std::uint64_t value = 0;
+    for(int i=7; i>=0; --i)
+      value = (value << 8) | buf[i];
+
+    return value;
+  }
+
+  /*
+      Read exactly len bytes at offset of fd. A short file is not an index
+   */
+  inline void record_index::read_at(int fd, unsigned char *buf,
+    std::size_t len, std::size_t offset)
+  {
+    while(len) {
+      ssize_t n = pread(fd,buf,len,offset);
+      if(n < 0) {
+        if(errno == EINTR)
+          continue;
+        throw std::system_error(errno,std::system_category());
+      }
+
+      if(n == 0)
+        throw std::system_error(EINVAL,std::system_category());
+
+      buf += n;
+      len -= n;
+      offset += n;
+    }
+  }
+
+}
+
+#endif
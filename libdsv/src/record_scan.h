@@ -0,0 +1,297 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_RECORD_SCAN_H
+#define LIBDSV_RECORD_SCAN_H
+
+#include "dsv_parser.h"
+#include "structural_scan.h"
+
+#include <cstddef>
+
+namespace detail {
+
+  /**
+   *  Locates the ends of records without parsing them.
+   *
+   *  Only quote state, newlines and, when counting, delimiters are tracked.
+   *  Every DQUOTE toggles whether the scan is inside an escaped field, which
+   *  also accounts for D2QUOTE, and a newline outside of an escaped field
+   *  ends a record. Newlines are recognized according to the newline
+   *  behavior in the same way as the parser does, including settling a
+   *  permissive behavior at the first newline. The content of the records is
+   *  not checked so malformed records are not detected.
+   *
+   *  The state is kept between calls so the input can be supplied in pieces
+   *  split anywhere.
+   */
+  class record_scan {
+    public:
+      explicit record_scan(
+        dsv_newline_behavior behavior=dsv_newline_permissive,
+        unsigned char delim=',', bool escaped_binary=false);
+
+      /*
+          The newline behavior, which a permissive behavior is settled to at
+          the first newline
+       */
+      dsv_newline_behavior newline(void) const;
+      void newline(dsv_newline_behavior behavior);
+
+      /*
+          Scan the len bytes at data until the ends of records records have
+          been found. Returns the number of bytes scanned which is either
+          len or just past the end of the last record found. records is
+          reduced by the number of records found.
+       */
+      std::size_t scan(const unsigned char *data, std::size_t len,
+        std::size_t &records);
+
+      /*
+          Scan all len bytes at data, counting the records that end and the
+          fields they contain. finish() counts a last unterminated record.
+       */
+      void count(const unsigned char *data, std::size_t len);
+      void finish(void);
+
+      /*
+          The number of records and their fields counted. An empty record
+          has no fields.
+       */
+      std::size_t records(void) const;
+      std::size_t fields(void) const;
+
+      /*
+          The number of newlines scanned, including those inside escaped
+          fields
+       */
+      std::size_t lines(void) const;
+
+      /*
+          True if the scan is inside an escaped field. Set to resume a scan
+          from a point known to be inside one
+       */
+      bool quoted(void) const;
+      void quoted(bool flag);
+
+      void reset(void);
+
+    private:
+      dsv_newline_behavior behavior;
+      unsigned char delimiter;
+      bool escaped_binary_fields;
+
+      bool in_quotes;
+
+      // the last byte scanned was a CR
+      bool after_cr;
+
+      // the record being counted has content and its unescaped delimiters
+      bool in_record;
+      std::size_t delimiters;
+
+      std::size_t _lines;
+      std::size_t _records;
+      std::size_t _fields;
+
+      /*
+          Called for a LF. Returns true if it completes a newline
+       */
+      bool end_of_line(void);
+
+      void end_record(void);
+  };
+
+  inline record_scan::record_scan(dsv_newline_behavior b, unsigned char delim,
+    bool escaped_binary) :behavior(b), delimiter(delim),
+    escaped_binary_fields(escaped_binary), in_quotes(false), after_cr(false),
+    in_record(false), delimiters(0), _lines(0), _records(0), _fields(0)
+  {
+  }
+
+  inline dsv_newline_behavior record_scan::newline(void) const
+  {
+    return behavior;
+  }
+
+  inline void record_scan::newline(dsv_newline_behavior b)
+  {
+    behavior = b;
+  }
+
+  inline std::size_t record_scan::scan(const unsigned char *data,
+    std::size_t len, std::size_t &records)
+  {
+    std::size_t i = 0;
+    while(i < len && records) {
+      std::size_t n = find_boundary(data+i,len-i);
+      if(n)
+        after_cr = (data[i+n-1] == 0x0D);
+
+      i += n;
+      if(i == len)
+        break;
+
+      if(data[i++] == 0x22) {
+        in_quotes = !in_quotes;
+        after_cr = false;
+        continue;
+      }
+
+      if(end_of_line() && !in_quotes)
+        --records;
+    }
+
+    return i;
+  }
+
+  inline void record_scan::count(const unsigned char *data, std::size_t len)
+  {
+    std::size_t i = 0;
+    while(i < len) {
+      std::size_t n = find_boundary(data+i,len-i,delimiter);
+      if(n) {
+        after_cr = (data[i+n-1] == 0x0D);
+
+        // a CR alone may yet be part of a CRLF
+        if(n > 1 || !after_cr)
+          in_record = true;
+      }
+
+      i += n;
+      if(i == len)
+        break;
+
+      // the delimiter takes precedence as in the parser
+      unsigned char cur = data[i++];
+      if(cur == delimiter) {
+        if(!in_quotes)
+          ++delimiters;
+        in_record = true;
+        after_cr = false;
+      }
+      else if(cur == 0x22) {
+        in_quotes = !in_quotes;
+        in_record = true;
+        after_cr = false;
+      }
+      else {
+        // a CR is content if only a LF is a newline
+        if(after_cr && behavior == dsv_newline_lf_strict)
+          in_record = true;
+
+        if(!end_of_line())
+          in_record = true;
+        else if(!in_quotes)
+          end_record();
+      }
+    }
+  }
+
+  inline void record_scan::finish(void)
+  {
+    if(after_cr)
+      in_record = true;
+
+    if(in_record)
+      end_record();
+
+    after_cr = false;
+  }
+
+  inline std::size_t record_scan::records(void) const
+  {
+    return _records;
+  }
+
+  inline std::size_t record_scan::fields(void) const
+  {
+    return _fields;
+  }
+
+  inline std::size_t record_scan::lines(void) const
+  {
+    return _lines;
+  }
+
+  inline bool record_scan::quoted(void) const
+  {
+    return in_quotes;
+  }
+
+  inline void record_scan::quoted(bool flag)
+  {
+    in_quotes = flag;
+  }
+
+  inline void record_scan::reset(void)
+  {
+    in_quotes = false;
+    after_cr = false;
+    in_record = false;
+    delimiters = 0;
+    _lines = 0;
+    _records = 0;
+    _fields = 0;
+  }
+
+  inline bool record_scan::end_of_line(void)
+  {
+    bool crlf = (after_cr && behavior != dsv_newline_lf_strict);
+    after_cr = false;
+
+    if(!crlf && behavior == dsv_newline_crlf_strict)
+      return false;
+
+    // as in the parser, the first newline settles a permissive behavior
+    if(behavior == dsv_newline_permissive
+      && !(in_quotes && escaped_binary_fields))
+    {
+      behavior = (crlf ? dsv_newline_crlf_strict : dsv_newline_lf_strict);
+    }
+
+    ++_lines;
+
+    return true;
+  }
+
+  inline void record_scan::end_record(void)
+  {
+    ++_records;
+    if(in_record)
+      _fields += delimiters+1;
+
+    in_record = false;
+    delimiters = 0;
+  }
+
+}
+
+#endif
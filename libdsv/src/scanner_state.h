@@ -35,6 +35,7 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <memory>
 #include <system_error>
@@ -46,10 +47,61 @@ namespace detail {
   /**
    *  Object that holds the current state of the scanner. Also handles buffered reads.
    *
+   *  The scanner either reads from a stream through its own buffer or scans
+   *  a caller supplied region of memory in place. In the latter case, there
+   *  is nothing to refill and the putback offsets index the region directly.
+   *
+   *  Input may also be supplied incrementally through append(). Until
+   *  finish() is called, running out of input returns underflow rather than
+   *  EOF so that the reader can wait for more.
    */
   class scanner_state {
     public:
-      scanner_state(const char *str, FILE *in=0, std::size_t buff_size=256);
+      /*
+          Returned by the read functions when all appended input has been
+          consumed but more may follow
+       */
+      enum { underflow = EOF-1 };
+
+      /*
+          Tag selecting incremental input
+       */
+      struct incremental_input {};
+
+      /*
+          Source of the input for a scanner that does not read a stream
+          itself. read() copies up to len bytes to buf and returns the number
+          copied, 0 at the end of input. Errors are thrown as
+          std::system_error
+       */
+      struct input_source {
+        virtual ~input_source(void) {}
+        virtual std::size_t read(unsigned char *buf, std::size_t len) = 0;
+      };
+
+      /*
+          Read from the stream in. If in is zero, open the file named by str.
+          A stream supplied by the caller is not closed by the scanner.
+       */
+      scanner_state(const char *str, FILE *in=0, std::size_t buff_size=65536);
+
+      /*
+          Scan the len bytes at data in place. The memory is not copied and
+          must remain valid for the lifetime of the scanner.
+       */
+      scanner_state(const char *str, const unsigned char *data,
+        std::size_t len);
+
+      /*
+          Scan input supplied through append()
+       */
+      scanner_state(const char *str, incremental_input);
+
+      /*
+          Read from source, which must outlive the scanner
+       */
+      scanner_state(const char *str, input_source &source,
+        std::size_t buff_size=65536);
 
       const char * filename(void) const;
 
@@ -78,6 +130,41 @@ namespace detail {
        */
       int fadvancec(void);
 
+      /*
+          Number of bytes that can be read contiguously starting at current().
+          Refills the buffer if needed. Returns 0 if none are available in
+          which case getc tells whether this is EOF or underflow.
+       */
+      std::size_t available(void);
+
+      /*
+          Pointer to the current read location
+       */
+      const unsigned char * current(void) const;
+
+      /*
+          True if the input is a caller supplied region that is scanned in
+          place and therefore remains valid and unmoved for the whole parse.
+          See region() and offset()
+       */
+      bool in_place(void) const;
+
+      /*
+          Start of the region scanned in place
+       */
+      const unsigned char * region(void) const;
+
+      /*
+          Offset of the current read location from region()
+       */
+      std::size_t offset(void) const;
+
+      /*
+          Forget any putback buffer and advance the read location by n bytes.
+          n must not exceed available()
+       */
+      void fadvance(std::size_t n);
+
       /*
           Putback any bytes from the putback buffer to be read again. If the
           putback buffer is empty, this has no effect.
@@ -89,21 +176,58 @@ namespace detail {
       */
       void forget(void);
 
+      /*
+          Remember the current read location so that a token that cannot be
+          completed with the input appended so far can be rescanned once more
+          input arrives. Only meaningful for incremental input.
+       */
+      void mark(void);
+
+      /*
+          Return to the location saved by mark()
+       */
+      void rewind(void);
+
+      /*
+          Add len bytes at data to the end of the incremental input. Input
+          before the marked location is discarded.
+       */
+      void append(const unsigned char *data, std::size_t len);
+
+      /*
+          No more input will be appended. Running out of input now returns
+          EOF.
+       */
+      void finish(void);
+
     private:
       std::string fname;
       std::shared_ptr<FILE> stream;
+      input_source *source;
 
       std::vector<unsigned char> buff;
+
+      // start of the readable bytes, either buff or the caller's memory
+      const unsigned char *base;
+
       std::size_t begin_off;
       std::size_t cur_off;
       std::size_t end_off;
+      std::size_t mark_off;
+
+      // false while incremental input may still be appended
+      bool finished;
+
+      // scanning a caller supplied region
+      bool scan_in_place;
 
       bool refill(void);
   };
 
   inline scanner_state::scanner_state(const char *str, FILE *in,
-    std::size_t buff_size) :buff(buff_size), begin_off(0), cur_off(0),
-    end_off(0)
+    std::size_t buff_size) :source(0), buff(buff_size), base(buff.data()),
+    begin_off(0), cur_off(0), end_off(0), mark_off(0), finished(true),
+    scan_in_place(false)
   {
     if(str)
       fname = str;
@@ -114,9 +238,37 @@ namespace detail {
       if(!in) {
         throw std::system_error(errno,std::system_category());
       }
+
+      stream = std::shared_ptr<FILE>(in,&fclose);
     }
+    else
+      stream = std::shared_ptr<FILE>(in,[](FILE *){});
+  }
+
+  inline scanner_state::scanner_state(const char *str,
+    const unsigned char *data, std::size_t len) :source(0), base(data),
+    begin_off(0), cur_off(0), end_off(len), mark_off(0), finished(true),
+    scan_in_place(true)
+  {
+    if(str)
+      fname = str;
+  }
+
+  inline scanner_state::scanner_state(const char *str, incremental_input)
+    :source(0), base(0), begin_off(0), cur_off(0), end_off(0), mark_off(0),
+    finished(false), scan_in_place(false)
+  {
+    if(str)
+      fname = str;
+  }
 
-    stream = std::shared_ptr<FILE>(in,&fclose);
+  inline scanner_state::scanner_state(const char *str, input_source &src,
+    std::size_t buff_size) :source(&src), buff(buff_size), base(buff.data()),
+    begin_off(0), cur_off(0), end_off(0), mark_off(0), finished(true),
+    scan_in_place(false)
+  {
+    if(str)
+      fname = str;
   }
 
   inline const char * scanner_state::filename(void) const
@@ -127,16 +279,16 @@ namespace detail {
   inline int scanner_state::getc(void)
   {
     if(cur_off == end_off && !refill())
-      return EOF;
+      return (finished ? EOF : underflow);
 
-    return buff.at(cur_off);
+    return base[cur_off];
   }
 
   inline int scanner_state::advancec(void)
   {
     int result = getc();
 
-    if(result != EOF)
+    if(result >= 0)
       ++cur_off;
 
     return result;
@@ -146,12 +298,45 @@ namespace detail {
   {
     int result = getc();
 
-    if(result != EOF)
+    if(result >= 0)
       begin_off = ++cur_off;
 
     return result;
   }
 
+  inline std::size_t scanner_state::available(void)
+  {
+    if(cur_off == end_off && !refill())
+      return 0;
+
+    return end_off - cur_off;
+  }
+
+  inline const unsigned char * scanner_state::current(void) const
+  {
+    return base + cur_off;
+  }
+
+  inline bool scanner_state::in_place(void) const
+  {
+    return scan_in_place;
+  }
+
+  inline const unsigned char * scanner_state::region(void) const
+  {
+    return base;
+  }
+
+  inline std::size_t scanner_state::offset(void) const
+  {
+    return cur_off;
+  }
+
+  inline void scanner_state::fadvance(std::size_t n)
+  {
+    begin_off = cur_off += n;
+  }
+
   inline void scanner_state::putback(void)
   {
     cur_off = begin_off;
@@ -162,6 +347,36 @@ namespace detail {
     begin_off = cur_off;
   }
 
+  inline void scanner_state::mark(void)
+  {
+    mark_off = cur_off;
+  }
+
+  inline void scanner_state::rewind(void)
+  {
+    begin_off = cur_off = mark_off;
+  }
+
+  inline void scanner_state::append(const unsigned char *data,
+    std::size_t len)
+  {
+    std::size_t keep_off = std::min(mark_off,begin_off);
+
+    buff.erase(buff.begin(),buff.begin()+keep_off);
+    begin_off -= keep_off;
+    cur_off -= keep_off;
+    mark_off -= keep_off;
+
+    buff.insert(buff.end(),data,data+len);
+    end_off = buff.size();
+    base = buff.data();
+  }
+
+  inline void scanner_state::finish(void)
+  {
+    finished = true;
+  }
+
 
   /**
       IMPORTANT! Buff MUST be bigger than twice the minimum putback size
@@ -169,6 +384,10 @@ namespace detail {
    */
   inline bool scanner_state::refill(void)
   {
+    // scanning memory in place, there is nothing more to read
+    if(!stream && !source)
+      return false;
+
 //     std::cerr << "(Pre) begin_off (" << begin_off << "); cur_off ("
 //       << cur_off << "); end_off (" << end_off << "); putback contains:\n [[";
 //     for(std::size_t i=begin_off; i<cur_off; ++i) {
@@ -196,10 +415,15 @@ namespace detail {
 //       std::cerr << "]]\n";
     }
 
-    // code adapted from flex non-posix fread
-    errno=0;
     std::size_t len;
     std::size_t buf_len = buff.size()-cur_off;
+    if(source) {
+      end_off = cur_off + source->read(buff.data()+cur_off,buf_len);
+      return cur_off != end_off;
+    }
+
+    // code adapted from flex non-posix fread
+    errno=0;
     while ((len = std::fread(buff.data()+cur_off,1,buf_len,stream.get()))==0
       && std::ferror(stream.get()))
     {
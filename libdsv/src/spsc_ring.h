@@ -0,0 +1,144 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_SPSC_RING_H
+#define LIBDSV_SPSC_RING_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+
+namespace detail {
+
+  /**
+   *  A bounded ring of items passed from one producing thread to one
+   *  consuming thread.
+   *
+   *  push() waits while the ring is full and pop() while it is empty. Either
+   *  side ends the exchange with close(): the producer once it has nothing
+   *  more to give, after which the consumer still receives what is left, or
+   *  the consumer to abandon it, after which push() fails at once.
+   *
+   *  The lock is only held to move an item in or out so with items as large
+   *  as a block of input or a batch of records the threads seldom meet.
+   */
+  template<typename T>
+  class spsc_ring {
+    public:
+      explicit spsc_ring(std::size_t capacity);
+
+      /*
+          Move item into the ring. Returns false, leaving item as it was, if
+          the ring has been closed
+       */
+      bool push(T &item);
+
+      /*
+          Move the oldest item into item. Returns false once the ring is
+          closed and empty
+       */
+      bool pop(T &item);
+
+      void close(void);
+
+    private:
+      std::vector<T> slots;
+      std::size_t head;
+      std::size_t count;
+      bool closed;
+
+      std::mutex lock;
+      std::condition_variable changed;
+
+      spsc_ring(const spsc_ring &);
+      spsc_ring & operator=(const spsc_ring &);
+  };
+
+  template<typename T>
+  inline spsc_ring<T>::spsc_ring(std::size_t capacity) :slots(capacity),
+    head(0), count(0), closed(false)
+  {
+  }
+
+  template<typename T>
+  inline bool spsc_ring<T>::push(T &item)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while(!closed && count == slots.size())
+        changed.wait(guard);
+
+      if(closed)
+        return false;
+
+      slots[(head+count) % slots.size()] = std::move(item);
+      ++count;
+    }
+    changed.notify_one();
+
+    return true;
+  }
+
+  template<typename T>
+  inline bool spsc_ring<T>::pop(T &item)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+
+      while(!closed && count == 0)
+        changed.wait(guard);
+
+      if(count == 0)
+        return false;
+
+      item = std::move(slots[head]);
+      head = (head+1) % slots.size();
+      --count;
+    }
+    changed.notify_one();
+
+    return true;
+  }
+
+  template<typename T>
+  inline void spsc_ring<T>::close(void)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closed = true;
+    }
+    changed.notify_all();
+  }
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ Copyright (c) 2014, Mike Tegtmeyer
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBDSV_STRUCTURAL_SCAN_H
+#define LIBDSV_STRUCTURAL_SCAN_H
+
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) \
+  && defined(__GNUC__)
+#define LIBDSV_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace detail {
+
+  /*
+      True if c can end an unescaped TEXTDATA run. That is, the delimiter,
+      DQUOTE, or any byte outside of the printable ASCII range (which includes
+      LF and CR).
+   */
+  inline bool is_structural(unsigned char c, unsigned char delim)
+  {
+    return (c == delim || c == 0x22 || c < 32 || c > 126);
+  }
+
+  inline std::size_t find_structural_scalar(const unsigned char *data,
+    std::size_t len, unsigned char delim)
+  {
+    std::size_t i = 0;
+    while(i < len && !is_structural(data[i],delim))
+      ++i;
+
+    return i;
+  }
+
+#ifdef LIBDSV_X86_SIMD
+  /*
+      In each kernel, a signed compare against 0x20 selects both the control
+      characters and all bytes >= 0x80. DEL (0x7F) is matched separately.
+   */
+
+  inline std::size_t find_structural_sse2(const unsigned char *data,
+    std::size_t len, unsigned char delim)
+  {
+    const __m128i delim_v = _mm_set1_epi8(static_cast<char>(delim));
+    const __m128i quote_v = _mm_set1_epi8(0x22);
+    const __m128i space_v = _mm_set1_epi8(0x20);
+    const __m128i del_v = _mm_set1_epi8(0x7F);
+
+    std::size_t i = 0;
+    for(; i+16 <= len; i+=16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data+i));
+      __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v,delim_v),_mm_cmpeq_epi8(v,quote_v)),
+        _mm_or_si128(_mm_cmplt_epi8(v,space_v),_mm_cmpeq_epi8(v,del_v)));
+
+      unsigned int mask = _mm_movemask_epi8(m);
+      if(mask)
+        return i + __builtin_ctz(mask);
+    }
+
+    return i + find_structural_scalar(data+i,len-i,delim);
+  }
+
+  __attribute__((target("avx2")))
+  inline std::size_t find_structural_avx2(const unsigned char *data,
+    std::size_t len, unsigned char delim)
+  {
+    const __m256i delim_v = _mm256_set1_epi8(static_cast<char>(delim));
+    const __m256i quote_v = _mm256_set1_epi8(0x22);
+    const __m256i space_v = _mm256_set1_epi8(0x20);
+    const __m256i del_v = _mm256_set1_epi8(0x7F);
+
+    std::size_t i = 0;
+    for(; i+32 <= len; i+=32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data+i));
+      __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v,delim_v),
+          _mm256_cmpeq_epi8(v,quote_v)),
+        _mm256_or_si256(_mm256_cmpgt_epi8(space_v,v),
+          _mm256_cmpeq_epi8(v,del_v)));
+
+      unsigned int mask = _mm256_movemask_epi8(m);
+      if(mask)
+        return i + __builtin_ctz(mask);
+    }
+
+    return i + find_structural_sse2(data+i,len-i,delim);
+  }
+
+  __attribute__((target("avx512bw")))
+  inline std::size_t find_structural_avx512(const unsigned char *data,
+    std::size_t len, unsigned char delim)
+  {
+    const __m512i delim_v = _mm512_set1_epi8(static_cast<char>(delim));
+    const __m512i quote_v = _mm512_set1_epi8(0x22);
+    const __m512i space_v = _mm512_set1_epi8(0x20);
+    const __m512i del_v = _mm512_set1_epi8(0x7F);
+
+    std::size_t i = 0;
+    for(; i+64 <= len; i+=64) {
+      __m512i v = _mm512_loadu_si512(data+i);
+      __mmask64 mask = _mm512_cmpeq_epi8_mask(v,delim_v)
+        | _mm512_cmpeq_epi8_mask(v,quote_v)
+        | _mm512_cmplt_epi8_mask(v,space_v)
+        | _mm512_cmpeq_epi8_mask(v,del_v);
+
+      if(mask)
+        return i + __builtin_ctzll(mask);
+    }
+
+    return i + find_structural_sse2(data+i,len-i,delim);
+  }
+#endif
+
+  typedef std::size_t (*find_structural_type)(const unsigned char *data,
+    std::size_t len, unsigned char delim);
+
+  /*
+      The widest kernel supported by the running CPU
+   */
+  inline find_structural_type select_find_structural(void)
+  {
+#ifdef LIBDSV_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512bw"))
+      return find_structural_avx512;
+    if(__builtin_cpu_supports("avx2"))
+      return find_structural_avx2;
+    return find_structural_sse2;
+#else
+    return find_structural_scalar;
+#endif
+  }
+
+  /**
+   *  Locate the first byte in the len bytes at data that can end an unescaped
+   *  TEXTDATA run. See is_structural. Returns len if there is no such byte.
+   *
+   *  The widest kernel the CPU supports is selected at runtime. The
+   *  individual kernels are only exposed for testing.
+   */
+  inline std::size_t find_structural(const unsigned char *data,
+    std::size_t len, unsigned char delim)
+  {
+    static const find_structural_type kernel = select_find_structural();
+
+    return kernel(data,len,delim);
+  }
+
+  /**
+   *  Locate the first DQUOTE or LF in the len bytes at data. These are the
+   *  only bytes that can change the record a byte belongs to. Returns len if
+   *  there is no such byte.
+   */
+  inline std::size_t find_boundary(const unsigned char *data, std::size_t len)
+  {
+    std::size_t i = 0;
+
+#ifdef LIBDSV_X86_SIMD
+    const __m128i quote_v = _mm_set1_epi8(0x22);
+    const __m128i lf_v = _mm_set1_epi8(0x0A);
+
+    for(; i+16 <= len; i+=16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data+i));
+      unsigned int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v,quote_v),_mm_cmpeq_epi8(v,lf_v)));
+
+      if(mask)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+
+    while(i < len && data[i] != 0x22 && data[i] != 0x0A)
+      ++i;
+
+    return i;
+  }
+
+  /**
+   *  As find_boundary but also locate the delimiter delim, which is needed
+   *  to count the fields of a record
+   */
+  inline std::size_t find_boundary(const unsigned char *data, std::size_t len,
+    unsigned char delim)
+  {
+    std::size_t i = 0;
+
+#ifdef LIBDSV_X86_SIMD
+    const __m128i quote_v = _mm_set1_epi8(0x22);
+    const __m128i lf_v = _mm_set1_epi8(0x0A);
+    const __m128i delim_v = _mm_set1_epi8(static_cast<char>(delim));
+
+    for(; i+16 <= len; i+=16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data+i));
+      __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v,quote_v),_mm_cmpeq_epi8(v,lf_v)),
+        _mm_cmpeq_epi8(v,delim_v));
+      unsigned int mask = _mm_movemask_epi8(hits);
+
+      if(mask)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+
+    while(i < len && data[i] != 0x22 && data[i] != 0x0A && data[i] != delim)
+      ++i;
+
+    return i;
+  }
+
+}
+
+#endif
@@ -0,0 +1,298 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <map>
+#include <set>
+#include <algorithm>
+
+/** \file
+ *  \brief Tests for passing records on from several worker threads
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    The records passed on by one worker. Boost.Test checks are not safe to
+    make from the workers so the callbacks only record what they see
+ */
+struct worker_context {
+  d::file_context context;
+
+  // stop once this many records have been seen, 0 for never
+  std::size_t limit;
+
+  worker_context(void) :limit(0) {}
+
+  static int header(const unsigned char *fields[], const size_t lengths[],
+    size_t size, void *_context)
+  {
+    worker_context &c = *static_cast<worker_context*>(_context);
+
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<size; ++i)
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+
+    c.context.parsed_headers.push_back(row);
+
+    return 1;
+  }
+
+  static int record(const unsigned char *fields[], const size_t lengths[],
+    size_t size, void *_context)
+  {
+    worker_context &c = *static_cast<worker_context*>(_context);
+
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<size; ++i)
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+
+    c.context.parsed_records.push_back(row);
+
+    return (!c.limit || c.context.parsed_records.size() < c.limit);
+  }
+};
+
+struct dispatched_result {
+  int result;
+  std::vector<worker_context> workers;
+};
+
+inline void parse_dispatched(dispatched_result &parsed,
+  const fs::path &filepath, std::size_t workers, int flags,
+  std::size_t key_column, dsv_parser_t parser, dsv_operations_t operations)
+{
+  parsed.workers.resize(workers);
+
+  std::vector<void *> contexts;
+  for(std::size_t i=0; i<workers; ++i)
+    contexts.push_back(&parsed.workers[i]);
+
+  dsv_set_header_callback(&worker_context::header,0,operations);
+  dsv_set_record_callback(&worker_context::record,0,operations);
+
+  parsed.result = dsv_parse_dispatched(filepath.c_str(),0,workers,flags,
+    key_column,contexts.data(),parser,operations);
+}
+
+/*
+    The workers together must receive the records of a sequential parse,
+    each in order and each with the header
+ */
+inline void check_dispatched(const dispatched_result &parsed,
+  const d::file_context &expected, const std::string &label)
+{
+  std::map<d::field_storage_type,std::size_t> order;
+  for(std::size_t r=0; r<expected.parsed_records.size(); ++r)
+    order[expected.parsed_records[r].at(0)] = r;
+
+  matrix_type all;
+  for(std::size_t w=0; w<parsed.workers.size(); ++w) {
+    const d::file_context &context = parsed.workers[w].context;
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_headers == expected.parsed_headers,
+      label << ": worker " << w << " did not receive the header");
+
+    std::size_t last = 0;
+    for(std::size_t r=0; r<context.parsed_records.size(); ++r) {
+      std::size_t at = order.at(context.parsed_records[r].at(0));
+      BOOST_REQUIRE_MESSAGE(r == 0 || at > last,
+        label << ": worker " << w << " received record " << at
+          << " after record " << last);
+      last = at;
+    }
+
+    all.insert(all.end(),context.parsed_records.begin(),
+      context.parsed_records.end());
+  }
+
+  matrix_type sorted = expected.parsed_records;
+  std::sort(sorted.begin(),sorted.end());
+  std::sort(all.begin(),all.end());
+
+  BOOST_REQUIRE_MESSAGE(all == sorted,
+    label << ": the workers received " << all.size() << " records rather "
+      "than " << sorted.size());
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_dispatched_parse_suite )
+
+/** \test Records given in turn are spread evenly and together match a
+ *  sequential parse
+ */
+BOOST_AUTO_TEST_CASE( dispatched_round_robin )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::keyed_contents(50000,13);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "dispatched_round_robin");
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse(filepath.c_str(),0,parser,operations) == 0);
+
+  const std::size_t workers[] = {1,3,8};
+  for(std::size_t t=0; t<sizeof(workers)/sizeof(std::size_t); ++t) {
+    std::string label = "round robin " + std::to_string(workers[t]);
+
+    dispatched_result parsed;
+    parse_dispatched(parsed,filepath,workers[t],dsv_dispatch_round_robin,0,
+      parser,operations);
+
+    BOOST_REQUIRE_MESSAGE(parsed.result == 0,
+      label << ": parse failed: " << parsed.result);
+
+    check_dispatched(parsed,expected,label);
+
+    std::size_t share = expected.parsed_records.size()/workers[t];
+    for(std::size_t w=0; w<workers[t]; ++w) {
+      std::size_t size = parsed.workers[w].context.parsed_records.size();
+      BOOST_REQUIRE_MESSAGE(size == share || size == share+1,
+        label << ": worker " << w << " received " << size << " records");
+    }
+  }
+
+  fs::remove(filepath);
+}
+
+/** \test Records with equal keys go to the same worker, with the key
+ *  counted after projection
+ */
+BOOST_AUTO_TEST_CASE( dispatched_by_key )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  const char *names[] = {"id","key"};
+  BOOST_REQUIRE(dsv_operations_set_projection_names(operations,names,2) == 0);
+
+  std::string contents = d::keyed_contents(50000,13);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "dispatched_by_key");
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse(filepath.c_str(),0,parser,operations) == 0);
+
+  dispatched_result parsed;
+  parse_dispatched(parsed,filepath,4,dsv_dispatch_by_key,1,parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(parsed.result == 0,
+    "parse failed: " << parsed.result);
+
+  check_dispatched(parsed,expected,"by key");
+
+  std::map<d::field_storage_type,std::size_t> owner;
+  for(std::size_t w=0; w<parsed.workers.size(); ++w) {
+    const matrix_type &records = parsed.workers[w].context.parsed_records;
+    for(std::size_t r=0; r<records.size(); ++r) {
+      std::map<d::field_storage_type,std::size_t>::iterator found =
+        owner.insert(std::make_pair(records[r].at(1),w)).first;
+
+      BOOST_REQUIRE_MESSAGE(found->second == w,
+        "a key went to workers " << found->second << " and " << w);
+    }
+  }
+
+  BOOST_REQUIRE(owner.size() == 13);
+
+  fs::remove(filepath);
+}
+
+/** \test A failed parse passes on the records before the failure and a
+ *  callback that asks to stop ends the parse
+ */
+BOOST_AUTO_TEST_CASE( dispatched_failure )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::keyed_contents(50000,13);
+  std::size_t middle = contents.find("\r\n",contents.size()/2)+2;
+  contents.insert(middle,"bad\"field,k1,x\r\n");
+
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "dispatched_failure");
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  int expected_result = dsv_parse(filepath.c_str(),0,parser,operations);
+  BOOST_REQUIRE(expected_result < 0);
+
+  dispatched_result parsed;
+  parse_dispatched(parsed,filepath,3,dsv_dispatch_round_robin,0,parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(parsed.result == expected_result,
+    "returned " << parsed.result << " rather than " << expected_result);
+
+  check_dispatched(parsed,expected,"failure");
+
+  // the first worker stops early
+  parsed.workers.clear();
+  parsed.workers.resize(3);
+  parsed.workers[0].limit = 100;
+
+  std::vector<void *> contexts;
+  for(std::size_t i=0; i<3; ++i)
+    contexts.push_back(&parsed.workers[i]);
+
+  dsv_set_header_callback(&worker_context::header,0,operations);
+  dsv_set_record_callback(&worker_context::record,0,operations);
+
+  int result = dsv_parse_dispatched(filepath.c_str(),0,3,
+    dsv_dispatch_round_robin,0,contexts.data(),parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,"parse did not stop when asked");
+  BOOST_REQUIRE(parsed.workers[0].context.parsed_records.size() == 100);
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
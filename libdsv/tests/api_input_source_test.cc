@@ -0,0 +1,700 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <algorithm>
+
+/** \file
+ *  \brief Unit tests for the alternate input paths of the parser
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+inline int mmap_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  return dsv_parse_file_mmap(filepath.c_str(),dsv_mmap_default,parser,
+    operations);
+}
+
+inline int mmap_huge_pages_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  return dsv_parse_file_mmap(filepath.c_str(),dsv_mmap_huge_pages,parser,
+    operations);
+}
+
+
+inline int buffer_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  std::ifstream in(filepath.c_str(),std::ios::binary);
+  std::vector<unsigned char> contents((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+
+  return dsv_parse_buffer(filepath.c_str(),contents.data(),contents.size(),
+    parser,operations);
+}
+
+
+/*
+    Supply the contents of filepath to dsv_parser_feed chunk_size bytes at a
+    time
+ */
+inline int feed_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations, std::size_t chunk_size)
+{
+  std::ifstream in(filepath.c_str(),std::ios::binary);
+  std::vector<unsigned char> contents((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+
+  for(std::size_t i=0; i<contents.size(); i+=chunk_size) {
+    std::size_t len = std::min(chunk_size,contents.size()-i);
+    int result = dsv_parser_feed(parser,operations,contents.data()+i,len);
+    if(result != 0)
+      return result;
+  }
+
+  return dsv_parser_finish(parser,operations);
+}
+
+/*
+    Chunk sizes that split the content at every possible position as well as
+    those that split it only occasionally
+ */
+static const std::size_t feed_chunk_sizes[] = {1,2,3,7,4096};
+
+inline void check_feed_compliance(dsv_parser_t parser,
+  const std::vector<std::vector<d::field_storage_type> > &headers,
+  const std::vector<std::vector<d::field_storage_type> > &records,
+  const std::vector<detail::log_msg> &logs,
+  const std::vector<d::field_storage_type> &file_contents,
+  const std::string &label, int expected_result)
+{
+  using namespace std::placeholders;
+
+  for(std::size_t chunk_size : feed_chunk_sizes) {
+    d::check_compliance(parser,headers,records,logs,file_contents,
+      label + "_" + std::to_string(chunk_size),expected_result,
+      std::bind(feed_parse,_1,_2,_3,chunk_size));
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_input_source_suite )
+
+
+/** \test Attempt to map a nonexistent file
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_nonexistent_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  int result = dsv_parse_file_mmap("nonexistant_file.dsv",dsv_mmap_default,
+    parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == ENOENT,
+    "dsv_parse_file_mmap attempted to open a nonexistent file and did not "
+    "return ENOENT");
+}
+
+/** \test Map an empty file. Empty files cannot be mapped and must be handled
+ *  as an empty region
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_empty_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  d::check_compliance(parser,{},{},{},{},"parse_mmap_empty_file",0,
+    mmap_parse);
+}
+
+/** \test Map a file that is not a regular file. The parse must fall back to
+ *  reading the file as a stream
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_non_regular_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parse_file_mmap("/dev/null",dsv_mmap_default,parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse_file_mmap failed to fall back for a non-regular file: "
+    << result);
+  BOOST_REQUIRE_MESSAGE(context.parsed_headers.empty()
+    && context.parsed_records.empty(),
+    "dsv_parse_file_mmap produced content for an empty non-regular file");
+}
+
+/** \test A regular file that reports a size of 0 but has content, as files
+ *  of procfs do, must fall back to reading the file as a stream
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_zero_size_file )
+{
+  const char *path = "/proc/self/mounts";
+  if(!fs::is_regular_file(path) || fs::file_size(path) != 0) {
+    BOOST_TEST_MESSAGE("No zero size file with content, skipping");
+    return;
+  }
+
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse(path,0,parser,operations) == 0);
+  BOOST_REQUIRE(!expected.parsed_headers.empty());
+
+  for(int api=0; api<2; ++api) {
+    d::file_context context;
+    dsv_set_header_callback(d::header_callback,&context,operations);
+    dsv_set_record_callback(d::record_callback,&context,operations);
+
+    int result;
+    if(api == 0)
+      result = dsv_parse_file_mmap(path,dsv_mmap_default,parser,operations);
+    else
+      result = dsv_parse_many(&path,1,1,dsv_many_concurrent,0,0,parser,
+        operations);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "parse of a zero size file failed for api " << api << ": " << result);
+    BOOST_REQUIRE_MESSAGE(context.parsed_headers == expected.parsed_headers
+      && context.parsed_records.size() == expected.parsed_records.size(),
+      "content of a zero size file was not read for api " << api);
+  }
+}
+
+/** \test Map a file containing quoted and unquoted fields over several
+ *  records
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_rfc4180_charset )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {d::rfc4180_charset,d::rfc4180_quoted_charset}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {d::rfc4180_quoted_charset,d::rfc4180_charset},
+    {d::rfc4180_charset,d::empty}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    d::rfc4180_charset,d::comma,d::rfc4180_raw_quoted_charset,d::crlf,
+    d::rfc4180_raw_quoted_charset,d::comma,d::rfc4180_charset,d::crlf,
+    d::rfc4180_charset,d::comma,d::crlf
+  };
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_mmap_rfc4180_charset",0,mmap_parse);
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_mmap_rfc4180_charset_huge_pages",0,mmap_huge_pages_parse);
+}
+
+/** \test Map a file with a syntax error. The location reported must be the
+ *  same as for a stream
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_syntax_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<detail::log_msg> logs{
+    {dsv_syntax_error,dsv_log_error,{"2","2","4","5",""}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a','b','c'},d::crlf,
+    {'d','e','f',0x01},d::crlf
+  };
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a','b','c'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'d','e','f'}}
+  };
+
+  d::check_compliance(parser,headers,records,logs,file_contents,
+    "parse_mmap_syntax_error_stream",-1);
+
+  d::check_compliance(parser,headers,records,logs,file_contents,
+    "parse_mmap_syntax_error",-1,mmap_parse);
+}
+
+
+/** \test Parse a zero length buffer
+ */
+BOOST_AUTO_TEST_CASE( parse_buffer_empty )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parse_buffer(0,0,0,parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse_buffer failed for an empty buffer: " << result);
+  BOOST_REQUIRE_MESSAGE(context.parsed_headers.empty()
+    && context.parsed_records.empty(),
+    "dsv_parse_buffer produced content for an empty buffer");
+}
+
+/** \test Parse a buffer containing quoted and unquoted fields over several
+ *  records
+ */
+BOOST_AUTO_TEST_CASE( parse_buffer_rfc4180_charset )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {d::rfc4180_charset,d::rfc4180_quoted_charset}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {d::rfc4180_quoted_charset,d::rfc4180_charset},
+    {d::rfc4180_charset,d::empty}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    d::rfc4180_charset,d::comma,d::rfc4180_raw_quoted_charset,d::crlf,
+    d::rfc4180_raw_quoted_charset,d::comma,d::rfc4180_charset,d::crlf,
+    d::rfc4180_charset,d::comma,d::crlf
+  };
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_buffer_rfc4180_charset",0,buffer_parse);
+}
+
+/** \test Parse a buffer with a syntax error
+ */
+BOOST_AUTO_TEST_CASE( parse_buffer_syntax_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<detail::log_msg> logs{
+    {dsv_syntax_error,dsv_log_error,{"2","2","4","5",""}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a','b','c'},d::crlf,
+    {'d','e','f',0x01},d::crlf
+  };
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a','b','c'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'d','e','f'}}
+  };
+
+  d::check_compliance(parser,headers,records,logs,file_contents,
+    "parse_buffer_syntax_error",-1,buffer_parse);
+}
+
+/** \test Only the given length of a buffer is parsed. The trailing bytes must
+ *  not be read
+ */
+BOOST_AUTO_TEST_CASE( parse_buffer_partial )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a'},{'b'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'c'},{'d'}}
+  };
+
+  d::file_context context(headers,records);
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  const unsigned char data[] = {
+    'a',',','b',0x0D,0x0A,'c',',','d',0x0D,0x0A,'e',',','f',0x01
+  };
+
+  int result = dsv_parse_buffer("parse_buffer_partial",data,10,parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse_buffer failed for a partial buffer: " << result);
+
+  BOOST_REQUIRE_MESSAGE(context.valid_headers == context.parsed_headers,
+    "Headers did not parse correctly\n"
+    << d::output_fields(context.valid_headers,context.parsed_headers));
+
+  BOOST_REQUIRE_MESSAGE(context.valid_records == context.parsed_records,
+    "Records did not parse correctly\n"
+    << d::output_fields(context.valid_records,context.parsed_records));
+}
+
+
+/** \test Finish a parse that was never fed
+ */
+BOOST_AUTO_TEST_CASE( parse_feed_empty )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parser_finish(parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parser_finish failed for empty content: " << result);
+  BOOST_REQUIRE_MESSAGE(context.parsed_headers.empty()
+    && context.parsed_records.empty(),
+    "dsv_parser_finish produced content for empty content");
+}
+
+/** \test Feed quoted and unquoted fields over several records split at every
+ *  possible location
+ */
+BOOST_AUTO_TEST_CASE( parse_feed_rfc4180_charset )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {d::rfc4180_charset,d::rfc4180_quoted_charset}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {d::rfc4180_quoted_charset,d::rfc4180_charset},
+    {d::rfc4180_charset,d::empty}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    d::rfc4180_charset,d::comma,d::rfc4180_raw_quoted_charset,d::crlf,
+    d::rfc4180_raw_quoted_charset,d::comma,d::rfc4180_charset,d::crlf,
+    d::rfc4180_charset,d::comma,d::crlf
+  };
+
+  check_feed_compliance(parser,headers,records,{},file_contents,
+    "parse_feed_rfc4180_charset",0);
+}
+
+/** \test Feed escaped fields containing binary content, a CRLF, and an
+ *  escaped DQUOTE. Every split of the CRLF and DQUOTE pairs must be handled
+ */
+BOOST_AUTO_TEST_CASE( parse_feed_escaped_binary )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_allow_escaped_binary_fields(parser,1);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a'},{'b',0x0D,0x0A,'c'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'d',0x01,'"','e'},{'f','g'}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a'},d::comma,{'"','b',0x0D,0x0A,'c','"'},d::crlf,
+    {'"','d',0x01,'"','"','e','"'},d::comma,{'f','g'},d::crlf
+  };
+
+  check_feed_compliance(parser,headers,records,{},file_contents,
+    "parse_feed_escaped_binary",0);
+}
+
+/** \test Feed content with a syntax error. The location reported must be the
+ *  same as for a stream regardless of how the content is split
+ */
+BOOST_AUTO_TEST_CASE( parse_feed_syntax_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<detail::log_msg> logs{
+    {dsv_syntax_error,dsv_log_error,{"2","2","4","5",""}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a','b','c'},d::crlf,
+    {'d','e','f',0x01},d::crlf
+  };
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a','b','c'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'d','e','f'}}
+  };
+
+  check_feed_compliance(parser,headers,records,logs,file_contents,
+    "parse_feed_syntax_error",-1);
+}
+
+/** \test A failed feed abandons the parse. The next feed starts over
+ */
+BOOST_AUTO_TEST_CASE( parse_feed_restart )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  const unsigned char bad[] = {'a',0x01,0x0D,0x0A};
+
+  int result = dsv_parser_feed(parser,operations,bad,sizeof(bad));
+  BOOST_REQUIRE_MESSAGE(result == -1,
+    "dsv_parser_feed did not fail for invalid content: " << result);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a'},{'b'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'c'},{'d'}}
+  };
+
+  d::file_context context(headers,records);
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  const unsigned char good[] = {'a',',','b',0x0D,0x0A,'c',',','d',0x0D,0x0A};
+
+  result = dsv_parser_feed(parser,operations,good,sizeof(good));
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parser_feed failed after an abandoned parse: " << result);
+
+  result = dsv_parser_finish(parser,operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parser_finish failed after an abandoned parse: " << result);
+
+  BOOST_REQUIRE_MESSAGE(context.valid_headers == context.parsed_headers,
+    "Headers did not parse correctly\n"
+    << d::output_fields(context.valid_headers,context.parsed_headers));
+
+  BOOST_REQUIRE_MESSAGE(context.valid_records == context.parsed_records,
+    "Records did not parse correctly\n"
+    << d::output_fields(context.valid_records,context.parsed_records));
+}
+
+/*
+    Record for each field whether it points into the region
+ */
+struct region_context {
+  const unsigned char *begin;
+  const unsigned char *end;
+
+  std::vector<std::vector<d::field_storage_type> > fields;
+  std::vector<std::vector<bool> > in_region;
+
+  region_context(const unsigned char *data, std::size_t len) :begin(data),
+    end(data+len) {}
+};
+
+static int region_callback(const unsigned char *fields[],
+  const size_t lengths[], size_t size, void *_context)
+{
+  region_context &context = *static_cast<region_context*>(_context);
+
+  std::vector<d::field_storage_type> row;
+  std::vector<bool> in_region;
+  for(std::size_t i=0; i<size; ++i) {
+    row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+    in_region.push_back(fields[i] >= context.begin
+      && fields[i]+lengths[i] <= context.end);
+  }
+
+  context.fields.push_back(row);
+  context.in_region.push_back(in_region);
+
+  return 1;
+}
+
+/** \test With zero copy fields enabled, fields that exist verbatim in the
+ *  buffer point into it. Fields that must be assembled do not.
+ */
+BOOST_AUTO_TEST_CASE( parse_buffer_zero_copy_fields )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  // a,"b,c"\r\n"d""e","f\r\ng",h\r\n
+  const unsigned char data[] = {
+    'a',',','"','b',',','c','"',0x0D,0x0A,
+    '"','d','"','"','e','"',',','"','f',0x0D,0x0A,'g','"',',','h',0x0D,0x0A
+  };
+
+  std::vector<std::vector<d::field_storage_type> > fields{
+    {{'a'},{'b',',','c'}},
+    {{'d','"','e'},{'f',0x0D,0x0A,'g'},{'h'}}
+  };
+
+  for(int zero_copy=0; zero_copy<2; ++zero_copy) {
+    region_context context(data,sizeof(data));
+    dsv_set_header_callback(region_callback,&context,operations);
+    dsv_set_record_callback(region_callback,&context,operations);
+
+    dsv_parser_allow_zero_copy_fields(parser,zero_copy);
+    dsv_parser_set_field_columns(parser,-1);
+
+    int result = dsv_parse_buffer("parse_buffer_zero_copy_fields",data,
+      sizeof(data),parser,operations);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "dsv_parse_buffer failed with zero copy fields " << zero_copy << ": "
+        << result);
+
+    BOOST_REQUIRE_MESSAGE(context.fields == fields,
+      "Fields did not parse correctly with zero copy fields " << zero_copy
+      << "\n" << d::output_fields(fields,context.fields));
+
+    std::vector<std::vector<bool> > in_region{
+      {zero_copy != 0,zero_copy != 0},
+      {false,zero_copy != 0,zero_copy != 0}
+    };
+
+    BOOST_REQUIRE_MESSAGE(context.in_region == in_region,
+      "Fields did not point into the buffer as expected with zero copy "
+      "fields " << zero_copy);
+  }
+}
+
+/** \test Parse a mapped file with zero copy fields
+ */
+BOOST_AUTO_TEST_CASE( parse_mmap_zero_copy_fields )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_allow_zero_copy_fields(parser,1);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {d::rfc4180_charset,d::rfc4180_quoted_charset}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {d::rfc4180_quoted_charset,d::rfc4180_charset},
+    {d::rfc4180_charset,d::empty}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    d::rfc4180_charset,d::comma,d::rfc4180_raw_quoted_charset,d::crlf,
+    d::rfc4180_raw_quoted_charset,d::comma,d::rfc4180_charset,d::crlf,
+    d::rfc4180_charset,d::comma,d::crlf
+  };
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_mmap_zero_copy_fields",0,mmap_parse);
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_buffer_zero_copy_fields",0,buffer_parse);
+
+  // other inputs are copied
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "parse_stream_zero_copy_fields",0);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -18,6 +18,18 @@ namespace test {
 
 
 
+static int record_batch_callback(const unsigned char *[], const size_t [],
+  const size_t [], size_t, void *)
+{
+  return 1;
+}
+
+static int column_batch_callback(const dsv_column_t [], size_t, size_t,
+  void *)
+{
+  return 1;
+}
+
 BOOST_AUTO_TEST_SUITE( api_operations_object_suite )
 
 /** \test Create operations object
@@ -135,6 +147,66 @@ BOOST_AUTO_TEST_CASE( record_getting_and_setting )
 }
 
 
+/** \test Getting and setting of operations batch members
+ */
+BOOST_AUTO_TEST_CASE( record_batch_getting_and_setting )
+{
+  dsv_operations_t operations = {};
+
+  int err = dsv_operations_create(&operations);
+  BOOST_REQUIRE_MESSAGE(err == 0,"dsv_operations_create succeeds");
+
+  record_batch_callback_t fn = dsv_get_record_batch_callback(operations);
+  BOOST_REQUIRE_MESSAGE(fn == 0,
+    "dsv_get_record_batch_callback returns nonzero for an unset callback");
+
+  void *context = dsv_get_record_batch_context(operations);
+  BOOST_REQUIRE_MESSAGE(context == 0,
+    "dsv_get_record_batch_context returns nonzero for an unset context");
+
+  BOOST_REQUIRE_MESSAGE(dsv_get_record_batch_size(operations) == 1024,
+    "dsv_get_record_batch_size does not return the default");
+
+  BOOST_REQUIRE_MESSAGE(dsv_get_record_batch_bytes(operations) == 1024*1024,
+    "dsv_get_record_batch_bytes does not return the default");
+
+  int fcontext;
+  dsv_set_record_batch_callback(record_batch_callback,&fcontext,operations);
+
+  fn = dsv_get_record_batch_callback(operations);
+  BOOST_REQUIRE_MESSAGE(fn == record_batch_callback,
+    "dsv_get_record_batch_callback does not return the just-set callback");
+
+  context = dsv_get_record_batch_context(operations);
+  BOOST_REQUIRE_MESSAGE(context == &fcontext,
+    "dsv_get_record_batch_context does not return the just-set context");
+
+  dsv_set_record_batch_size(7,operations);
+  BOOST_REQUIRE_MESSAGE(dsv_get_record_batch_size(operations) == 7,
+    "dsv_get_record_batch_size does not return the just-set size");
+
+  dsv_set_record_batch_bytes(0,operations);
+  BOOST_REQUIRE_MESSAGE(dsv_get_record_batch_bytes(operations) == 0,
+    "dsv_get_record_batch_bytes does not return the just-set budget");
+
+  BOOST_REQUIRE_MESSAGE(dsv_get_column_batch_callback(operations) == 0,
+    "dsv_get_column_batch_callback returns nonzero for an unset callback");
+
+  BOOST_REQUIRE_MESSAGE(dsv_get_column_batch_context(operations) == 0,
+    "dsv_get_column_batch_context returns nonzero for an unset context");
+
+  dsv_set_column_batch_callback(column_batch_callback,&fcontext,operations);
+
+  BOOST_REQUIRE_MESSAGE(
+    dsv_get_column_batch_callback(operations) == column_batch_callback,
+    "dsv_get_column_batch_callback does not return the just-set callback");
+
+  BOOST_REQUIRE_MESSAGE(dsv_get_column_batch_context(operations) == &fcontext,
+    "dsv_get_column_batch_context does not return the just-set context");
+
+  dsv_operations_destroy(operations);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -0,0 +1,289 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <thread>
+
+/** \file
+ *  \brief Tests for parsing a file with several threads
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    Records with escaped fields long enough that many blocks of the content
+    start inside one. The fields hold newlines, delimiters and D2QUOTE and
+    one is longer than several blocks.
+ */
+inline std::string multiline_contents(const std::string &newline)
+{
+  std::string contents = "id,text" + newline;
+  for(std::size_t i=0; contents.size() < 3*1024*1024; ++i) {
+    std::string id = std::to_string(i);
+
+    std::size_t repeat = (i == 5 ? 40000 : 1 + (i*997) % 6000);
+    if(i % 3 == 2)
+      contents += id + ",short" + newline;
+    else {
+      contents += id + ",\"";
+      for(std::size_t j=0; j<repeat; ++j)
+        contents += "say \"\"" + id + "\"\"," + newline;
+      contents += "\"" + newline;
+    }
+  }
+
+  return contents;
+}
+
+/*
+    Parse filepath sequentially or with threads threads
+ */
+inline void parse(d::parse_result &parsed, const fs::path &filepath,
+  dsv_parser_t parser, dsv_operations_t operations, std::size_t threads,
+  int flags)
+{
+  d::capture_parse(parsed,parser,operations);
+
+  if(!threads)
+    parsed.result = dsv_parse(filepath.c_str(),0,parser,operations);
+  else {
+    parsed.result = dsv_parse_file_parallel(filepath.c_str(),threads,flags,
+      parser,operations);
+  }
+}
+
+/*
+    Parsing with threads must match a sequential parse
+ */
+inline void check_parallel(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations, const std::string &label)
+{
+  d::parse_result expected;
+  parse(expected,filepath,parser,operations,0,0);
+
+  const std::size_t threads[] = {1,3,8};
+  for(std::size_t t=0; t<sizeof(threads)/sizeof(std::size_t); ++t) {
+    d::parse_result ordered;
+    parse(ordered,filepath,parser,operations,threads[t],dsv_parallel_ordered);
+
+    d::check_same_parse(expected,ordered,
+      label + " with " + std::to_string(threads[t]) + " threads");
+
+    if(expected.result != 0)
+      continue;
+
+    d::parse_result unordered;
+    parse(unordered,filepath,parser,operations,threads[t],
+      dsv_parallel_unordered);
+
+    BOOST_REQUIRE_MESSAGE(unordered.result == 0,
+      label << ": unordered with " << threads[t] << " threads failed: "
+        << unordered.result);
+
+    // with a maximum, which records are passed on depends on the order
+    if(dsv_parser_get_max_records(parser)) {
+      BOOST_REQUIRE_MESSAGE(unordered.context.parsed_records.size()
+        == expected.context.parsed_records.size(),
+        label << ": unordered record count differs with " << threads[t]
+          << " threads");
+      continue;
+    }
+
+    matrix_type sorted = unordered.context.parsed_records;
+    matrix_type expected_sorted = expected.context.parsed_records;
+    std::sort(sorted.begin(),sorted.end());
+    std::sort(expected_sorted.begin(),expected_sorted.end());
+
+    BOOST_REQUIRE_MESSAGE(sorted == expected_sorted,
+      label << ": unordered records differ with " << threads[t]
+        << " threads");
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_parallel_parse_suite )
+
+/** \test The same records and warnings as a sequential parse
+ */
+BOOST_AUTO_TEST_CASE( parallel_matches_sequential )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(3*1024*1024);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "parallel_matches_sequential");
+
+  check_parallel(filepath,parser,operations,"parallel");
+
+  // projection by name and predicates are settled by the header
+  const char *names[] = {"value","id"};
+  BOOST_REQUIRE(dsv_operations_set_projection_names(operations,names,2) == 0);
+  const unsigned char prefix[] = {'1'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,0,prefix,1)
+    == 0);
+
+  check_parallel(filepath,parser,operations,"parallel_filtered");
+
+  dsv_operations_clear_predicates(operations);
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,0,0) == 0);
+
+  // a range of the records in order
+  dsv_parser_set_skip_records(parser,1000);
+  dsv_parser_set_max_records(parser,50000);
+
+  check_parallel(filepath,parser,operations,"parallel_range");
+
+  fs::remove(filepath);
+}
+
+/** \test Parts are divided correctly when they would start inside
+ *  escaped fields
+ */
+BOOST_AUTO_TEST_CASE( parallel_multiline_fields )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  const char *newlines[] = {"\r\n","\n"};
+  for(std::size_t n=0; n<2; ++n) {
+    std::string contents = multiline_contents(newlines[n]);
+    fs::path filepath = d::gen_testfile(
+      {d::field_storage_type(contents.begin(),contents.end())},
+      "parallel_multiline_fields");
+
+    check_parallel(filepath,parser,operations,
+      "parallel_multiline " + std::to_string(n));
+
+    fs::remove(filepath);
+  }
+}
+
+/** \test A failure deep in the file is reported as by a sequential parse
+ *  and the records before it are passed on
+ */
+BOOST_AUTO_TEST_CASE( parallel_failure )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(3*1024*1024);
+  std::size_t middle = contents.find("\r\n",contents.size()/2)+2;
+  contents.insert(middle,"bad\"field\r\n");
+
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "parallel_failure");
+
+  check_parallel(filepath,parser,operations,"parallel_failure");
+
+  fs::remove(filepath);
+}
+
+/** \test Batches are passed on from the calling thread
+ */
+BOOST_AUTO_TEST_CASE( parallel_batches )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(3*1024*1024);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "parallel_batches");
+
+  d::parse_result expected;
+  parse(expected,filepath,parser,operations,0,0);
+  BOOST_REQUIRE(expected.result == 0);
+
+  struct batches {
+    std::thread::id caller;
+    matrix_type parsed;
+
+    static int callback(const unsigned char *fields[], const size_t lengths[],
+      const size_t offsets[], size_t size, void *_context)
+    {
+      batches &context = *static_cast<batches*>(_context);
+
+      if(std::this_thread::get_id() != context.caller)
+        return 0;
+
+      for(std::size_t r=0; r<size; ++r) {
+        std::vector<d::field_storage_type> row;
+        for(std::size_t i=offsets[r]; i<offsets[r+1]; ++i)
+          row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+        context.parsed.push_back(row);
+      }
+
+      return 1;
+    }
+  };
+
+  batches context;
+  context.caller = std::this_thread::get_id();
+  dsv_set_header_callback(0,0,operations);
+  dsv_set_record_batch_callback(&batches::callback,&context,operations);
+  dsv_set_logger_callback(0,0,dsv_log_none,parser);
+
+  int result = dsv_parse_file_parallel(filepath.c_str(),4,
+    dsv_parallel_ordered,parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse_file_parallel failed: " << result);
+  BOOST_REQUIRE_MESSAGE(context.parsed == expected.context.parsed_records,
+    "Batched records differ");
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,378 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <cerrno>
+
+/** \file
+ *  \brief Tests for parsing many files with several threads
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    The files have differing newlines, column counts and sizes. One is
+    malformed and one is missing
+ */
+static const std::size_t many_files = 48;
+static const std::size_t malformed_file = 17;
+static const std::size_t missing_file = 31;
+
+inline std::string many_contents(std::size_t i)
+{
+  std::string newline = (i % 2 ? "\n" : "\r\n");
+  std::size_t columns = 1 + i % 4;
+
+  std::string contents;
+  for(std::size_t c=0; c<columns; ++c)
+    contents += (c ? "," : "") + std::string("col") + std::to_string(c);
+  contents += newline;
+
+  std::size_t records = (i % 5 == 0 ? 2000 : 1 + (i*37) % 50);
+  for(std::size_t r=0; r<records; ++r) {
+    std::string id = std::to_string(i) + "." + std::to_string(r);
+
+    for(std::size_t c=0; c<columns; ++c) {
+      if(c)
+        contents += ",";
+
+      if((r+c) % 6 == 1)
+        contents += "\"say \"\"" + id + "\"\", more\"";
+      else
+        contents += id + "-" + std::to_string(c);
+    }
+
+    if(i == malformed_file && r == 20)
+      contents += ",extra";
+
+    contents += newline;
+  }
+
+  return contents;
+}
+
+struct many_fixture {
+  std::vector<fs::path> paths;
+  std::vector<const char *> names;
+
+  many_fixture(void) {
+    for(std::size_t i=0; i<many_files; ++i) {
+      std::string label = "parse_many_" + std::to_string(i);
+
+      if(i == missing_file)
+        paths.push_back(fs::temp_directory_path()/(label + "_missing.dsv"));
+      else {
+        std::string contents = many_contents(i);
+        paths.push_back(d::gen_testfile({d::field_storage_type(
+          contents.begin(),contents.end())},label));
+      }
+    }
+
+    for(std::size_t i=0; i<paths.size(); ++i)
+      names.push_back(paths[i].c_str());
+  }
+
+  ~many_fixture(void) {
+    for(std::size_t i=0; i<paths.size(); ++i)
+      fs::remove(paths[i]);
+  }
+};
+
+/*
+    Callbacks that can be called from several threads. Boost.Test checks
+    are not safe to make from them so anything found is recorded and
+    checked once the parse returns
+ */
+struct many_context {
+  d::file_context context;
+
+  // ordered, the files in the order their records were passed on
+  std::vector<std::size_t> *order;
+  std::size_t index;
+
+  std::thread::id thread;
+  bool other_thread;
+
+  many_context(void) :order(0), index(0), other_thread(false) {}
+
+  void called(void) {
+    if(std::this_thread::get_id() != thread)
+      other_thread = true;
+
+    if(order && (order->empty() || order->back() != index))
+      order->push_back(index);
+  }
+
+  static int header(const unsigned char *fields[], const size_t lengths[],
+    size_t size, void *_context)
+  {
+    many_context &c = *static_cast<many_context*>(_context);
+    c.called();
+
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<size; ++i)
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+
+    c.context.parsed_headers.push_back(row);
+
+    return 1;
+  }
+
+  static int record(const unsigned char *fields[], const size_t lengths[],
+    size_t size, void *_context)
+  {
+    many_context &c = *static_cast<many_context*>(_context);
+    c.called();
+
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<size; ++i)
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+
+    c.context.parsed_records.push_back(row);
+
+    return 1;
+  }
+};
+
+struct expected_parse {
+  std::vector<int> results;
+  std::vector<d::file_context> contexts;
+  d::logging_context log_context;
+};
+
+/*
+    Parse each file on its own
+ */
+inline void parse_each(expected_parse &expected, const many_fixture &files,
+  dsv_parser_t parser, dsv_operations_t operations)
+{
+  expected.contexts.resize(files.paths.size());
+
+  dsv_set_logger_callback(d::logger,&expected.log_context,dsv_log_all,parser);
+
+  for(std::size_t i=0; i<files.paths.size(); ++i) {
+    dsv_set_header_callback(d::header_callback,&expected.contexts[i],
+      operations);
+    dsv_set_record_callback(d::record_callback,&expected.contexts[i],
+      operations);
+
+    expected.results.push_back(dsv_parse_file_mmap(files.names[i],
+      dsv_mmap_default,parser,operations));
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_parse_many_suite )
+
+/** \test Files parsed concurrently into their own contexts match parsing
+ *  each file on its own
+ */
+BOOST_AUTO_TEST_CASE( parse_many_concurrent )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  many_fixture files;
+
+  expected_parse expected;
+  parse_each(expected,files,parser,operations);
+
+  BOOST_REQUIRE(expected.results[malformed_file] < 0);
+  BOOST_REQUIRE(expected.results[missing_file] == ENOENT);
+
+  // the logger may be called concurrently
+  dsv_set_logger_callback(0,0,dsv_log_all,parser);
+
+  const std::size_t threads[] = {1,4,0};
+  for(std::size_t t=0; t<sizeof(threads)/sizeof(std::size_t); ++t) {
+    std::vector<many_context> contexts(files.paths.size());
+    std::vector<void *> context_ptrs;
+    for(std::size_t i=0; i<contexts.size(); ++i)
+      context_ptrs.push_back(&contexts[i]);
+
+    dsv_set_header_callback(&many_context::header,0,operations);
+    dsv_set_record_callback(&many_context::record,0,operations);
+
+    std::vector<int> results(files.paths.size(),1);
+    int result = dsv_parse_many(files.names.data(),files.names.size(),
+      threads[t],dsv_many_concurrent,context_ptrs.data(),results.data(),
+      parser,operations);
+
+    BOOST_REQUIRE_MESSAGE(result == expected.results[malformed_file],
+      threads[t] << " threads returned " << result << " rather than the "
+        "result of the first failing file");
+
+    for(std::size_t i=0; i<files.paths.size(); ++i) {
+      BOOST_REQUIRE_MESSAGE(results[i] == expected.results[i],
+        "file " << i << " returned " << results[i] << " rather than "
+          << expected.results[i] << " with " << threads[t] << " threads");
+
+      BOOST_REQUIRE_MESSAGE(contexts[i].context.parsed_headers
+        == expected.contexts[i].parsed_headers,
+        "header of file " << i << " differs with " << threads[t]
+          << " threads");
+
+      BOOST_REQUIRE_MESSAGE(contexts[i].context.parsed_records
+        == expected.contexts[i].parsed_records,
+        "records of file " << i << " differ with " << threads[t]
+          << " threads\n" << d::output_fields(expected.contexts[i].parsed_records,
+            contexts[i].context.parsed_records));
+    }
+  }
+}
+
+/** \test Ordered, files are passed on one at a time in the order given from
+ *  the calling thread with their log messages
+ */
+BOOST_AUTO_TEST_CASE( parse_many_ordered )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  many_fixture files;
+
+  expected_parse expected;
+  parse_each(expected,files,parser,operations);
+
+  std::vector<std::size_t> expected_order;
+  for(std::size_t i=0; i<files.paths.size(); ++i) {
+    if(!expected.contexts[i].parsed_headers.empty())
+      expected_order.push_back(i);
+  }
+
+  const std::size_t threads[] = {1,3,8};
+  for(std::size_t t=0; t<sizeof(threads)/sizeof(std::size_t); ++t) {
+    d::logging_context log_context;
+    dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+    std::vector<std::size_t> order;
+    std::vector<many_context> contexts(files.paths.size());
+    std::vector<void *> context_ptrs;
+    for(std::size_t i=0; i<contexts.size(); ++i) {
+      contexts[i].order = &order;
+      contexts[i].index = i;
+      contexts[i].thread = std::this_thread::get_id();
+      context_ptrs.push_back(&contexts[i]);
+    }
+
+    dsv_set_header_callback(&many_context::header,0,operations);
+    dsv_set_record_callback(&many_context::record,0,operations);
+
+    std::vector<int> results(files.paths.size(),1);
+    int result = dsv_parse_many(files.names.data(),files.names.size(),
+      threads[t],dsv_many_ordered,context_ptrs.data(),results.data(),parser,
+      operations);
+
+    BOOST_REQUIRE_MESSAGE(result == expected.results[malformed_file],
+      threads[t] << " threads returned " << result << " rather than the "
+        "result of the first failing file");
+
+    BOOST_REQUIRE_MESSAGE(order == expected_order,
+      "files not passed on in order with " << threads[t] << " threads");
+
+    for(std::size_t i=0; i<files.paths.size(); ++i) {
+      BOOST_REQUIRE_MESSAGE(results[i] == expected.results[i],
+        "file " << i << " returned " << results[i] << " rather than "
+          << expected.results[i] << " with " << threads[t] << " threads");
+
+      BOOST_REQUIRE_MESSAGE(!contexts[i].other_thread,
+        "callbacks of file " << i << " called from another thread");
+
+      BOOST_REQUIRE_MESSAGE(contexts[i].context.parsed_headers
+        == expected.contexts[i].parsed_headers,
+        "header of file " << i << " differs with " << threads[t]
+          << " threads");
+
+      BOOST_REQUIRE_MESSAGE(contexts[i].context.parsed_records
+        == expected.contexts[i].parsed_records,
+        "records of file " << i << " differ with " << threads[t]
+          << " threads");
+    }
+
+    BOOST_REQUIRE_MESSAGE(
+      d::check_logs(expected.log_context.recd_logs,log_context.recd_logs),
+      "logs differ with " << threads[t] << " threads:\n"
+        << d::compare_logs(expected.log_context.recd_logs,
+          log_context.recd_logs));
+  }
+}
+
+/** \test Without contexts for the files, the contexts of the operations are
+ *  used and the maximum number of records applies to each file
+ */
+BOOST_AUTO_TEST_CASE( parse_many_shared_context )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_max_records(parser,5);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  many_fixture files;
+
+  expected_parse expected;
+  parse_each(expected,files,parser,operations);
+
+  matrix_type records;
+  for(std::size_t i=0; i<expected.contexts.size(); ++i) {
+    BOOST_REQUIRE(expected.contexts[i].parsed_records.size() <= 5);
+    records.insert(records.end(),expected.contexts[i].parsed_records.begin(),
+      expected.contexts[i].parsed_records.end());
+  }
+
+  int first_failure = 0;
+  for(std::size_t i=0; i<expected.results.size() && !first_failure; ++i)
+    first_failure = expected.results[i];
+
+  d::file_context context;
+  dsv_set_header_callback(0,0,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parse_many(files.names.data(),files.names.size(),4,
+    dsv_many_ordered,0,0,parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == first_failure,
+    "dsv_parse_many returned " << result << " rather than the result of the "
+      "first failing file");
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+    "records differ\n" << d::output_fields(records,context.parsed_records));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
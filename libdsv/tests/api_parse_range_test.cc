@@ -0,0 +1,374 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+/** \file
+ *  \brief Tests for indexing records and parsing a range of them
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    A header with an escaped newline and the mixed records of every test of a
+    divided parse without empty or short records. The last record is not
+    terminated
+ */
+inline std::string range_contents(void)
+{
+  std::string contents = "id,\"te\r\nxt\",value\r\n";
+  for(std::size_t i=0; i<2000; ++i)
+    d::append_mixed_record(contents,i,"\r\n",false);
+
+  contents += "last,record,here";
+
+  return contents;
+}
+
+inline void parse_range(d::parse_result &parsed, const fs::path &filepath,
+  const char *index_path, std::size_t first, std::size_t count,
+  dsv_parser_t parser, dsv_operations_t operations)
+{
+  d::capture_parse(parsed,parser,operations);
+
+  parsed.result = dsv_parse_range(filepath.c_str(),index_path,first,count,
+    parser,operations);
+}
+
+inline void parse_whole(d::parse_result &parsed, const fs::path &filepath,
+  dsv_parser_t parser, dsv_operations_t operations)
+{
+  d::capture_parse(parsed,parser,operations);
+
+  parsed.result = dsv_parse(filepath.c_str(),0,parser,operations);
+}
+
+/*
+    Records [first,first+count) of a whole parse
+ */
+inline matrix_type slice(const matrix_type &records, std::size_t first,
+  std::size_t count)
+{
+  first = std::min(first,records.size());
+  count = std::min(count,records.size()-first);
+
+  return matrix_type(records.begin()+first,records.begin()+first+count);
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_parse_range_suite )
+
+/** \test Ranges with and without an index match the records of a whole
+ *  parse
+ */
+BOOST_AUTO_TEST_CASE( range_matches_whole_parse )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = range_contents();
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "range_matches_whole_parse");
+  fs::path index_path = filepath.string() + ".idx";
+
+  d::parse_result whole;
+  parse_whole(whole,filepath,parser,operations);
+  BOOST_REQUIRE(whole.result == 0);
+
+  const matrix_type &records = whole.context.parsed_records;
+  BOOST_REQUIRE_EQUAL(records.size(),2001);
+
+  const std::size_t strides[] = {1,7,64,5000};
+  for(std::size_t s=0; s<sizeof(strides)/sizeof(std::size_t); ++s) {
+    int err = dsv_index_build(filepath.c_str(),index_path.c_str(),strides[s],
+      parser);
+    BOOST_REQUIRE_MESSAGE(err == 0,"dsv_index_build failed: " << err);
+
+    std::size_t indexed = 0;
+    BOOST_REQUIRE(dsv_index_records(index_path.c_str(),&indexed) == 0);
+    BOOST_REQUIRE_EQUAL(indexed,records.size());
+
+    const std::size_t ranges[][2] = {
+      {0,10},{6,1},{7,7},{63,66},{999,500},{1995,10},{2000,1},{2001,5},
+      {5000,5},{12,0},{0,5000}
+    };
+
+    for(std::size_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r) {
+      std::size_t first = ranges[r][0];
+      std::size_t count = ranges[r][1];
+
+      for(int use_index=0; use_index<2; ++use_index) {
+        d::parse_result range;
+        parse_range(range,filepath,(use_index ? index_path.c_str() : 0),
+          first,count,parser,operations);
+
+        BOOST_REQUIRE_MESSAGE(range.result == 0,
+          "dsv_parse_range failed for " << first << "," << count << ": "
+            << range.result);
+
+        BOOST_REQUIRE_MESSAGE(
+          range.context.parsed_headers == whole.context.parsed_headers,
+          "Header differs for " << first << "," << count);
+
+        matrix_type expected = slice(records,first,count);
+        BOOST_REQUIRE_MESSAGE(range.context.parsed_records == expected,
+          "Records differ for " << first << "," << count << " with stride "
+            << strides[s] << (use_index ? " and" : " without") << " an index ("
+            << range.context.parsed_records.size() << " rather than "
+            << expected.size() << ")");
+      }
+    }
+  }
+
+  fs::remove(index_path);
+  fs::remove(filepath);
+}
+
+/** \test Log messages give the lines of the file
+ */
+BOOST_AUTO_TEST_CASE( range_log_lines )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  // record 150 has a field too many
+  std::string contents = "a,b\r\n";
+  for(std::size_t i=0; i<200; ++i) {
+    std::string id = std::to_string(i);
+    if(i == 150)
+      contents += id + ",x,y\r\n";
+    else
+      contents += id + ",\"two\r\nlines\"\r\n";
+  }
+
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "range_log_lines");
+  fs::path index_path = filepath.string() + ".idx";
+
+  BOOST_REQUIRE(dsv_index_build(filepath.c_str(),index_path.c_str(),16,
+    parser) == 0);
+
+  d::parse_result whole;
+  parse_whole(whole,filepath,parser,operations);
+  BOOST_REQUIRE(whole.result < 0);
+  BOOST_REQUIRE(!whole.log_context.recd_logs.empty());
+
+  d::parse_result range;
+  parse_range(range,filepath,index_path.c_str(),140,20,parser,operations);
+  BOOST_REQUIRE_MESSAGE(range.result < 0,
+    "The range did not fail: " << range.result);
+
+  BOOST_REQUIRE_MESSAGE(
+    d::check_logs(whole.log_context.recd_logs,range.log_context.recd_logs),
+    "Did not receive the correct log messages:\n"
+      << d::compare_logs(whole.log_context.recd_logs,
+        range.log_context.recd_logs));
+
+  BOOST_REQUIRE(range.context.parsed_records
+    == slice(whole.context.parsed_records,140,10));
+
+  // before the bad record
+  d::parse_result before;
+  parse_range(before,filepath,index_path.c_str(),100,50,parser,operations);
+  BOOST_REQUIRE(before.result == 0);
+  BOOST_REQUIRE(before.log_context.recd_logs.empty());
+
+  fs::remove(index_path);
+  fs::remove(filepath);
+}
+
+/** \test An index that is out of date, built with other settings or not an
+ *  index at all is refused
+ */
+BOOST_AUTO_TEST_CASE( range_bad_index )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = "a,b\r\n1,2\r\n3,4\r\n";
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "range_bad_index");
+  fs::path index_path = filepath.string() + ".idx";
+
+  BOOST_REQUIRE(dsv_index_build(filepath.c_str(),index_path.c_str(),1,
+    parser) == 0);
+
+  d::parse_result range;
+  parse_range(range,filepath,index_path.c_str(),1,1,parser,operations);
+  BOOST_REQUIRE(range.result == 0);
+  BOOST_REQUIRE(range.context.parsed_records
+    == matrix_type({{{'3'},{'4'}}}));
+
+  dsv_parser_t other;
+  assert(dsv_parser_create(&other) == 0);
+  std::shared_ptr<dsv_parser_t> other_sentry(&other,detail::parser_destroy);
+  dsv_parser_set_field_delimiter(other,';');
+
+  BOOST_REQUIRE(dsv_parse_range(filepath.c_str(),index_path.c_str(),1,1,
+    other,operations) == EINVAL);
+
+  // the file is not an index
+  BOOST_REQUIRE(dsv_parse_range(filepath.c_str(),filepath.c_str(),1,1,
+    parser,operations) == EINVAL);
+
+  std::size_t records = 0;
+  BOOST_REQUIRE(dsv_index_records(filepath.c_str(),&records) == EINVAL);
+
+  // the file changed
+  {
+    std::ofstream out(filepath.c_str(),std::ios::binary|std::ios::app);
+    out << "5,6\r\n";
+  }
+
+  BOOST_REQUIRE(dsv_parse_range(filepath.c_str(),index_path.c_str(),1,1,
+    parser,operations) == ESTALE);
+
+  // rewritten with the same size within the same second
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = 1000000000;
+  times[0].tv_nsec = times[1].tv_nsec = 1000;
+  BOOST_REQUIRE(utimensat(AT_FDCWD,filepath.c_str(),times,0) == 0);
+  BOOST_REQUIRE(dsv_index_build(filepath.c_str(),index_path.c_str(),1,
+    parser) == 0);
+
+  {
+    std::ofstream out(filepath.c_str(),std::ios::binary|std::ios::trunc);
+    out << "a,b\r\n7,8\r\n9,0\r\n5,6\r\n";
+  }
+
+  times[0].tv_nsec = times[1].tv_nsec = 2000;
+  BOOST_REQUIRE(utimensat(AT_FDCWD,filepath.c_str(),times,0) == 0);
+
+  BOOST_REQUIRE(dsv_parse_range(filepath.c_str(),index_path.c_str(),1,1,
+    parser,operations) == ESTALE);
+
+  // replaced by another file with the same size and time
+  times[0].tv_nsec = times[1].tv_nsec = 1000;
+  BOOST_REQUIRE(utimensat(AT_FDCWD,filepath.c_str(),times,0) == 0);
+  BOOST_REQUIRE(dsv_index_build(filepath.c_str(),index_path.c_str(),1,
+    parser) == 0);
+
+  fs::path other_path = filepath.string() + ".new";
+  {
+    std::ofstream out(other_path.c_str(),std::ios::binary);
+    out << "a,b\r\n1,2\r\n3,4\r\n5,6\r\n";
+  }
+  BOOST_REQUIRE(utimensat(AT_FDCWD,other_path.c_str(),times,0) == 0);
+  BOOST_REQUIRE(std::rename(other_path.c_str(),filepath.c_str()) == 0);
+
+  BOOST_REQUIRE(dsv_parse_range(filepath.c_str(),index_path.c_str(),1,1,
+    parser,operations) == ESTALE);
+
+  fs::remove(index_path);
+  fs::remove(filepath);
+}
+
+/** \test The records to skip follow the first record of the range and the
+ *  maximum number of records still applies
+ */
+BOOST_AUTO_TEST_CASE( range_skip_records )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = range_contents();
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "range_skip_records");
+  fs::path index_path = filepath.string() + ".idx";
+
+  d::parse_result whole;
+  parse_whole(whole,filepath,parser,operations);
+  BOOST_REQUIRE(whole.result == 0);
+
+  const matrix_type &records = whole.context.parsed_records;
+
+  BOOST_REQUIRE(dsv_index_build(filepath.c_str(),index_path.c_str(),7,
+    parser) == 0);
+
+  dsv_parser_set_skip_records(parser,5);
+
+  for(int use_index=0; use_index<2; ++use_index) {
+    const char *index = (use_index ? index_path.c_str() : 0);
+
+    d::parse_result range;
+    parse_range(range,filepath,index,10,4,parser,operations);
+    BOOST_REQUIRE(range.result == 0);
+    BOOST_REQUIRE_MESSAGE(range.context.parsed_records == slice(records,15,4),
+      "records to skip not applied" << (use_index ? " with" : " without")
+        << " an index");
+
+    // past the last record
+    d::parse_result past;
+    parse_range(past,filepath,index,1998,4,parser,operations);
+    BOOST_REQUIRE(past.result == 0);
+    BOOST_REQUIRE(past.context.parsed_records.empty());
+
+    dsv_parser_set_max_records(parser,2);
+
+    d::parse_result limited;
+    parse_range(limited,filepath,index,10,4,parser,operations);
+    BOOST_REQUIRE(limited.result == 0);
+    BOOST_REQUIRE_MESSAGE(
+      limited.context.parsed_records == slice(records,15,2),
+      "maximum number of records not applied" << (use_index ? " with"
+        : " without") << " an index");
+
+    dsv_parser_set_max_records(parser,0);
+  }
+
+  fs::remove(index_path);
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
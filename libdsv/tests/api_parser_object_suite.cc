@@ -8,6 +8,8 @@
 #include <stdio.h>
 
 #include <string>
+#include <vector>
+#include <thread>
 
 /** \file
  *  \brief Unit tests for parser creation
@@ -130,8 +132,132 @@ BOOST_AUTO_TEST_CASE( parser_default_object_settings )
   unsigned char delim = dsv_parser_get_field_delimiter(parser);
   BOOST_REQUIRE_MESSAGE(delim == ',',
     "Default parser delimiter was not ',' but rather '" << delim << "'");
+
+  int zero_copy = dsv_parser_zero_copy_fields_allowed(parser);
+  BOOST_REQUIRE_MESSAGE(zero_copy == 0,
+    "Default parser zero copy fields was not '0' but rather '" << zero_copy
+      << "'");
+
+  size_t skip = dsv_parser_get_skip_records(parser);
+  BOOST_REQUIRE_MESSAGE(skip == 0,
+    "Default parser skip records was not '0' but rather '" << skip << "'");
+
+  size_t max = dsv_parser_get_max_records(parser);
+  BOOST_REQUIRE_MESSAGE(max == 0,
+    "Default parser max records was not '0' but rather '" << max << "'");
 }
 
+/** \test Test zero copy fields getting and setting
+ */
+BOOST_AUTO_TEST_CASE( parser_zero_copy_fields_getting_and_setting )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  boost::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_allow_zero_copy_fields(parser,1);
+  BOOST_REQUIRE_MESSAGE(dsv_parser_zero_copy_fields_allowed(parser) != 0,
+    "dsv_parser_zero_copy_fields_allowed did not return the newly set value");
+
+  dsv_parser_allow_zero_copy_fields(parser,0);
+  BOOST_REQUIRE_MESSAGE(dsv_parser_zero_copy_fields_allowed(parser) == 0,
+    "dsv_parser_zero_copy_fields_allowed did not return the newly cleared "
+    "value");
+}
+
+/** \test Test skip records and max records getting and setting
+ */
+BOOST_AUTO_TEST_CASE( parser_record_range_getting_and_setting )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  boost::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_skip_records(parser,7);
+  BOOST_REQUIRE_MESSAGE(dsv_parser_get_skip_records(parser) == 7,
+    "dsv_parser_get_skip_records did not return the newly set value");
+
+  dsv_parser_set_max_records(parser,3);
+  BOOST_REQUIRE_MESSAGE(dsv_parser_get_max_records(parser) == 3,
+    "dsv_parser_get_max_records did not return the newly set value");
+}
+
+
+/** \test One parser object used by concurrent parses. The contents differ
+ *  in newline and column count, which each parse settles for itself
+ */
+BOOST_AUTO_TEST_CASE( parser_shared_by_concurrent_parses )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  boost::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  struct worker {
+    std::string contents;
+    std::vector<std::vector<detail::field_storage_type> > records;
+    std::size_t failures;
+
+    static void run(worker *w, dsv_parser_t parser)
+    {
+      dsv_operations_t operations;
+      if(dsv_operations_create(&operations) != 0) {
+        ++w->failures;
+        return;
+      }
+
+      for(int i=0; i<200; ++i) {
+        detail::file_context context;
+        dsv_set_record_callback(detail::record_callback,&context,operations);
+
+        int result = dsv_parse_buffer("shared",
+          reinterpret_cast<const unsigned char *>(w->contents.data()),
+          w->contents.size(),parser,operations);
+
+        if(result != 0 || context.parsed_records != w->records)
+          ++w->failures;
+      }
+
+      dsv_operations_destroy(operations);
+    }
+  };
+
+  std::vector<worker> workers(8);
+  for(std::size_t t=0; t<workers.size(); ++t) {
+    worker &w = workers[t];
+    std::string newline = (t % 2 ? "\n" : "\r\n");
+    std::size_t columns = t+1;
+
+    for(std::size_t r=0; r<20; ++r) {
+      std::vector<detail::field_storage_type> row;
+      for(std::size_t c=0; c<columns; ++c) {
+        std::string field = std::to_string(t) + "_" + std::to_string(r)
+          + "_" + std::to_string(c);
+        w.contents += (c ? "," : "") + field;
+        row.push_back(detail::field_storage_type(field.begin(),field.end()));
+      }
+      w.contents += newline;
+
+      // the first row is the header
+      if(r)
+        w.records.push_back(row);
+    }
+
+    w.failures = 0;
+  }
+
+  std::vector<std::thread> threads;
+  for(std::size_t t=0; t<workers.size(); ++t)
+    threads.push_back(std::thread(&worker::run,&workers[t],parser));
+
+  for(std::size_t t=0; t<threads.size(); ++t)
+    threads[t].join();
+
+  for(std::size_t t=0; t<workers.size(); ++t) {
+    BOOST_REQUIRE_MESSAGE(workers[t].failures == 0,
+      "Parse " << t << " failed or differed " << workers[t].failures
+        << " times");
+  }
+}
 
 
 BOOST_AUTO_TEST_SUITE_END()
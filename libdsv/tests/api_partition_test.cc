@@ -0,0 +1,399 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <map>
+#include <algorithm>
+
+/** \file
+ *  \brief Tests for routing records to partitions by key
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+inline d::field_storage_type field(const std::string &str)
+{
+  return d::field_storage_type(str.begin(),str.end());
+}
+
+struct partition_context {
+  matrix_type records;
+  std::vector<std::size_t> partitions;
+
+  static int callback(std::size_t partition, const unsigned char *fields[],
+    const size_t lengths[], size_t size, void *_context)
+  {
+    partition_context &context = *static_cast<partition_context*>(_context);
+
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<size; ++i)
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+
+    context.records.push_back(row);
+    context.partitions.push_back(partition);
+
+    return 1;
+  }
+};
+
+/*
+    Each key of column col of records must be in a single partition
+ */
+inline bool keys_in_one_partition(const matrix_type &records,
+  const std::vector<std::size_t> &partitions, std::size_t col)
+{
+  std::map<d::field_storage_type,std::size_t> owner;
+  for(std::size_t r=0; r<records.size(); ++r) {
+    if(owner.insert(std::make_pair(records[r].at(col),partitions[r]))
+      .first->second != partitions[r])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_partition_suite )
+
+/** \test Records go to the partition callback rather than the record
+ *  callback, in order and with equal keys in the same partition
+ */
+BOOST_AUTO_TEST_CASE( partition_callback )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::keyed_contents(2000,23);
+  const unsigned char *data =
+    reinterpret_cast<const unsigned char *>(contents.data());
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse_buffer("partition_callback",data,contents.size(),
+    parser,operations) == 0);
+
+  std::size_t key[] = {1};
+  partition_context partitioned;
+  BOOST_REQUIRE(dsv_operations_set_partitions(operations,key,1,4,
+    &partition_context::callback,&partitioned) == 0);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+  BOOST_REQUIRE(dsv_parse_buffer("partition_callback",data,contents.size(),
+    parser,operations) == 0);
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_headers == expected.parsed_headers,
+    "header not passed to the header callback");
+  BOOST_REQUIRE_MESSAGE(context.parsed_records.empty(),
+    "records passed to the record callback while partitioning");
+  BOOST_REQUIRE_MESSAGE(partitioned.records == expected.parsed_records,
+    "partitioned records differ\n"
+      << d::output_fields(expected.parsed_records,partitioned.records));
+
+  BOOST_REQUIRE(keys_in_one_partition(partitioned.records,
+    partitioned.partitions,1));
+
+  std::vector<std::size_t> used(partitioned.partitions);
+  std::sort(used.begin(),used.end());
+  used.erase(std::unique(used.begin(),used.end()),used.end());
+  BOOST_REQUIRE_MESSAGE(used.size() == 4,
+    "only " << used.size() << " partitions used");
+
+  // a key of several columns counted after projection
+  const char *names[] = {"key","id"};
+  BOOST_REQUIRE(dsv_operations_set_projection_names(operations,names,2) == 0);
+
+  std::size_t keys[] = {1,0};
+  partitioned = partition_context();
+  BOOST_REQUIRE(dsv_operations_set_partitions(operations,keys,2,3,
+    &partition_context::callback,&partitioned) == 0);
+  BOOST_REQUIRE(dsv_parse_buffer("partition_callback",data,contents.size(),
+    parser,operations) == 0);
+
+  BOOST_REQUIRE(partitioned.records.size() == expected.parsed_records.size());
+  for(std::size_t r=0; r<partitioned.records.size(); ++r) {
+    BOOST_REQUIRE(partitioned.partitions[r] < 3);
+    BOOST_REQUIRE(partitioned.records[r].at(0)
+      == expected.parsed_records[r].at(1));
+  }
+
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,0,0) == 0);
+
+  // and back to the record callback
+  dsv_operations_clear_partitions(operations);
+  context.parsed_headers.clear();
+  BOOST_REQUIRE(dsv_parse_buffer("partition_callback",data,contents.size(),
+    parser,operations) == 0);
+  BOOST_REQUIRE(context.parsed_records == expected.parsed_records);
+}
+
+/** \test Partition files hold the header once and records that parse back
+ *  to the originals
+ */
+BOOST_AUTO_TEST_CASE( partition_files )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::keyed_contents(2000,23);
+  const unsigned char *data =
+    reinterpret_cast<const unsigned char *>(contents.data());
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse_buffer("partition_files",data,contents.size(),
+    parser,operations) == 0);
+
+  const std::size_t partitions = 5;
+  std::vector<fs::path> paths;
+  std::vector<std::FILE *> files;
+  for(std::size_t i=0; i<partitions; ++i) {
+    paths.push_back(d::gen_testfile({},"partition_files_"
+      + std::to_string(i)));
+    files.push_back(std::fopen(paths.back().c_str(),"wb"));
+    BOOST_REQUIRE(files.back());
+  }
+
+  std::size_t key[] = {1};
+  BOOST_REQUIRE(dsv_operations_set_partition_files(operations,key,1,
+    files.data(),partitions,',') == 0);
+
+  // two inputs into the same files
+  dsv_set_header_callback(0,0,operations);
+  for(int pass=0; pass<2; ++pass) {
+    BOOST_REQUIRE(dsv_parse_buffer("partition_files",data,contents.size(),
+      parser,operations) == 0);
+  }
+
+  dsv_operations_clear_partitions(operations);
+  for(std::size_t i=0; i<partitions; ++i)
+    std::fclose(files[i]);
+
+  matrix_type all;
+  std::map<d::field_storage_type,std::size_t> owner;
+  for(std::size_t i=0; i<partitions; ++i) {
+    d::file_context context;
+    dsv_set_header_callback(d::header_callback,&context,operations);
+    dsv_set_record_callback(d::record_callback,&context,operations);
+
+    int result = dsv_parse(paths[i].c_str(),0,parser,operations);
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "partition " << i << " did not parse: " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_headers == expected.parsed_headers,
+      "partition " << i << " does not start with the header");
+
+    for(std::size_t r=0; r<context.parsed_records.size(); ++r) {
+      const d::field_storage_type &k = context.parsed_records[r].at(1);
+      BOOST_REQUIRE_MESSAGE(owner.insert(std::make_pair(k,i)).first->second
+        == i,"a key was written to two partitions");
+    }
+
+    all.insert(all.end(),context.parsed_records.begin(),
+      context.parsed_records.end());
+
+    fs::remove(paths[i]);
+  }
+
+  matrix_type twice(expected.parsed_records);
+  twice.insert(twice.end(),expected.parsed_records.begin(),
+    expected.parsed_records.end());
+
+  std::sort(all.begin(),all.end());
+  std::sort(twice.begin(),twice.end());
+
+  BOOST_REQUIRE_MESSAGE(all == twice,
+    "partition files hold " << all.size() << " records rather than "
+      << twice.size());
+}
+
+/** \test Partition files written by the threads of dsv_parse_many and the
+ *  workers of dsv_parse_dispatched hold the header once and every record
+ */
+BOOST_AUTO_TEST_CASE( partition_files_threads )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::keyed_contents(2000,23);
+  const unsigned char *data =
+    reinterpret_cast<const unsigned char *>(contents.data());
+
+  d::file_context expected;
+  dsv_set_header_callback(d::header_callback,&expected,operations);
+  dsv_set_record_callback(d::record_callback,&expected,operations);
+  BOOST_REQUIRE(dsv_parse_buffer("partition_files_threads",data,
+    contents.size(),parser,operations) == 0);
+
+  const std::size_t inputs = 4;
+  std::vector<fs::path> input_paths;
+  std::vector<std::string> input_names;
+  std::vector<const char *> input_cstrs;
+  for(std::size_t i=0; i<inputs; ++i) {
+    input_paths.push_back(d::gen_testfile({field(contents)},
+      "partition_files_threads_in_" + std::to_string(i)));
+    input_names.push_back(input_paths.back().string());
+  }
+  for(std::size_t i=0; i<inputs; ++i)
+    input_cstrs.push_back(input_names[i].c_str());
+
+  const std::size_t partitions = 3;
+  std::size_t key[] = {1};
+
+  // many concurrent, many ordered and dispatched
+  for(int mode=0; mode<3; ++mode) {
+    std::vector<fs::path> paths;
+    std::vector<std::FILE *> files;
+    for(std::size_t i=0; i<partitions; ++i) {
+      paths.push_back(d::gen_testfile({},"partition_files_threads_"
+        + std::to_string(i)));
+      files.push_back(std::fopen(paths.back().c_str(),"wb"));
+      BOOST_REQUIRE(files.back());
+    }
+
+    BOOST_REQUIRE(dsv_operations_set_partition_files(operations,key,1,
+      files.data(),partitions,',') == 0);
+    dsv_set_header_callback(0,0,operations);
+
+    int result;
+    std::size_t copies = inputs;
+    if(mode < 2) {
+      result = dsv_parse_many(input_cstrs.data(),inputs,inputs,
+        (mode ? dsv_many_ordered : dsv_many_concurrent),0,0,parser,
+        operations);
+    }
+    else {
+      copies = 1;
+      result = dsv_parse_dispatched(input_cstrs[0],0,4,dsv_dispatch_by_key,1,
+        0,parser,operations);
+    }
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "mode " << mode << " failed: " << result);
+
+    dsv_operations_clear_partitions(operations);
+    for(std::size_t i=0; i<partitions; ++i)
+      std::fclose(files[i]);
+
+    matrix_type all;
+    for(std::size_t i=0; i<partitions; ++i) {
+      d::file_context context;
+      dsv_set_header_callback(d::header_callback,&context,operations);
+      dsv_set_record_callback(d::record_callback,&context,operations);
+
+      result = dsv_parse(paths[i].c_str(),0,parser,operations);
+      BOOST_REQUIRE_MESSAGE(result == 0,"mode " << mode << " partition "
+        << i << " did not parse: " << result);
+
+      BOOST_REQUIRE_MESSAGE(context.parsed_headers == expected.parsed_headers,
+        "mode " << mode << " partition " << i
+          << " does not start with the header");
+
+      // a header written again appears as a record
+      BOOST_REQUIRE_MESSAGE(std::count(context.parsed_records.begin(),
+        context.parsed_records.end(),expected.parsed_headers.front()) == 0,
+        "mode " << mode << " partition " << i
+          << " holds the header more than once");
+
+      all.insert(all.end(),context.parsed_records.begin(),
+        context.parsed_records.end());
+
+      fs::remove(paths[i]);
+    }
+
+    matrix_type each;
+    for(std::size_t i=0; i<copies; ++i) {
+      each.insert(each.end(),expected.parsed_records.begin(),
+        expected.parsed_records.end());
+    }
+
+    std::sort(all.begin(),all.end());
+    std::sort(each.begin(),each.end());
+
+    BOOST_REQUIRE_MESSAGE(all == each,
+      "mode " << mode << ": partition files hold " << all.size()
+        << " records rather than " << each.size());
+  }
+
+  for(std::size_t i=0; i<inputs; ++i)
+    fs::remove(input_paths[i]);
+}
+
+/** \test A partition callback that asks to stop ends the parse
+ */
+BOOST_AUTO_TEST_CASE( partition_stop )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  struct stop {
+    static int callback(std::size_t, const unsigned char *[],
+      const size_t [], size_t, void *_context)
+    {
+      std::size_t &seen = *static_cast<std::size_t*>(_context);
+      return (++seen < 10);
+    }
+  };
+
+  std::size_t seen = 0;
+  std::size_t key[] = {0};
+  BOOST_REQUIRE(dsv_operations_set_partitions(operations,key,1,2,
+    &stop::callback,&seen) == 0);
+
+  std::string contents = d::keyed_contents(2000,23);
+  int result = dsv_parse_buffer("partition_stop",
+    reinterpret_cast<const unsigned char *>(contents.data()),contents.size(),
+    parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,"parse did not stop: " << result);
+  BOOST_REQUIRE(seen == 10);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,206 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <cstdio>
+#include <cerrno>
+
+/** \file
+ *  \brief Tests for parsing a stream with reading and parsing overlapped
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+/*
+    Parse filepath with dsv_parse or dsv_parse_pipelined, from the file
+    itself or from a stream
+ */
+inline void parse(d::parse_result &parsed, const fs::path &filepath,
+  dsv_parser_t parser, dsv_operations_t operations, bool pipelined,
+  bool from_stream)
+{
+  d::capture_parse(parsed,parser,operations);
+
+  std::unique_ptr<std::FILE,int(*)(std::FILE *)> in(0,&std::fclose);
+  if(from_stream)
+    in.reset(std::fopen(filepath.c_str(),"rb"));
+
+  if(pipelined) {
+    parsed.result = dsv_parse_pipelined(filepath.c_str(),in.get(),parser,
+      operations);
+  }
+  else
+    parsed.result = dsv_parse(filepath.c_str(),in.get(),parser,operations);
+}
+
+/*
+    A pipelined parse must match a sequential parse
+ */
+inline void check_pipelined(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations, const std::string &label)
+{
+  d::parse_result expected;
+  parse(expected,filepath,parser,operations,false,false);
+
+  for(int from_stream=0; from_stream<2; ++from_stream) {
+    d::parse_result pipelined;
+    parse(pipelined,filepath,parser,operations,true,from_stream);
+
+    d::check_same_parse(expected,pipelined,
+      label + " from stream " + std::to_string(from_stream));
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_pipelined_parse_suite )
+
+/** \test The same records and warnings as a sequential parse
+ */
+BOOST_AUTO_TEST_CASE( pipelined_matches_sequential )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(5*1024*1024);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "pipelined_matches_sequential");
+
+  check_pipelined(filepath,parser,operations,"pipelined");
+
+  const char *names[] = {"value","id"};
+  BOOST_REQUIRE(dsv_operations_set_projection_names(operations,names,2) == 0);
+  const unsigned char prefix[] = {'1'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,0,prefix,1)
+    == 0);
+
+  check_pipelined(filepath,parser,operations,"pipelined_filtered");
+
+  dsv_operations_clear_predicates(operations);
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,0,0) == 0);
+
+  // the maximum ends the parse part way through the stream
+  dsv_parser_set_skip_records(parser,1000);
+  dsv_parser_set_max_records(parser,50000);
+
+  check_pipelined(filepath,parser,operations,"pipelined_range");
+
+  fs::remove(filepath);
+}
+
+/** \test Failures are reported as by a sequential parse and the records
+ *  before them are passed on
+ */
+BOOST_AUTO_TEST_CASE( pipelined_failure )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(5*1024*1024);
+  std::size_t middle = contents.find("\r\n",contents.size()/2)+2;
+  contents.insert(middle,"bad\"field\r\n");
+
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "pipelined_failure");
+
+  check_pipelined(filepath,parser,operations,"pipelined_failure");
+
+  fs::remove(filepath);
+
+  d::parse_result missing;
+  parse(missing,filepath,parser,operations,true,false);
+  BOOST_REQUIRE_MESSAGE(missing.result == ENOENT,
+    "missing file returned " << missing.result);
+}
+
+/** \test Callbacks are called from the calling thread and a callback that
+ *  asks to stop ends the parse
+ */
+BOOST_AUTO_TEST_CASE( pipelined_callbacks )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = d::mixed_contents(5*1024*1024);
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},
+    "pipelined_callbacks");
+
+  struct records {
+    std::thread::id caller;
+    std::size_t limit;
+    std::size_t seen;
+    bool other_thread;
+
+    static int callback(const unsigned char *fields[], const size_t lengths[],
+      size_t size, void *_context)
+    {
+      records &context = *static_cast<records*>(_context);
+
+      if(std::this_thread::get_id() != context.caller)
+        context.other_thread = true;
+
+      return (++context.seen < context.limit);
+    }
+  };
+
+  records context{std::this_thread::get_id(),30000,0,false};
+  dsv_set_header_callback(0,0,operations);
+  dsv_set_record_callback(&records::callback,&context,operations);
+  dsv_set_logger_callback(0,0,dsv_log_none,parser);
+
+  int result = dsv_parse_pipelined(filepath.c_str(),0,parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "parse did not stop when asked: " << result);
+  BOOST_REQUIRE_MESSAGE(context.seen == context.limit,
+    context.seen << " records passed on rather than " << context.limit);
+  BOOST_REQUIRE_MESSAGE(!context.other_thread,
+    "record callback called from another thread");
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,324 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <functional>
+
+/** \file
+ *  \brief Tests for filtering records with predicates
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+inline d::field_storage_type field(const std::string &str)
+{
+  return d::field_storage_type(str.begin(),str.end());
+}
+
+static const std::string predicate_file =
+  "key,name,amount\r\n"
+  "k1,apple,10\r\n"
+  "k2,\"apricot, dried\",2.5\r\n"
+  "k1,\"ban\"\"ana\",-3\r\n"
+  "k10,cherry,1e2\r\n"
+  "k1,\"date\r\npalm\",abc\r\n"
+  "x1,apple,7\r\n";
+
+inline matrix_type predicate_file_records(void)
+{
+  return matrix_type{
+    {field("k1"),field("apple"),field("10")},
+    {field("k2"),field("apricot, dried"),field("2.5")},
+    {field("k1"),field("ban\"ana"),field("-3")},
+    {field("k10"),field("cherry"),field("1e2")},
+    {field("k1"),field("date\r\npalm"),field("abc")},
+    {field("x1"),field("apple"),field("7")}
+  };
+}
+
+/*
+    The rows of matrix with the given indices
+ */
+inline matrix_type rows(const matrix_type &matrix,
+  const std::vector<std::size_t> &indices)
+{
+  matrix_type result;
+  for(std::size_t i=0; i<indices.size(); ++i)
+    result.push_back(matrix[indices[i]]);
+
+  return result;
+}
+
+/*
+    Parse contents from a buffer, a stream and a byte at a time through
+    dsv_parser_feed. Each must produce records
+ */
+inline void check_filter(dsv_parser_t parser, dsv_operations_t operations,
+  const std::string &contents, const matrix_type &records,
+  const std::string &label)
+{
+  fs::path filepath = d::gen_testfile({field(contents)},label);
+
+  for(int source=0; source<3; ++source) {
+    d::file_context context;
+    dsv_set_record_callback(d::record_callback,&context,operations);
+
+    const unsigned char *data =
+      reinterpret_cast<const unsigned char *>(contents.data());
+
+    int result = 0;
+    switch(source) {
+      case 0:
+        result = dsv_parse_buffer(label.c_str(),data,contents.size(),parser,
+          operations);
+        break;
+
+      case 1:
+        result = d::stream_parse(filepath,parser,operations);
+        break;
+
+      case 2:
+        for(std::size_t i=0; i<contents.size() && result == 0; ++i)
+          result = dsv_parser_feed(parser,operations,data+i,1);
+        if(result == 0)
+          result = dsv_parser_finish(parser,operations);
+        break;
+    }
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      label << ": parse failed for source " << source << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+      label << ": filtered records differ for source " << source << "\n"
+        << d::output_fields(records,context.parsed_records));
+  }
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_predicate_suite )
+
+/** \test Each kind of predicate on its own and in combination
+ */
+BOOST_AUTO_TEST_CASE( predicate_kinds )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  matrix_type records = predicate_file_records();
+
+  const unsigned char k1[] = {'k','1'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_equal(operations,0,k1,2) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,2,4}),
+    "predicate_equal");
+  dsv_operations_clear_predicates(operations);
+
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,0,k1,2) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,2,3,4}),
+    "predicate_prefix");
+  dsv_operations_clear_predicates(operations);
+
+  // quoted fields are compared by content
+  const unsigned char ap[] = {'a','p'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,1,ap,2) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,1,5}),
+    "predicate_quoted_prefix");
+  dsv_operations_clear_predicates(operations);
+
+  BOOST_REQUIRE(dsv_operations_add_predicate_range(operations,2,0,50) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,1,5}),
+    "predicate_range");
+  dsv_operations_clear_predicates(operations);
+
+  BOOST_REQUIRE(dsv_operations_add_predicate_range(operations,2,-5,1000) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,1,2,3,5}),
+    "predicate_wide_range");
+
+  // all must hold
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,0,k1,2) == 0);
+  check_filter(parser,operations,predicate_file,rows(records,{0,2,3}),
+    "predicate_combined");
+  dsv_operations_clear_predicates(operations);
+
+  check_filter(parser,operations,predicate_file,records,"predicate_cleared");
+}
+
+/** \test The range predicate only accepts plain decimal numbers
+ */
+BOOST_AUTO_TEST_CASE( predicate_range_strict )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents =
+    "value\r\n"
+    "1\r\n"
+    "+.5\r\n"
+    "5.\r\n"
+    "-2E+1\r\n"
+    "inf\r\n"
+    "nan\r\n"
+    "0x10\r\n"
+    " 5\r\n"
+    "5 \r\n"
+    "1e\r\n"
+    ".\r\n"
+    "-\r\n"
+    "1e999\r\n";
+
+  BOOST_REQUIRE(dsv_operations_add_predicate_range(operations,0,-1e300,
+    1e300) == 0);
+
+  matrix_type records{{field("1")},{field("+.5")},{field("5.")},
+    {field("-2E+1")}};
+
+  check_filter(parser,operations,contents,records,"predicate_range_strict");
+}
+
+/** \test Predicate columns refer to the parsed row when projecting and need
+ *  not be projected
+ */
+BOOST_AUTO_TEST_CASE( predicate_projection )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::size_t cols[] = {2,1};
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,cols,2) == 0);
+
+  const unsigned char k1[] = {'k','1'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_equal(operations,0,k1,2) == 0);
+
+  matrix_type records{
+    {field("10"),field("apple")},
+    {field("-3"),field("ban\"ana")},
+    {field("abc"),field("date\r\npalm")}
+  };
+
+  check_filter(parser,operations,predicate_file,records,
+    "predicate_projection");
+}
+
+/** \test Missing fields are checked as empty fields
+ */
+BOOST_AUTO_TEST_CASE( predicate_missing_fields )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string contents = "a,b\r\n1,\r\n2\r\n\r\n3,x\r\n";
+
+  BOOST_REQUIRE(dsv_operations_add_predicate_equal(operations,1,0,0) == 0);
+
+  matrix_type records{
+    {field("1"),field("")},
+    {field("2")},
+    {}
+  };
+
+  check_filter(parser,operations,contents,records,"predicate_missing_empty");
+
+  dsv_operations_clear_predicates(operations);
+  const unsigned char x[] = {'x'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_equal(operations,1,x,1) == 0);
+
+  check_filter(parser,operations,contents,{{field("3"),field("x")}},
+    "predicate_missing_value");
+}
+
+/** \test Filtered records are left out of batches and columns
+ */
+BOOST_AUTO_TEST_CASE( predicate_batches )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  const unsigned char k1[] = {'k','1'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_equal(operations,0,k1,2) == 0);
+  dsv_set_record_batch_size(2,operations);
+
+  struct batches {
+    static int callback(const unsigned char *fields[], const size_t lengths[],
+      const size_t offsets[], size_t size, void *_context)
+    {
+      matrix_type &parsed = *static_cast<matrix_type*>(_context);
+
+      for(std::size_t r=0; r<size; ++r) {
+        std::vector<d::field_storage_type> row;
+        for(std::size_t i=offsets[r]; i<offsets[r+1]; ++i)
+          row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+        parsed.push_back(row);
+      }
+
+      return 1;
+    }
+  };
+
+  matrix_type parsed;
+  dsv_set_record_batch_callback(&batches::callback,&parsed,operations);
+
+  int result = dsv_parse_buffer("predicate_batches",
+    reinterpret_cast<const unsigned char *>(predicate_file.data()),
+    predicate_file.size(),parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+  matrix_type records = rows(predicate_file_records(),{0,2,4});
+  BOOST_REQUIRE_MESSAGE(parsed == records,
+    "Filtered batches differ\n" << d::output_fields(records,parsed));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
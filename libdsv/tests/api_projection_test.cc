@@ -0,0 +1,334 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+/** \file
+ *  \brief Tests for passing on a subset of the columns
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    The columns cols of each row of matrix. Missing columns are empty
+ */
+inline matrix_type project(const matrix_type &matrix,
+  const std::vector<std::size_t> &cols)
+{
+  matrix_type result;
+  for(std::size_t r=0; r<matrix.size(); ++r) {
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=0; i<cols.size(); ++i)
+      row.push_back(cols[i] < matrix[r].size() ? matrix[r][cols[i]] : d::empty);
+
+    result.push_back(row);
+  }
+
+  return result;
+}
+
+inline std::vector<unsigned char> file_contents(const fs::path &filepath)
+{
+  std::ifstream in(filepath.c_str(),std::ios::binary);
+  return std::vector<unsigned char>((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+}
+
+/*
+    Parse filepath with every input source. Each must produce headers and
+    records.
+ */
+inline void check_sources(dsv_parser_t parser, dsv_operations_t operations,
+  const fs::path &filepath, const matrix_type &headers,
+  const matrix_type &records, const std::string &label)
+{
+  std::vector<unsigned char> contents = file_contents(filepath);
+
+  for(int source=0; source<5; ++source) {
+    d::file_context context;
+    dsv_set_header_callback(d::header_callback,&context,operations);
+    dsv_set_record_callback(d::record_callback,&context,operations);
+
+    dsv_parser_allow_zero_copy_fields(parser,source == 2);
+
+    int result = 0;
+    switch(source) {
+      case 0:
+        result = d::stream_parse(filepath,parser,operations);
+        break;
+
+      case 1:
+      case 2:
+        result = dsv_parse_buffer(label.c_str(),contents.data(),
+          contents.size(),parser,operations);
+        break;
+
+      case 3:
+        result = dsv_parse_file_mmap(filepath.c_str(),dsv_mmap_default,parser,
+          operations);
+        break;
+
+      case 4:
+        // every token is split
+        for(std::size_t i=0; i<contents.size() && result == 0; ++i)
+          result = dsv_parser_feed(parser,operations,contents.data()+i,1);
+        if(result == 0)
+          result = dsv_parser_finish(parser,operations);
+        break;
+    }
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      label << ": parse failed for source " << source << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_headers == headers,
+      label << ": projected header differs for source " << source << "\n"
+        << d::output_fields(headers,context.parsed_headers));
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+      label << ": projected records differ for source " << source << "\n"
+        << d::output_fields(records,context.parsed_records));
+  }
+
+  dsv_parser_allow_zero_copy_fields(parser,0);
+}
+
+static const std::string projection_file =
+  "id,name,note,value,flag\r\n"
+  "1,alpha,\"quoted, with delimiter\",10,y\r\n"
+  "2,\"be\"\"ta\",\"multi\r\nline\",20,n\r\n"
+  "3,gamma,,30,\r\n"
+  ",,,,\r\n"
+  "5,epsilon,plain,50,y\r\n";
+
+inline matrix_type projection_file_header(void)
+{
+  return matrix_type{
+    {{'i','d'},{'n','a','m','e'},{'n','o','t','e'},{'v','a','l','u','e'},
+      {'f','l','a','g'}}
+  };
+}
+
+inline matrix_type projection_file_records(void)
+{
+  std::string note = "quoted, with delimiter";
+  std::string multi = "multi\r\nline";
+
+  return matrix_type{
+    {{'1'},{'a','l','p','h','a'},d::field_storage_type(note.begin(),note.end()),
+      {'1','0'},{'y'}},
+    {{'2'},{'b','e','"','t','a'},
+      d::field_storage_type(multi.begin(),multi.end()),{'2','0'},{'n'}},
+    {{'3'},{'g','a','m','m','a'},{},{'3','0'},{}},
+    {{},{},{},{},{}},
+    {{'5'},{'e','p','s','i','l','o','n'},{'p','l','a','i','n'},{'5','0'},
+      {'y'}}
+  };
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_projection_suite )
+
+/** \test Project by column number in any order, with repeats and past the
+ *  end of the rows
+ */
+BOOST_AUTO_TEST_CASE( projection_by_number )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  fs::path filepath = d::gen_testfile({d::field_storage_type(
+    projection_file.begin(),projection_file.end())},"projection_by_number");
+
+  const std::vector<std::vector<std::size_t> > projections{
+    {0},{3,1},{2},{4,4,0},{1,7},{0,1,2,3,4}
+  };
+
+  for(std::size_t p=0; p<projections.size(); ++p) {
+    const std::vector<std::size_t> &cols = projections[p];
+
+    int err = dsv_operations_set_projection(operations,cols.data(),
+      cols.size());
+    BOOST_REQUIRE_MESSAGE(err == 0,
+      "dsv_operations_set_projection failed: " << err);
+
+    check_sources(parser,operations,filepath,
+      project(projection_file_header(),cols),
+      project(projection_file_records(),cols),
+      "projection " + std::to_string(p));
+  }
+
+  // and back to all columns
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,0,0) == 0);
+  check_sources(parser,operations,filepath,projection_file_header(),
+    projection_file_records(),"no projection");
+
+  fs::remove(filepath);
+}
+
+/** \test Project by header name
+ */
+BOOST_AUTO_TEST_CASE( projection_by_name )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  fs::path filepath = d::gen_testfile({d::field_storage_type(
+    projection_file.begin(),projection_file.end())},"projection_by_name");
+
+  const char *names[] = {"value","note","id"};
+  int err = dsv_operations_set_projection_names(operations,names,3);
+  BOOST_REQUIRE_MESSAGE(err == 0,
+    "dsv_operations_set_projection_names failed: " << err);
+
+  std::vector<std::size_t> cols{3,2,0};
+  check_sources(parser,operations,filepath,
+    project(projection_file_header(),cols),
+    project(projection_file_records(),cols),"projection by name");
+
+  // by number replaces by name
+  std::size_t col = 1;
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,&col,1) == 0);
+  check_sources(parser,operations,filepath,
+    project(projection_file_header(),{1}),
+    project(projection_file_records(),{1}),"projection replaced");
+
+  fs::remove(filepath);
+}
+
+/** \test A name that is not in the header fails the parse
+ */
+BOOST_AUTO_TEST_CASE( projection_unknown_name )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  d::logging_context log_context;
+  dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  const char *names[] = {"name","missing"};
+  BOOST_REQUIRE(dsv_operations_set_projection_names(operations,names,2) == 0);
+
+  int result = dsv_parse_buffer("projection_unknown_name",
+    reinterpret_cast<const unsigned char *>(projection_file.data()),
+    projection_file.size(),parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "Parse did not fail for an unknown column: " << result);
+
+  std::vector<d::log_msg> logs{
+    d::log_msg{dsv_unknown_column,dsv_log_error,
+      {"1","missing","projection_unknown_name"}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(d::check_logs(logs,log_context.recd_logs),
+    "Did not receive the correct log messages:\n"
+      << d::compare_logs(logs,log_context.recd_logs));
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_headers.empty()
+    && context.parsed_records.empty(),"Rows passed on after the failure");
+}
+
+/** \test Projection applies to the batch and column callbacks. Unselected
+ *  escaped binary content is skipped
+ */
+BOOST_AUTO_TEST_CASE( projection_batches )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_allow_escaped_binary_fields(parser,1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::size_t cols[] = {2,0};
+  BOOST_REQUIRE(dsv_operations_set_projection(operations,cols,2) == 0);
+
+  std::string raw = "a,b,c\nx,\"\x01\x02\n\",z\n1,2,3\n";
+
+  struct columns {
+    static int callback(const dsv_column_t columns[], size_t size,
+      size_t rows, void *_context)
+    {
+      matrix_type &parsed = *static_cast<matrix_type*>(_context);
+
+      for(std::size_t r=0; r<rows; ++r) {
+        std::vector<d::field_storage_type> row;
+        for(std::size_t c=0; c<size; ++c) {
+          row.push_back(d::field_storage_type(
+            columns[c].data+columns[c].offsets[r],
+            columns[c].data+columns[c].offsets[r+1]));
+        }
+
+        parsed.push_back(row);
+      }
+
+      return 1;
+    }
+  };
+
+  matrix_type parsed;
+  dsv_set_column_batch_callback(&columns::callback,&parsed,operations);
+
+  int result = dsv_parse_buffer("projection_batches",
+    reinterpret_cast<const unsigned char *>(raw.data()),raw.size(),parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+  matrix_type records{
+    {{'z'},{'x'}},
+    {{'3'},{'1'}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(parsed == records,
+    "Projected columns differ\n" << d::output_fields(records,parsed));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
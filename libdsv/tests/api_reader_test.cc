@@ -0,0 +1,245 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <string>
+#include <memory>
+
+/** \file
+ *  \brief Unit tests for the record at a time reader
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+inline void reader_close(dsv_reader_t *reader)
+{
+  dsv_reader_close(*reader);
+}
+
+/*
+    Read filepath with a dsv_reader_t and hand the header and each record to
+    the callbacks registered in operations as if dsv_parse had been called
+ */
+inline int reader_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  dsv_reader_t reader;
+  int result = dsv_reader_open(&reader,filepath.c_str(),0,parser);
+  if(result != 0)
+    return result;
+
+  std::shared_ptr<dsv_reader_t> reader_sentry(&reader,reader_close);
+
+  const unsigned char * const *fields;
+  const size_t *lengths;
+  size_t size;
+
+  result = dsv_reader_header(reader,&fields,&lengths,&size);
+  if(result == 1) {
+    dsv_get_header_callback(operations)(const_cast<const unsigned char **>(fields),
+      lengths,size,dsv_get_header_context(operations));
+  }
+
+  while(result == 1) {
+    result = dsv_reader_next(reader,&fields,&lengths,&size);
+    if(result == 1) {
+      dsv_get_record_callback(operations)(const_cast<const unsigned char **>(fields),
+        lengths,size,dsv_get_record_context(operations));
+    }
+  }
+
+  return result;
+}
+
+
+
+BOOST_AUTO_TEST_SUITE( api_reader_suite )
+
+
+/** \test Attempt to open a nonexistent file
+ */
+BOOST_AUTO_TEST_CASE( reader_nonexistent_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_reader_t reader;
+  int result = dsv_reader_open(&reader,"nonexistant_file.dsv",0,parser);
+
+  BOOST_REQUIRE_MESSAGE(result == ENOENT,
+    "dsv_reader_open attempted to open a nonexistent file and did not "
+    "return ENOENT");
+}
+
+/** \test Read an empty file. There is neither a header nor records
+ */
+BOOST_AUTO_TEST_CASE( reader_empty_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  d::check_compliance(parser,{},{},{},{},"reader_empty_file",0,reader_parse);
+}
+
+/** \test Read quoted and unquoted fields over several records
+ */
+BOOST_AUTO_TEST_CASE( reader_rfc4180_charset )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {d::rfc4180_charset,d::rfc4180_quoted_charset}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {d::rfc4180_quoted_charset,d::rfc4180_charset},
+    {d::rfc4180_charset,d::empty}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    d::rfc4180_charset,d::comma,d::rfc4180_raw_quoted_charset,d::crlf,
+    d::rfc4180_raw_quoted_charset,d::comma,d::rfc4180_charset,d::crlf,
+    d::rfc4180_charset,d::comma,d::crlf
+  };
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "reader_rfc4180_charset",0,reader_parse);
+}
+
+/** \test The final record need not be terminated by a newline
+ */
+BOOST_AUTO_TEST_CASE( reader_unterminated_record )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a'},{'b'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'c'},{'d'}},
+    {{'e'},{'f'}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a'},d::comma,{'b'},d::lf,
+    {'c'},d::comma,{'d'},d::lf,
+    {'e'},d::comma,{'f'}
+  };
+
+  d::check_compliance(parser,headers,records,{},file_contents,
+    "reader_unterminated_record",0,reader_parse);
+}
+
+/** \test Read content with a syntax error. Records before the error are
+ *  returned
+ */
+BOOST_AUTO_TEST_CASE( reader_syntax_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create_RFC4180_strict(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<detail::log_msg> logs{
+    {dsv_syntax_error,dsv_log_error,{"2","2","4","5",""}}
+  };
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a','b','c'},d::crlf,
+    {'d','e','f',0x01},d::crlf
+  };
+
+  std::vector<std::vector<d::field_storage_type> > headers{
+    {{'a','b','c'}}
+  };
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'d','e','f'}}
+  };
+
+  d::check_compliance(parser,headers,records,logs,file_contents,
+    "reader_syntax_error",-1,reader_parse);
+}
+
+/** \test Records are produced on demand from a caller supplied stream. The
+ *  header remains valid while records are read and the stream is not closed
+ */
+BOOST_AUTO_TEST_CASE( reader_stream )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::vector<d::field_storage_type> file_contents{
+    {'a'},d::comma,{'b'},d::lf,
+    {'c'},d::comma,{'d'},d::lf,
+    {'e'},d::comma,{'f'},d::lf
+  };
+
+  fs::path filepath = d::gen_testfile(file_contents,"reader_stream");
+
+  std::unique_ptr<std::FILE,int(*)(std::FILE *)>
+    in(std::fopen(filepath.c_str(),"rb"),&std::fclose);
+  BOOST_REQUIRE(in);
+
+  dsv_reader_t reader;
+  BOOST_REQUIRE(dsv_reader_open(&reader,"reader_stream",in.get(),parser) == 0);
+  std::shared_ptr<dsv_reader_t> reader_sentry(&reader,reader_close);
+
+  const unsigned char * const *header_fields;
+  const size_t *header_lengths;
+  size_t header_size;
+
+  BOOST_REQUIRE(dsv_reader_header(reader,&header_fields,&header_lengths,
+    &header_size) == 1);
+  BOOST_REQUIRE(header_size == 2);
+
+  const unsigned char * const *fields;
+  const size_t *lengths;
+  size_t size;
+
+  BOOST_REQUIRE(dsv_reader_next(reader,&fields,&lengths,&size) == 1);
+  BOOST_REQUIRE(size == 2 && lengths[0] == 1 && fields[0][0] == 'c'
+    && lengths[1] == 1 && fields[1][0] == 'd');
+
+  BOOST_REQUIRE(dsv_reader_next(reader,&fields,&lengths,&size) == 1);
+  BOOST_REQUIRE(size == 2 && lengths[0] == 1 && fields[0][0] == 'e'
+    && lengths[1] == 1 && fields[1][0] == 'f');
+
+  BOOST_REQUIRE(dsv_reader_next(reader,&fields,&lengths,&size) == 0);
+  BOOST_REQUIRE(dsv_reader_next(reader,&fields,&lengths,&size) == 0);
+
+  BOOST_REQUIRE(header_lengths[0] == 1 && header_fields[0][0] == 'a'
+    && header_lengths[1] == 1 && header_fields[1][0] == 'b');
+
+  BOOST_REQUIRE_MESSAGE(std::fgetc(in.get()) == EOF && !std::ferror(in.get()),
+    "dsv_reader did not read the caller's stream to the end");
+
+  fs::remove(filepath);
+}
+
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,644 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <algorithm>
+
+/** \file
+ *  \brief Tests for delivering records in batches and by column
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+/*
+    Unpack each batch back into records and keep track of the batch sizes
+ */
+struct batch_context {
+  std::vector<std::vector<d::field_storage_type> > parsed_records;
+  std::vector<std::size_t> batch_sizes;
+  std::vector<std::size_t> batch_bytes;
+
+  // number of batches to accept before asking the parser to stop
+  std::size_t stop_after;
+
+  batch_context(void) :stop_after(0) {}
+};
+
+static int batch_callback(const unsigned char *fields[],
+  const size_t lengths[], const size_t offsets[], size_t size,
+  void *_context)
+{
+  batch_context &context = *static_cast<batch_context*>(_context);
+
+  BOOST_REQUIRE_MESSAGE(size > 0,"Batch callback called with no records");
+  BOOST_REQUIRE_MESSAGE(offsets[0] == 0,
+    "First record of batch does not start at field 0");
+
+  std::size_t bytes = 0;
+  for(std::size_t r=0; r<size; ++r) {
+    std::vector<d::field_storage_type> row;
+    for(std::size_t i=offsets[r]; i<offsets[r+1]; ++i) {
+      row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+      bytes += lengths[i];
+    }
+
+    context.parsed_records.push_back(row);
+  }
+
+  context.batch_sizes.push_back(size);
+  context.batch_bytes.push_back(bytes);
+
+  return !(context.stop_after
+    && context.batch_sizes.size() == context.stop_after);
+}
+
+/*
+    Transpose each column batch back into records
+ */
+struct column_context {
+  std::vector<std::vector<d::field_storage_type> > parsed_records;
+  std::vector<std::size_t> batch_rows;
+  std::vector<std::size_t> batch_columns;
+};
+
+static int column_callback(const dsv_column_t columns[], size_t size,
+  size_t rows, void *_context)
+{
+  column_context &context = *static_cast<column_context*>(_context);
+
+  BOOST_REQUIRE_MESSAGE(rows > 0,"Column batch callback called with no rows");
+
+  std::size_t first = context.parsed_records.size();
+  context.parsed_records.resize(first+rows);
+
+  for(std::size_t c=0; c<size; ++c) {
+    const dsv_column_t &column = columns[c];
+
+    BOOST_REQUIRE_MESSAGE(column.offsets[0] == 0,
+      "Column " << c << " does not start at offset 0");
+
+    for(std::size_t r=0; r<rows; ++r) {
+      BOOST_REQUIRE(column.offsets[r] <= column.offsets[r+1]);
+      context.parsed_records[first+r].push_back(d::field_storage_type(
+        column.data+column.offsets[r],column.data+column.offsets[r+1]));
+    }
+  }
+
+  context.batch_rows.push_back(rows);
+  context.batch_columns.push_back(size);
+
+  return 1;
+}
+
+/*
+    Export each column batch and keep the exported structures
+ */
+struct arrow_context {
+  dsv_operations_t operations;
+  dsv_arrow_type type;
+
+  std::vector<ArrowSchema> schemas;
+  std::vector<ArrowArray> arrays;
+  std::vector<int> second_export;
+
+  // the column data pointers passed to the callback
+  std::vector<std::vector<const unsigned char *> > column_data;
+};
+
+static int arrow_callback(const dsv_column_t columns[], size_t size,
+  size_t rows, void *_context)
+{
+  arrow_context &context = *static_cast<arrow_context*>(_context);
+
+  ArrowSchema schema;
+  ArrowArray array;
+  int result = dsv_column_batch_export(context.operations,context.type,
+    &schema,&array);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_column_batch_export failed: " << result);
+
+  context.schemas.push_back(schema);
+  context.arrays.push_back(array);
+
+  // a batch can only be exported once
+  ArrowSchema again_schema;
+  ArrowArray again_array;
+  context.second_export.push_back(dsv_column_batch_export(context.operations,
+    context.type,&again_schema,&again_array));
+
+  std::vector<const unsigned char *> data;
+  for(std::size_t c=0; c<size; ++c)
+    data.push_back(columns[c].data);
+  context.column_data.push_back(data);
+
+  return 1;
+}
+
+/*
+    Parse contents through the record callback and return the records
+ */
+inline std::vector<std::vector<d::field_storage_type> >
+parse_records(dsv_parser_t parser, const fs::path &filepath)
+{
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = d::stream_parse(filepath,parser,operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse with a record callback failed: " << result);
+
+  return context.parsed_records;
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_record_batch_suite )
+
+/** \test Batches hold the same records as individual record callbacks
+ *  regardless of the limits and respect them
+ */
+BOOST_AUTO_TEST_CASE( record_batch_limits )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  // allow the empty record below
+  dsv_parser_set_field_columns(parser,-1);
+
+  std::string raw =
+    "h1,h2,h3\r\n"
+    "a,b,c\r\n"
+    "\"d\"\"\",\"e\r\nf\",g\r\n"
+    "\r\n"
+    "hijk,lm,n\r\n"
+    "o,,p\r\n"
+    ",,\r\n"
+    "qrstuvwxyz,0,1\r\n"
+    "2,3,4";
+
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(raw.begin(),raw.end())},"record_batch_limits");
+
+  std::vector<std::vector<d::field_storage_type> > records =
+    parse_records(parser,filepath);
+
+  BOOST_REQUIRE_MESSAGE(records.size() == 8,
+    "Unexpected number of records " << records.size());
+
+  struct limit {
+    std::size_t records;
+    std::size_t bytes;
+  };
+
+  const limit limits[] = {
+    {1,0},{3,0},{8,0},{100,0},{0,0},{0,5},{0,1},{2,4},{1024,1024*1024}
+  };
+
+  for(std::size_t l=0; l<sizeof(limits)/sizeof(limits[0]); ++l) {
+    dsv_operations_t operations;
+    assert(dsv_operations_create(&operations) == 0);
+    std::shared_ptr<dsv_operations_t>
+      operations_sentry(&operations,detail::operations_destroy);
+
+    batch_context context;
+    dsv_set_record_batch_callback(batch_callback,&context,operations);
+    dsv_set_record_batch_size(limits[l].records,operations);
+    dsv_set_record_batch_bytes(limits[l].bytes,operations);
+
+    // a record callback must not be called while batching
+    d::file_context unused;
+    dsv_set_record_callback(d::record_callback,&unused,operations);
+
+    int result = d::stream_parse(filepath,parser,operations);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse failed with batch limits "
+      << limits[l].records << "/" << limits[l].bytes << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+      "Batched records differ with batch limits " << limits[l].records << "/"
+      << limits[l].bytes << "\n" << d::output_fields(records,
+        context.parsed_records));
+
+    BOOST_REQUIRE_MESSAGE(unused.parsed_records.empty(),
+      "Record callback called while batching");
+
+    for(std::size_t b=0; b<context.batch_sizes.size(); ++b) {
+      bool last = (b+1 == context.batch_sizes.size());
+
+      if(limits[l].records) {
+        BOOST_REQUIRE_MESSAGE(context.batch_sizes[b] <= limits[l].records,
+          "Batch " << b << " has " << context.batch_sizes[b]
+            << " records, limit " << limits[l].records);
+      }
+
+      // all but the last batch are passed on as soon as a limit is reached
+      if(!last) {
+        bool full = (limits[l].records
+            && context.batch_sizes[b] == limits[l].records)
+          || (limits[l].bytes && context.batch_bytes[b] >= limits[l].bytes);
+
+        BOOST_REQUIRE_MESSAGE(full,"Batch " << b
+          << " passed on before reaching a limit");
+      }
+    }
+  }
+}
+
+/** \test Returning 0 from the batch callback stops the parse
+ */
+BOOST_AUTO_TEST_CASE( record_batch_stop )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string raw = "a,b\r\nc,d\r\ne,f\r\ng,h\r\ni,j\r\n";
+
+  batch_context context;
+  context.stop_after = 1;
+  dsv_set_record_batch_callback(batch_callback,&context,operations);
+  dsv_set_record_batch_size(2,operations);
+
+  int result = dsv_parse_buffer("record_batch_stop",
+    reinterpret_cast<const unsigned char *>(raw.data()),raw.size(),parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "dsv_parse_buffer did not fail when the batch callback returned 0: "
+      << result);
+
+  BOOST_REQUIRE_MESSAGE(context.batch_sizes.size() == 1
+    && context.batch_sizes[0] == 2,
+    "Batch callback called again after returning 0");
+}
+
+/** \test Records that precede a parse error are still delivered
+ */
+BOOST_AUTO_TEST_CASE( record_batch_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  // the last record has the wrong number of columns
+  std::string raw = "a,b\r\nc,d\r\ne,f\r\ng\r\n";
+
+  batch_context context;
+  dsv_set_record_batch_callback(batch_callback,&context,operations);
+
+  int result = dsv_parse_buffer("record_batch_error",
+    reinterpret_cast<const unsigned char *>(raw.data()),raw.size(),parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "dsv_parse_buffer did not fail on the column count: " << result);
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'c'},{'d'}},
+    {{'e'},{'f'}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+    "Records before the error were not delivered\n"
+      << d::output_fields(records,context.parsed_records));
+}
+
+/** \test Batches span incremental input
+ */
+BOOST_AUTO_TEST_CASE( record_batch_feed )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string raw = "h,i\r\nab,\"c\"\"d\"\r\n\"e\r\nf\",gh\r\nij,kl\r\n";
+
+  batch_context context;
+  dsv_set_record_batch_callback(batch_callback,&context,operations);
+  dsv_set_record_batch_size(2,operations);
+
+  // one byte at a time so that every token is split
+  for(std::size_t i=0; i<raw.size(); ++i) {
+    int result = dsv_parser_feed(parser,operations,
+      reinterpret_cast<const unsigned char *>(raw.data())+i,1);
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "dsv_parser_feed failed at byte " << i << ": " << result);
+  }
+
+  int result = dsv_parser_finish(parser,operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parser_finish failed: " << result);
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'a','b'},{'c','"','d'}},
+    {{'e',0x0D,0x0A,'f'},{'g','h'}},
+    {{'i','j'},{'k','l'}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+    "Fed records differ\n" << d::output_fields(records,context.parsed_records));
+
+  std::vector<std::size_t> batch_sizes{2,1};
+  BOOST_REQUIRE_MESSAGE(context.batch_sizes == batch_sizes,
+    "Unexpected batch sizes");
+}
+
+/** \test Column batches hold the same fields as individual record callbacks
+ */
+BOOST_AUTO_TEST_CASE( column_batch_records )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::string raw =
+    "h1,h2,h3\r\n"
+    "a,b,c\r\n"
+    "\"d\"\"\",\"e\r\nf\",g\r\n"
+    "hijk,lm,n\r\n"
+    "o,,p\r\n"
+    ",,\r\n"
+    "qrstuvwxyz,0,1\r\n"
+    "2,3,4";
+
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(raw.begin(),raw.end())},"column_batch_records");
+
+  std::vector<std::vector<d::field_storage_type> > records =
+    parse_records(parser,filepath);
+
+  const std::size_t sizes[] = {1,3,7,0};
+
+  for(std::size_t l=0; l<sizeof(sizes)/sizeof(sizes[0]); ++l) {
+    dsv_operations_t operations;
+    assert(dsv_operations_create(&operations) == 0);
+    std::shared_ptr<dsv_operations_t>
+      operations_sentry(&operations,detail::operations_destroy);
+
+    column_context context;
+    dsv_set_column_batch_callback(column_callback,&context,operations);
+    dsv_set_record_batch_size(sizes[l],operations);
+
+    // neither row callback may be called in column mode
+    d::file_context unused;
+    dsv_set_record_callback(d::record_callback,&unused,operations);
+    batch_context unused_batch;
+    dsv_set_record_batch_callback(batch_callback,&unused_batch,operations);
+
+    int result = d::stream_parse(filepath,parser,operations);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse failed with batch size "
+      << sizes[l] << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+      "Column batch records differ with batch size " << sizes[l] << "\n"
+      << d::output_fields(records,context.parsed_records));
+
+    BOOST_REQUIRE_MESSAGE(unused.parsed_records.empty()
+      && unused_batch.parsed_records.empty(),
+      "Row callback called in column mode");
+
+    for(std::size_t b=0; b+1<context.batch_rows.size(); ++b) {
+      BOOST_REQUIRE_MESSAGE(context.batch_rows[b] == sizes[l],
+        "Batch " << b << " has " << context.batch_rows[b] << " rows");
+    }
+  }
+}
+
+/** \test Records with differing numbers of fields are padded with empty
+ *  values
+ */
+BOOST_AUTO_TEST_CASE( column_batch_ragged )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string raw = "h\r\na\r\nb,c\r\n\r\nd,e,f\r\ng\r\n";
+
+  column_context context;
+  dsv_set_column_batch_callback(column_callback,&context,operations);
+  dsv_set_record_batch_size(3,operations);
+
+  int result = dsv_parse_buffer("column_batch_ragged",
+    reinterpret_cast<const unsigned char *>(raw.data()),raw.size(),parser,
+    operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "dsv_parse_buffer failed: " << result);
+
+  std::vector<std::vector<d::field_storage_type> > records{
+    {{'a'},{}},
+    {{'b'},{'c'}},
+    {{},{}},
+    {{'d'},{'e'},{'f'}},
+    {{'g'},{},{}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+    "Ragged records differ\n"
+      << d::output_fields(records,context.parsed_records));
+
+  std::vector<std::size_t> batch_columns{2,3};
+  BOOST_REQUIRE_MESSAGE(context.batch_columns == batch_columns,
+    "Unexpected number of columns per batch");
+}
+
+/** \test The columns of one parse do not carry over to the next
+ */
+BOOST_AUTO_TEST_CASE( column_batch_reparse )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  column_context context;
+  dsv_set_column_batch_callback(column_callback,&context,operations);
+
+  std::string wide = "a,b,c\r\nd,e,f\r\n";
+  std::string narrow = "a\r\nb\r\n";
+
+  int result = dsv_parse_buffer("column_batch_reparse",
+    reinterpret_cast<const unsigned char *>(wide.data()),wide.size(),parser,
+    operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+  result = dsv_parse_buffer("column_batch_reparse",
+    reinterpret_cast<const unsigned char *>(narrow.data()),narrow.size(),
+    parser,operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+  std::vector<std::size_t> batch_columns{3,1};
+  BOOST_REQUIRE_MESSAGE(context.batch_columns == batch_columns,
+    "Columns carried over between parses");
+}
+
+/** \test Column batches export through the Arrow C Data Interface without
+ *  copying the columns
+ */
+BOOST_AUTO_TEST_CASE( column_batch_arrow_export )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  std::string raw = "name,value\r\na,1\r\n\"b\"\"\",\r\nc,3,x\r\n";
+
+  const dsv_arrow_type types[] = {dsv_arrow_large_utf8,dsv_arrow_large_binary};
+  const char *formats[] = {"U","Z"};
+
+  for(std::size_t t=0; t<2; ++t) {
+    arrow_context context;
+    context.operations = operations;
+    context.type = types[t];
+
+    dsv_set_column_batch_callback(arrow_callback,&context,operations);
+    dsv_set_record_batch_size(2,operations);
+
+    int result = dsv_parse_buffer("column_batch_arrow_export",
+      reinterpret_cast<const unsigned char *>(raw.data()),raw.size(),parser,
+      operations);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.arrays.size() == 2,
+      "Unexpected number of batches " << context.arrays.size());
+
+    std::vector<int> second_export{EINVAL,EINVAL};
+    BOOST_REQUIRE_MESSAGE(context.second_export == second_export,
+      "A column batch was exported twice");
+
+    // outside of the callback
+    ArrowSchema schema;
+    ArrowArray array;
+    BOOST_REQUIRE_MESSAGE(dsv_column_batch_export(operations,types[t],
+      &schema,&array) == EINVAL,"Column batch exported outside the callback");
+
+    std::vector<std::vector<std::string> > names{
+      {"name","value"},
+      {"name","value","2"}
+    };
+
+    std::vector<std::vector<std::vector<std::string> > > values{
+      {{"a","b\""},{"1",""}},
+      {{"c"},{"3"},{"x"}}
+    };
+
+    for(std::size_t b=0; b<2; ++b) {
+      ArrowSchema &schema = context.schemas[b];
+      ArrowArray &array = context.arrays[b];
+
+      BOOST_REQUIRE(std::string(schema.format) == "+s");
+      BOOST_REQUIRE(schema.n_children == int64_t(names[b].size()));
+      BOOST_REQUIRE(array.n_children == schema.n_children);
+      BOOST_REQUIRE(array.length == int64_t(values[b][0].size()));
+      BOOST_REQUIRE(array.null_count == 0 && array.n_buffers == 1);
+
+      for(std::size_t c=0; c<names[b].size(); ++c) {
+        const ArrowSchema &child_schema = *schema.children[c];
+        const ArrowArray &child = *array.children[c];
+
+        BOOST_REQUIRE_MESSAGE(std::string(child_schema.format) == formats[t],
+          "Unexpected child format " << child_schema.format);
+        BOOST_REQUIRE_MESSAGE(child_schema.name == names[b][c],
+          "Unexpected column name " << child_schema.name);
+
+        BOOST_REQUIRE(child.length == array.length);
+        BOOST_REQUIRE(child.null_count == 0 && child.n_buffers == 3);
+        BOOST_REQUIRE(child.buffers[0] == 0);
+
+        const int64_t *offsets = static_cast<const int64_t *>(child.buffers[1]);
+        const char *data = static_cast<const char *>(child.buffers[2]);
+
+        BOOST_REQUIRE_MESSAGE(reinterpret_cast<const unsigned char *>(data)
+            == context.column_data[b][c],
+          "Column " << c << " of batch " << b << " was copied");
+
+        for(int64_t r=0; r<child.length; ++r) {
+          std::string value(data+offsets[r],data+offsets[r+1]);
+          BOOST_REQUIRE_MESSAGE(value == values[b][c][r],
+            "Unexpected value '" << value << "' in column " << c << " row "
+              << r << " of batch " << b);
+        }
+      }
+    }
+
+    // move the first child of the first batch out and release it last
+    ArrowArray moved = *context.arrays[0].children[0];
+    context.arrays[0].children[0]->release = 0;
+
+    for(std::size_t b=0; b<2; ++b) {
+      context.schemas[b].release(&context.schemas[b]);
+      BOOST_REQUIRE(context.schemas[b].release == 0);
+
+      context.arrays[b].release(&context.arrays[b]);
+      BOOST_REQUIRE(context.arrays[b].release == 0);
+    }
+
+    const int64_t *offsets = static_cast<const int64_t *>(moved.buffers[1]);
+    const char *data = static_cast<const char *>(moved.buffers[2]);
+    BOOST_REQUIRE_MESSAGE(std::string(data+offsets[0],data+offsets[2]) == "ab\"",
+      "Moved child did not outlive its parent");
+
+    moved.release(&moved);
+    BOOST_REQUIRE(moved.release == 0);
+  }
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,160 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <cstdio>
+
+/** \file
+ *  \brief Tests for counting records without parsing
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+/*
+    Count the records and fields of contents both by opening the file and
+    through a stream and compare them to those of a parse
+ */
+inline void check_count(dsv_parser_t parser, const std::string &contents,
+  const std::string &label)
+{
+  fs::path filepath = d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},label);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parse(filepath.c_str(),0,parser,operations);
+  BOOST_REQUIRE_MESSAGE(result == 0,label << ": parse failed: " << result);
+
+  std::size_t expected_fields = 0;
+  for(std::size_t i=0; i<context.parsed_records.size(); ++i)
+    expected_fields += context.parsed_records[i].size();
+
+  for(int source=0; source<2; ++source) {
+    std::shared_ptr<FILE> in;
+    if(source == 1) {
+      in.reset(std::fopen(filepath.c_str(),"rb"),&std::fclose);
+      BOOST_REQUIRE(in);
+    }
+
+    std::size_t records = 99;
+    std::size_t fields = 99;
+    result = dsv_count_records(filepath.c_str(),in.get(),parser,&records,
+      &fields);
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      label << ": count failed for source " << source << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(records == context.parsed_records.size(),
+      label << ": counted " << records << " records rather than "
+        << context.parsed_records.size() << " for source " << source);
+
+    BOOST_REQUIRE_MESSAGE(fields == expected_fields,
+      label << ": counted " << fields << " fields rather than "
+        << expected_fields << " for source " << source);
+  }
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_record_count_suite )
+
+/** \test Counts agree with a parse for each kind of newline, escaped
+ *  content and empty records
+ */
+BOOST_AUTO_TEST_CASE( record_count_matches_parse )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  const std::vector<std::string> contents{
+    "",
+    "a,b,c",
+    "a,b,c\r\n",
+    "a,b,c\r\n1,2,3\r\n4,5,6",
+    "a,b,c\r\n1,2,3\r\n4,5,6\r\n",
+    "a,b,c\n1,2,3\n4,5,6\n",
+    "a,b\r\n\"x,\r\ny\",\"z\"\"\r\n\"\r\n,\r\n",
+    "a,b\n\n1,2\n\n\n3\n",
+    "\r\n1,2\r\n3,4\r\n",
+    "a\r\n\"\r\n\"\r\n\r\nb\r\n",
+    "a,b\r\n1,\"2\r\n3\r\n4,\"\"5\"\"\"\r\n"
+  };
+
+  for(std::size_t i=0; i<contents.size(); ++i)
+    check_count(parser,contents[i],"record_count_" + std::to_string(i));
+
+  // a different delimiter
+  dsv_parser_set_field_delimiter(parser,'|');
+  check_count(parser,"a|b\r\n1,2|3\r\n\"4|\"|5|6\r\n","record_count_delimiter");
+}
+
+/** \test The newline behavior of the parser is followed
+ */
+BOOST_AUTO_TEST_CASE( record_count_newlines )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  // LF only, a bare CR is allowed in escaped binary content
+  dsv_parser_allow_escaped_binary_fields(parser,1);
+  BOOST_REQUIRE(dsv_parser_set_newline_behavior(parser,
+    dsv_newline_lf_strict) == 0);
+  check_count(parser,"a,b\n\"1\r\",2\n3,4\n","record_count_lf");
+
+  // CRLF only, a bare LF is allowed in escaped binary content
+  BOOST_REQUIRE(dsv_parser_set_newline_behavior(parser,
+    dsv_newline_crlf_strict) == 0);
+  check_count(parser,"a,b\r\n\"1\n\",2\r\n3,4\r\n","record_count_crlf");
+
+  // permissive settles at the first newline
+  BOOST_REQUIRE(dsv_parser_set_newline_behavior(parser,
+    dsv_newline_permissive) == 0);
+  check_count(parser,"a,b\r\n\"1\n\",2\r\n3,4\r\n","record_count_settled");
+}
+
+/** \test A missing file is reported
+ */
+BOOST_AUTO_TEST_CASE( record_count_missing_file )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::size_t records = 0;
+  int result = dsv_count_records("/nonexistent/record_count",0,parser,
+    &records,0);
+
+  BOOST_REQUIRE_MESSAGE(result == ENOENT,
+    "dsv_count_records did not return ENOENT: " << result);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,301 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+
+/** \file
+ *  \brief Tests for skipping records and limiting the records passed on
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+inline d::field_storage_type field(const std::string &str)
+{
+  return d::field_storage_type(str.begin(),str.end());
+}
+
+static const std::string range_file =
+  "id,text\r\n"
+  "1,one\r\n"
+  "2,\"two\r\n,\"\"still two\"\"\r\n\"\r\n"
+  "3,three\r\n"
+  "\r\n"
+  "5,\"five\"\r\n"
+  "6,six\r\n";
+
+inline matrix_type range_file_records(void)
+{
+  return matrix_type{
+    {field("1"),field("one")},
+    {field("2"),field("two\r\n,\"still two\"\r\n")},
+    {field("3"),field("three")},
+    {},
+    {field("5"),field("five")},
+    {field("6"),field("six")}
+  };
+}
+
+/*
+    The records [first,first+count) of matrix
+ */
+inline matrix_type slice(const matrix_type &matrix, std::size_t first,
+  std::size_t count)
+{
+  first = std::min(first,matrix.size());
+  std::size_t last = std::min(first+count,matrix.size());
+
+  return matrix_type(matrix.begin()+first,matrix.begin()+last);
+}
+
+/*
+    Parse contents from a buffer, a stream and a byte at a time through
+    dsv_parser_feed. Each must produce the header and records
+ */
+inline void check_range(dsv_parser_t parser, dsv_operations_t operations,
+  const std::string &contents, const matrix_type &headers,
+  const matrix_type &records, const std::string &label)
+{
+  fs::path filepath = d::gen_testfile({field(contents)},label);
+
+  for(int source=0; source<3; ++source) {
+    d::file_context context;
+    dsv_set_header_callback(d::header_callback,&context,operations);
+    dsv_set_record_callback(d::record_callback,&context,operations);
+
+    const unsigned char *data =
+      reinterpret_cast<const unsigned char *>(contents.data());
+
+    int result = 0;
+    switch(source) {
+      case 0:
+        result = dsv_parse_buffer(label.c_str(),data,contents.size(),parser,
+          operations);
+        break;
+
+      case 1:
+        result = d::stream_parse(filepath,parser,operations);
+        break;
+
+      case 2:
+        for(std::size_t i=0; i<contents.size() && result == 0; ++i)
+          result = dsv_parser_feed(parser,operations,data+i,1);
+        if(result == 0)
+          result = dsv_parser_finish(parser,operations);
+        break;
+    }
+
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      label << ": parse failed for source " << source << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_headers == headers,
+      label << ": header differs for source " << source << "\n"
+        << d::output_fields(headers,context.parsed_headers));
+
+    BOOST_REQUIRE_MESSAGE(context.parsed_records == records,
+      label << ": records differ for source " << source << "\n"
+        << d::output_fields(records,context.parsed_records));
+  }
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_record_range_suite )
+
+/** \test Every combination of skip and limit, including skipping escaped
+ *  newlines and empty records
+ */
+BOOST_AUTO_TEST_CASE( record_range_combinations )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  matrix_type headers{{field("id"),field("text")}};
+  matrix_type records = range_file_records();
+
+  for(std::size_t skip=0; skip<=records.size()+1; ++skip) {
+    for(std::size_t max=0; max<=records.size()+1; ++max) {
+      dsv_parser_set_skip_records(parser,skip);
+      dsv_parser_set_max_records(parser,max);
+
+      check_range(parser,operations,range_file,headers,
+        slice(records,skip,(max ? max : records.size())),
+        "record_range_" + std::to_string(skip) + "_" + std::to_string(max));
+    }
+  }
+}
+
+/** \test Skipping follows the newline behavior and an unterminated last
+ *  record
+ */
+BOOST_AUTO_TEST_CASE( record_range_newlines )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  dsv_parser_set_skip_records(parser,2);
+
+  // LF only, the CR in the skipped record is content
+  check_range(parser,operations,"a,b\nx,\"1\n2\"\ny,\rz\nw,5",
+    {{field("a"),field("b")}},{{field("w"),field("5")}},"record_range_lf");
+
+  dsv_parser_set_skip_records(parser,1);
+  dsv_parser_set_max_records(parser,1);
+
+  check_range(parser,operations,"a,b\r\nx,\"1\n2\"\r\nw,5\r\nv,6",
+    {{field("a"),field("b")}},{{field("w"),field("5")}},"record_range_crlf");
+
+  // skipping everything including an unterminated record
+  dsv_parser_set_skip_records(parser,3);
+  dsv_parser_set_max_records(parser,0);
+
+  check_range(parser,operations,"a,b\r\nx,1\r\nw,5\r\nv,\"6",
+    {{field("a"),field("b")}},{},"record_range_unterminated");
+
+  // without a header
+  dsv_parser_set_skip_records(parser,1);
+  dsv_parser_set_field_columns(parser,-1);
+
+  check_range(parser,operations,"\r\nx,1\r\nw,5\r\n",{{}},
+    {{field("w"),field("5")}},"record_range_no_header");
+}
+
+/** \test The limit counts the records passed on after filtering and flushes
+ *  the pending batch
+ */
+BOOST_AUTO_TEST_CASE( record_range_batches )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+  dsv_parser_set_skip_records(parser,1);
+  dsv_parser_set_max_records(parser,2);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  const unsigned char prefix[] = {'t'};
+  BOOST_REQUIRE(dsv_operations_add_predicate_prefix(operations,1,prefix,1)
+    == 0);
+  dsv_set_record_batch_size(10,operations);
+
+  struct batches {
+    static int callback(const unsigned char *fields[], const size_t lengths[],
+      const size_t offsets[], size_t size, void *_context)
+    {
+      matrix_type &parsed = *static_cast<matrix_type*>(_context);
+
+      for(std::size_t r=0; r<size; ++r) {
+        std::vector<d::field_storage_type> row;
+        for(std::size_t i=offsets[r]; i<offsets[r+1]; ++i)
+          row.push_back(d::field_storage_type(fields[i],fields[i]+lengths[i]));
+        parsed.push_back(row);
+      }
+
+      return 1;
+    }
+  };
+
+  matrix_type parsed;
+  dsv_set_record_batch_callback(&batches::callback,&parsed,operations);
+
+  // the trailing garbage is never reached
+  std::string contents = range_file + "7,\"bad\"x\r\n";
+
+  int result = dsv_parse_buffer("record_range_batches",
+    reinterpret_cast<const unsigned char *>(contents.data()),contents.size(),
+    parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,"dsv_parse_buffer failed: " << result);
+
+  matrix_type records = range_file_records();
+  matrix_type expected{records[1],records[2]};
+  BOOST_REQUIRE_MESSAGE(parsed == expected,
+    "Limited batches differ\n" << d::output_fields(expected,parsed));
+}
+
+
+/** \test Input fed after the limit is reached is ignored rather than kept
+ */
+BOOST_AUTO_TEST_CASE( record_range_feed_after_limit )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+  dsv_parser_set_max_records(parser,2);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_header_callback(d::header_callback,&context,operations);
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  const unsigned char *data =
+    reinterpret_cast<const unsigned char *>(range_file.data());
+  BOOST_REQUIRE(dsv_parser_feed(parser,operations,data,range_file.size())
+    == 0);
+
+  matrix_type expected = slice(range_file_records(),0,2);
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == expected,
+    "Limited records differ\n"
+      << d::output_fields(expected,context.parsed_records));
+
+  // more records and content that would not parse are never looked at
+  std::string more = range_file + "7,\"bad\"x\r\n";
+  const unsigned char *more_data =
+    reinterpret_cast<const unsigned char *>(more.data());
+  for(int i=0; i<1000; ++i) {
+    int result = dsv_parser_feed(parser,operations,more_data,more.size());
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "dsv_parser_feed after the limit failed: " << result);
+  }
+
+  BOOST_REQUIRE(dsv_parser_finish(parser,operations) == 0);
+
+  BOOST_REQUIRE_EQUAL(context.parsed_headers.size(),1);
+  BOOST_REQUIRE_MESSAGE(context.parsed_records == expected,
+    "Records passed on after the limit\n"
+      << d::output_fields(expected,context.parsed_records));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,317 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+/** \file
+ *  \brief Tests for dividing a file into parts at record boundaries
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+typedef std::vector<std::vector<d::field_storage_type> > matrix_type;
+
+/*
+    The mixed records of every test of a divided parse, without empty or
+    short records, and some escaped fields long enough to span several parts
+ */
+inline std::string split_contents(const std::string &newline)
+{
+  std::string contents = "id,text,value" + newline;
+  for(std::size_t i=0; contents.size() < 256*1024; ++i) {
+    d::append_mixed_record(contents,i,newline,false);
+
+    if(i == 100 || i == 3000) {
+      std::string id = std::to_string(i);
+
+      contents += id + ",\"";
+      for(std::size_t j=0; j<2000; ++j)
+        contents += "long \"\"" + id + "\"\"," + newline;
+      contents += "\",y" + newline;
+    }
+  }
+
+  return contents;
+}
+
+inline std::string file_contents(const fs::path &filepath)
+{
+  std::ifstream in(filepath.c_str(),std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+}
+
+/*
+    The records of contents
+ */
+inline matrix_type parse_records(const std::string &contents,
+  dsv_parser_t parser, const std::string &label)
+{
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  d::file_context context;
+  dsv_set_record_callback(d::record_callback,&context,operations);
+
+  int result = dsv_parse_buffer(label.c_str(),
+    reinterpret_cast<const unsigned char *>(contents.data()),contents.size(),
+    parser,operations);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    label << ": parse failed: " << result);
+
+  return context.parsed_records;
+}
+
+/*
+    The parts of contents found by dsv_split must adjoin, cover the file and
+    each parse to the records of the file they hold
+ */
+inline void check_split(const std::string &contents, dsv_parser_t parser,
+  const std::string &label)
+{
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      label);
+
+  matrix_type expected = parse_records(contents,parser,label);
+
+  const std::size_t counts[] = {1,2,3,7,16};
+  for(std::size_t c=0; c<sizeof(counts)/sizeof(std::size_t); ++c) {
+    std::size_t n = counts[c];
+
+    std::vector<dsv_byte_range_t> with_header(n);
+    std::size_t parts = 0;
+    int err = dsv_split(filepath.c_str(),n,dsv_split_default,parser,
+      with_header.data(),&parts);
+    BOOST_REQUIRE_MESSAGE(err == 0,label << ": dsv_split failed: " << err);
+    BOOST_REQUIRE(parts > 0 && parts <= n);
+    with_header.resize(parts);
+
+    std::vector<dsv_byte_range_t> records(n);
+    std::size_t record_parts = 0;
+    err = dsv_split(filepath.c_str(),n,dsv_split_after_header,parser,
+      records.data(),&record_parts);
+    BOOST_REQUIRE_MESSAGE(err == 0,label << ": dsv_split failed: " << err);
+    BOOST_REQUIRE_EQUAL(record_parts,parts);
+    records.resize(record_parts);
+
+    std::string header = contents.substr(0,records[0].offset);
+
+    BOOST_REQUIRE_EQUAL(with_header[0].offset,0);
+    BOOST_REQUIRE_EQUAL(with_header[0].line,1);
+    BOOST_REQUIRE_EQUAL(with_header[0].length,
+      header.size() + records[0].length);
+
+    matrix_type parsed;
+    for(std::size_t i=0; i<parts; ++i) {
+      const dsv_byte_range_t &range = records[i];
+
+      if(i > 0) {
+        BOOST_REQUIRE_EQUAL(range.offset,
+          records[i-1].offset + records[i-1].length);
+        BOOST_REQUIRE_EQUAL(with_header[i].offset,range.offset);
+        BOOST_REQUIRE_EQUAL(with_header[i].length,range.length);
+      }
+
+      std::string part = contents.substr(range.offset,range.length);
+
+      std::size_t line = 1 + std::count(contents.begin(),
+        contents.begin()+range.offset,'\n');
+      BOOST_REQUIRE_MESSAGE(range.line == line,
+        label << ": part " << i << " of " << n << " starts on line "
+          << range.line << " rather than " << line);
+
+      matrix_type part_records = parse_records(header + part,parser,label);
+      parsed.insert(parsed.end(),part_records.begin(),part_records.end());
+    }
+
+    BOOST_REQUIRE_EQUAL(records.back().offset + records.back().length,
+      contents.size());
+
+    BOOST_REQUIRE_MESSAGE(parsed == expected,
+      label << ": the records of " << n << " parts differ ("
+        << parsed.size() << " rather than " << expected.size() << ")");
+  }
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE( api_split_suite )
+
+/** \test Parts end at record boundaries for each newline behavior
+ */
+BOOST_AUTO_TEST_CASE( split_record_boundaries )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  check_split(split_contents("\r\n"),parser,"split_crlf_permissive");
+  check_split(split_contents("\n"),parser,"split_lf_permissive");
+
+  dsv_parser_set_newline_behavior(parser,dsv_newline_crlf_strict);
+  check_split(split_contents("\r\n"),parser,"split_crlf_strict");
+
+  dsv_parser_set_newline_behavior(parser,dsv_newline_lf_strict);
+  check_split(split_contents("\n"),parser,"split_lf_strict");
+}
+
+/** \test Short records give the number of parts asked for in about equal
+ *  sizes
+ */
+BOOST_AUTO_TEST_CASE( split_sizes )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::string contents = "a,b\r\n";
+  while(contents.size() < 100000)
+    contents += "1,\"x\r\ny\"\r\n";
+
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "split_sizes");
+
+  std::vector<dsv_byte_range_t> ranges(8);
+  std::size_t parts = 0;
+  BOOST_REQUIRE(dsv_split(filepath.c_str(),8,dsv_split_after_header,parser,
+    ranges.data(),&parts) == 0);
+  BOOST_REQUIRE_EQUAL(parts,8);
+
+  for(std::size_t i=0; i<parts; ++i) {
+    BOOST_REQUIRE_MESSAGE(ranges[i].length > contents.size()/8 - 16
+      && ranges[i].length < contents.size()/8 + 16,
+      "Part " << i << " holds " << ranges[i].length << " bytes");
+  }
+
+  fs::remove(filepath);
+}
+
+/** \test A file holding no records
+ */
+BOOST_AUTO_TEST_CASE( split_no_records )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::string header = "a,\"b\r\nc\"\r\n";
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(header.begin(),header.end())},
+      "split_header_only");
+
+  std::vector<dsv_byte_range_t> ranges(4);
+  std::size_t parts = 0;
+  BOOST_REQUIRE(dsv_split(filepath.c_str(),4,dsv_split_default,parser,
+    ranges.data(),&parts) == 0);
+  BOOST_REQUIRE_EQUAL(parts,1);
+  BOOST_REQUIRE_EQUAL(ranges[0].offset,0);
+  BOOST_REQUIRE_EQUAL(ranges[0].length,header.size());
+
+  BOOST_REQUIRE(dsv_split(filepath.c_str(),4,dsv_split_after_header,parser,
+    ranges.data(),&parts) == 0);
+  BOOST_REQUIRE_EQUAL(parts,0);
+
+  fs::remove(filepath);
+
+  filepath = d::gen_testfile({},"split_empty");
+  BOOST_REQUIRE(dsv_split(filepath.c_str(),4,dsv_split_default,parser,
+    ranges.data(),&parts) == 0);
+  BOOST_REQUIRE_EQUAL(parts,0);
+  fs::remove(filepath);
+
+  BOOST_REQUIRE(dsv_split("/this/file/does/not/exist",4,dsv_split_default,
+    parser,ranges.data(),&parts) == ENOENT);
+
+  // no parts at all is refused
+  BOOST_REQUIRE(dsv_split("/this/file/does/not/exist",0,dsv_split_default,
+    parser,ranges.data(),&parts) == EINVAL);
+  BOOST_REQUIRE_EQUAL(parts,0);
+}
+
+/** \test Writing the parts to files
+ */
+BOOST_AUTO_TEST_CASE( split_files )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  std::string contents = split_contents("\r\n");
+  fs::path filepath =
+    d::gen_testfile({d::field_storage_type(contents.begin(),contents.end())},
+      "split_files");
+
+  matrix_type expected = parse_records(contents,parser,"split_files");
+
+  const std::size_t n = 5;
+  std::vector<fs::path> shard_paths;
+  std::vector<const char *> paths;
+  for(std::size_t i=0; i<n; ++i) {
+    shard_paths.push_back(
+      d::gen_testfile({},"split_files_part_" + std::to_string(i)));
+  }
+  for(std::size_t i=0; i<n; ++i)
+    paths.push_back(shard_paths[i].c_str());
+
+  // the parts put back together are the file
+  std::size_t parts = 0;
+  int err = dsv_split_files(filepath.c_str(),n,dsv_split_default,parser,
+    paths.data(),&parts);
+  BOOST_REQUIRE_MESSAGE(err == 0,"dsv_split_files failed: " << err);
+  BOOST_REQUIRE(parts > 1 && parts <= n);
+
+  std::string joined;
+  for(std::size_t i=0; i<parts; ++i)
+    joined += file_contents(shard_paths[i]);
+
+  BOOST_REQUIRE_MESSAGE(joined == contents,"The parts differ from the file");
+
+  // each part is a complete file
+  err = dsv_split_files(filepath.c_str(),n,dsv_split_after_header,parser,
+    paths.data(),&parts);
+  BOOST_REQUIRE_MESSAGE(err == 0,"dsv_split_files failed: " << err);
+
+  matrix_type parsed;
+  for(std::size_t i=0; i<parts; ++i) {
+    std::string part = file_contents(shard_paths[i]);
+    BOOST_REQUIRE(part.compare(0,15,"id,text,value\r\n") == 0);
+
+    matrix_type part_records = parse_records(part,parser,"split_files");
+    parsed.insert(parsed.end(),part_records.begin(),part_records.end());
+  }
+
+  BOOST_REQUIRE_MESSAGE(parsed == expected,
+    "The records of the files differ (" << parsed.size() << " rather than "
+      << expected.size() << ")");
+
+  for(std::size_t i=0; i<n; ++i)
+    fs::remove(shard_paths[i]);
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
@@ -0,0 +1,193 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+
+/** \file
+ *  \brief Tests for checking content without parsing it into fields
+ */
+
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+inline fs::path gen_file(const std::string &contents, const std::string &label)
+{
+  return d::gen_testfile(
+    {d::field_storage_type(contents.begin(),contents.end())},label);
+}
+
+/*
+    The result and logs of a parse of filepath
+ */
+inline int parse_logs(dsv_parser_t parser, const fs::path &filepath,
+  d::logging_context &log_context)
+{
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+  return dsv_parse(filepath.c_str(),0,parser,operations);
+}
+
+static const std::string invalid_file =
+  "a,b\r\n"
+  "1,2\r\n"
+  "1,2,3\r\n"
+  "4,5\r\n"
+  "x\"y,1\r\n"
+  "\"ok\r\n\",2\r\n"
+  "\"\x01\",3\r\n"
+  "7,8\r\n";
+
+
+BOOST_AUTO_TEST_SUITE( api_validate_suite )
+
+/** \test Valid content passes with the same warnings as a parse
+ */
+BOOST_AUTO_TEST_CASE( validate_valid )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  fs::path filepath = gen_file("a,b\r\n1,\"2\r\n,\"\"\"\r\n3\r\n\r\n4,5\r\n",
+    "validate_valid");
+
+  d::logging_context parse_context;
+  BOOST_REQUIRE(parse_logs(parser,filepath,parse_context) == 0);
+
+  for(int flags=0; flags<2; ++flags) {
+    d::logging_context log_context;
+    dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+    int result = dsv_validate(filepath.c_str(),0,parser,flags);
+    BOOST_REQUIRE_MESSAGE(result == 0,
+      "dsv_validate failed for flags " << flags << ": " << result);
+
+    BOOST_REQUIRE_MESSAGE(
+      d::check_logs(parse_context.recd_logs,log_context.recd_logs),
+      "Did not receive the log messages of a parse:\n"
+        << d::compare_logs(parse_context.recd_logs,log_context.recd_logs));
+  }
+
+  fs::remove(filepath);
+}
+
+/** \test By default the first error is reported as by a parse
+ */
+BOOST_AUTO_TEST_CASE( validate_first_error )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  fs::path filepath = gen_file(invalid_file,"validate_first_error");
+
+  d::logging_context parse_context;
+  BOOST_REQUIRE(parse_logs(parser,filepath,parse_context) < 0);
+
+  d::logging_context log_context;
+  dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+  int result = dsv_validate(filepath.c_str(),0,parser,dsv_validate_default);
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "dsv_validate did not fail for invalid content: " << result);
+
+  BOOST_REQUIRE_MESSAGE(
+    d::check_logs(parse_context.recd_logs,log_context.recd_logs),
+    "Did not receive the log messages of a parse:\n"
+      << d::compare_logs(parse_context.recd_logs,log_context.recd_logs));
+
+  fs::remove(filepath);
+}
+
+/** \test Every offending record is reported, including those with escaped
+ *  newlines
+ */
+BOOST_AUTO_TEST_CASE( validate_all_errors )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  fs::path filepath = gen_file(invalid_file,"validate_all_errors");
+
+  d::logging_context log_context;
+  dsv_set_logger_callback(d::logger,&log_context,dsv_log_all,parser);
+
+  int result = dsv_validate(filepath.c_str(),0,parser,
+    dsv_validate_all_errors);
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "dsv_validate did not fail for invalid content: " << result);
+
+  std::vector<d::log_msg> logs{
+    d::log_msg{dsv_inconsistant_column_count,dsv_log_error,
+      {"3","3","2","3",filepath.string()}},
+    d::log_msg{dsv_inconsistant_column_count,dsv_log_error,
+      {"5","5","2","1",filepath.string()}},
+    d::log_msg{dsv_syntax_error,dsv_log_error,
+      {"8","8","2","3",filepath.string()}}
+  };
+
+  BOOST_REQUIRE_MESSAGE(d::check_logs(logs,log_context.recd_logs),
+    "Did not receive the correct log messages:\n"
+      << d::compare_logs(logs,log_context.recd_logs));
+
+  fs::remove(filepath);
+}
+
+/** \test A logger that declines a warning stops the check
+ */
+BOOST_AUTO_TEST_CASE( validate_logger_stop )
+{
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_parser_set_field_columns(parser,-1);
+
+  struct stop {
+    static int logger(dsv_log_code code, dsv_log_level level,
+      const char *params[], size_t size, void *_context)
+    {
+      ++*static_cast<std::size_t*>(_context);
+      return 0;
+    }
+  };
+
+  std::size_t calls = 0;
+  dsv_set_logger_callback(&stop::logger,&calls,dsv_log_all,parser);
+
+  fs::path filepath = gen_file("a,b\r\n1\r\n1,2,3\r\n","validate_logger_stop");
+
+  int result = dsv_validate(filepath.c_str(),0,parser,
+    dsv_validate_all_errors);
+  BOOST_REQUIRE_MESSAGE(result < 0,
+    "dsv_validate did not stop: " << result);
+  BOOST_REQUIRE_MESSAGE(calls == 1,"The logger was called " << calls
+    << " times rather than once");
+
+  fs::remove(filepath);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
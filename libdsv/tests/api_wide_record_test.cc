@@ -0,0 +1,195 @@
+#include <boost/test/unit_test.hpp>
+
+#include <dsv_parser.h>
+#include "test_detail.h"
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+/** \file
+ *  \brief Regression tests for records with very many fields
+ */
+
+
+
+
+/*
+    Count the bytes requested from the global allocator while
+    counting_allocations is set. This includes any allocation made inside
+    the library so the cost of accumulating a record can be measured without
+    relying on the wall clock. Storage comes from malloc which is what the
+    default operator delete releases it with.
+ */
+static std::atomic<bool> counting_allocations(false);
+static std::atomic<std::size_t> allocated_bytes(0);
+
+void * operator new(std::size_t size)
+{
+  if(counting_allocations.load(std::memory_order_relaxed))
+    allocated_bytes.fetch_add(size,std::memory_order_relaxed);
+
+  if(void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+
+
+namespace dsv {
+namespace test {
+
+
+namespace fs=boost::filesystem;
+namespace d=detail;
+
+
+/*
+    Record callback that only counts the fields so that allocations made by
+    the parser dominate
+ */
+struct wide_context {
+  std::size_t header_fields;
+  std::size_t records;
+  std::size_t record_fields;
+  bool content_ok;
+
+  wide_context(void) :header_fields(0), records(0), record_fields(0),
+    content_ok(true) {}
+};
+
+static int wide_header_callback(const unsigned char *fields[],
+  const size_t lengths[], size_t size, void *_context)
+{
+  wide_context &context = *static_cast<wide_context*>(_context);
+
+  context.header_fields = size;
+
+  return 1;
+}
+
+static int wide_record_callback(const unsigned char *fields[],
+  const size_t lengths[], size_t size, void *_context)
+{
+  wide_context &context = *static_cast<wide_context*>(_context);
+
+  ++context.records;
+  context.record_fields += size;
+
+  // spot check the last field, it holds its column number
+  std::string last(fields[size-1],fields[size-1]+lengths[size-1]);
+  if(last != std::to_string(size-1))
+    context.content_ok = false;
+
+  return 1;
+}
+
+/*
+    Generate rows records of columns fields each plus a header and return
+    the number of bytes allocated while parsing the file. Every other field is
+    quoted to exercise both kinds of fields.
+ */
+inline std::size_t parse_wide_file(std::size_t columns, std::size_t rows,
+  const std::string &label)
+{
+  std::vector<d::field_storage_type> contents;
+  for(std::size_t r=0; r<rows+1; ++r) {
+    d::field_storage_type row;
+    for(std::size_t c=0; c<columns; ++c) {
+      std::string field = std::to_string(c);
+      if(c)
+        row.push_back(',');
+      if(c % 2)
+        row.push_back('"');
+      row.insert(row.end(),field.begin(),field.end());
+      if(c % 2)
+        row.push_back('"');
+    }
+    row.push_back(0x0D);
+    row.push_back(0x0A);
+    contents.push_back(row);
+  }
+
+  fs::path filepath = d::gen_testfile(contents,label);
+
+  dsv_parser_t parser;
+  assert(dsv_parser_create(&parser) == 0);
+  std::shared_ptr<dsv_parser_t> parser_sentry(&parser,detail::parser_destroy);
+
+  dsv_operations_t operations;
+  assert(dsv_operations_create(&operations) == 0);
+  std::shared_ptr<dsv_operations_t>
+    operations_sentry(&operations,detail::operations_destroy);
+
+  wide_context context;
+  dsv_set_header_callback(wide_header_callback,&context,operations);
+  dsv_set_record_callback(wide_record_callback,&context,operations);
+
+  allocated_bytes = 0;
+  counting_allocations = true;
+
+  int result = dsv_parse_file_mmap(filepath.c_str(),dsv_mmap_default,parser,
+    operations);
+
+  counting_allocations = false;
+
+  fs::remove(filepath);
+
+  BOOST_REQUIRE_MESSAGE(result == 0,
+    "Parsing " << columns << " columns failed: " << result);
+  BOOST_REQUIRE_MESSAGE(context.header_fields == columns,
+    "Header has " << context.header_fields << " fields, expected "
+      << columns);
+  BOOST_REQUIRE_MESSAGE(context.records == rows
+    && context.record_fields == rows*columns,
+    "Parsed " << context.records << " records with " << context.record_fields
+      << " fields, expected " << rows << " records of " << columns);
+  BOOST_REQUIRE_MESSAGE(context.content_ok,
+    "Fields of a " << columns << " column record were not parsed correctly");
+
+  return allocated_bytes;
+}
+
+
+
+BOOST_AUTO_TEST_SUITE( api_wide_record_suite )
+
+
+/** \test Parse records of 10k, 50k, and 100k fields
+ */
+BOOST_AUTO_TEST_CASE( wide_record_content )
+{
+  parse_wide_file(10000,3,"wide_record_10k");
+  parse_wide_file(50000,3,"wide_record_50k");
+  parse_wide_file(100000,3,"wide_record_100k");
+}
+
+/** \test The memory needed to parse a record must grow linearly with the
+ *  number of fields. Ten times the fields with quadratic accumulation
+ *  allocates a hundred times as much while buffers that grow geometrically
+ *  stay within a small multiple of ten. The count does not depend on
+ *  timing so the bound holds on a loaded machine.
+ */
+BOOST_AUTO_TEST_CASE( wide_record_scaling )
+{
+  std::size_t narrow = parse_wide_file(10000,10,"wide_record_scaling_10k");
+  std::size_t wide = parse_wide_file(100000,10,"wide_record_scaling_100k");
+
+  BOOST_TEST_MESSAGE("10k columns: " << narrow << " bytes, 100k columns: "
+    << wide << " bytes");
+
+  BOOST_REQUIRE_MESSAGE(wide < 30*narrow,
+    "Parsing 100k column records allocated " << wide << " bytes vs "
+      << narrow << " for 10k columns. Field accumulation is no longer "
+      "linear");
+}
+
+
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
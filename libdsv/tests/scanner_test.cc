@@ -1,6 +1,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <scanner_state.h>
+#include <structural_scan.h>
 
 #include <boost/filesystem.hpp>
 
@@ -10,6 +11,7 @@
 #include <sstream>
 #include <memory>
 #include <cstdio>
+#include <vector>
 
 /** \file
  *  \brief Unit tests the scanner
@@ -540,6 +542,191 @@ BOOST_AUTO_TEST_CASE( scanner_putback_refill_test )
 
 
 
+/* CHECK SCANNING OF MEMORY IN PLACE */
+
+/**
+    \test Check for proper handling of an empty memory region
+ */
+BOOST_AUTO_TEST_CASE( scanner_memory_empty_eof_test )
+{
+  const unsigned char *contents = 0;
+
+  d::scanner_state scanner(0,contents,0);
+
+  BOOST_REQUIRE_MESSAGE(scanner.getc() == EOF,
+    "getc: scanner did not return EOF for empty region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.advancec() == EOF,
+    "advancec: scanner did not return EOF for empty region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.fadvancec() == EOF,
+    "fadvancec: scanner did not return EOF for empty region");
+}
+
+/**
+    \test Read a memory region with getc/fadvancec and stop at its length
+ */
+BOOST_AUTO_TEST_CASE( scanner_memory_getc_fadvancec_test )
+{
+  const unsigned char contents[] = {
+    'a','b','c'
+  };
+
+  d::scanner_state scanner(0,contents,2);
+
+  BOOST_REQUIRE_MESSAGE(scanner.getc() == 'a',
+    "getc: scanner did not return 'a' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.fadvancec() == 'a',
+    "fadvancec: scanner did not return 'a' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.fadvancec() == 'b',
+    "fadvancec: scanner did not return 'b' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.getc() == EOF,
+    "follow-on getc: scanner read past the end of the memory region");
+}
+
+/**
+    \test Check that characters read from a memory region are putback as
+    requested
+ */
+BOOST_AUTO_TEST_CASE( scanner_memory_putback_test )
+{
+  const unsigned char contents[] = {
+    'a','b','c'
+  };
+
+  d::scanner_state scanner(0,contents,sizeof(contents));
+
+  BOOST_REQUIRE_MESSAGE(scanner.fadvancec() == 'a',
+    "fadvancec: scanner did not return 'a' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.advancec() == 'b',
+    "advancec: scanner did not return 'b' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.advancec() == 'c',
+    "advancec: scanner did not return 'c' for memory region");
+
+  BOOST_REQUIRE_MESSAGE(scanner.getc() == EOF,
+    "getc: scanner did not return EOF at the end of the memory region");
+
+  scanner.putback();
+
+  BOOST_REQUIRE_MESSAGE(scanner.advancec() == 'b',
+    "advancec: scanner did not return putback 'b' for memory region");
+
+  scanner.forget();
+  scanner.putback();
+
+  BOOST_REQUIRE_MESSAGE(scanner.advancec() == 'c',
+    "advancec: scanner did not return 'c' after forget for memory region");
+}
+
+
+/**
+    \test Check that available, current, and fadvance expose the buffered
+    bytes contiguously and refill once they are consumed
+ */
+BOOST_AUTO_TEST_CASE( scanner_available_fadvance_test )
+{
+  std::vector<unsigned char> contents{'a','b','c','d','e','f'};
+
+  fs::path filepath = gen_testfile(contents,"scanner_available_fadvance_test");
+
+  std::unique_ptr<std::FILE,int(*)(std::FILE *)>
+    in(std::fopen(filepath.c_str(),"rb"),&std::fclose);
+
+  d::scanner_state scanner(0,in.get(),4);
+
+  BOOST_REQUIRE_MESSAGE(scanner.available() == 4,
+    "available: scanner did not fill the buffer");
+  BOOST_REQUIRE_MESSAGE(scanner.current()[0] == 'a'
+    && scanner.current()[3] == 'd',
+    "current: scanner did not expose the buffered bytes");
+
+  scanner.fadvance(3);
+
+  BOOST_REQUIRE_MESSAGE(scanner.available() == 1,
+    "available: scanner did not account for fadvance");
+  BOOST_REQUIRE_MESSAGE(scanner.fadvancec() == 'd',
+    "fadvancec: scanner did not return 'd' after fadvance");
+
+  BOOST_REQUIRE_MESSAGE(scanner.available() == 2,
+    "available: scanner did not refill");
+  scanner.fadvance(2);
+
+  BOOST_REQUIRE_MESSAGE(scanner.available() == 0,
+    "available: scanner did not return 0 at EOF");
+  BOOST_REQUIRE_MESSAGE(scanner.getc() == EOF,
+    "getc: scanner did not return EOF after available returned 0");
+
+  fs::remove(filepath);
+}
+
+/*
+    Check kernel against the scalar implementation for every length up to a
+    few vector widths and every position of each kind of structural byte
+ */
+inline void check_find_structural(d::find_structural_type kernel,
+  const std::string &label)
+{
+  const unsigned char delim = ',';
+  const unsigned char structural[] = {
+    ',',0x22,0x0A,0x0D,0x00,0x1F,0x7F,0x80,0xFF
+  };
+
+  for(std::size_t len=0; len<200; ++len) {
+    std::vector<unsigned char> data(len,'a');
+    for(std::size_t i=0; i<len; ++i)
+      data[i] = 0x20 + (i % 95); // printable, includes ',' and '"'
+
+    for(std::size_t i=0; i<len; ++i) {
+      if(d::is_structural(data[i],delim))
+        data[i] = 'x';
+    }
+
+    BOOST_REQUIRE_MESSAGE(kernel(data.data(),len,delim) == len,
+      label << " found a structural byte in " << len
+        << " ordinary bytes");
+
+    for(std::size_t pos=0; pos<len; ++pos) {
+      for(unsigned char c : structural) {
+        unsigned char save = data[pos];
+        data[pos] = c;
+
+        std::size_t result = kernel(data.data(),len,delim);
+        BOOST_REQUIRE_MESSAGE(result == pos,
+          label << " returned " << result << " for byte " << int(c)
+            << " at " << pos << " of " << len);
+
+        data[pos] = save;
+      }
+    }
+  }
+}
+
+/**
+    \test Check each structural byte kernel supported by the CPU
+ */
+BOOST_AUTO_TEST_CASE( scanner_find_structural_test )
+{
+  check_find_structural(d::find_structural_scalar,"scalar");
+  check_find_structural(d::find_structural,"dispatched");
+
+#ifdef LIBDSV_X86_SIMD
+  check_find_structural(d::find_structural_sse2,"sse2");
+
+  if(__builtin_cpu_supports("avx2"))
+    check_find_structural(d::find_structural_avx2,"avx2");
+
+  if(__builtin_cpu_supports("avx512bw"))
+    check_find_structural(d::find_structural_avx512,"avx512");
+#endif
+}
+
+
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }
@@ -45,8 +45,10 @@
 
 #include <iostream>
 #include <sstream>
+#include <string>
 #include <ctime>
 #include <cstring>
+#include <functional>
 
 #include <boost/filesystem.hpp>
 
@@ -170,6 +172,9 @@ std::string to_string(dsv_log_code code)
     case dsv_unexpected_binary:
       return "dsv_unexpected_binary";
 
+    case dsv_unknown_column:
+      return "dsv_unknown_column";
+
   };
 
   return "unknown code";
@@ -454,18 +459,149 @@ std::string output_fields(
   return out.str();
 }
 
+/*
+  A function that parses the file at the given path. Used to run the same
+  compliance checks through the different input paths of the library.
+*/
+typedef std::function<int(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)> parse_function_type;
+
+inline int stream_parse(const fs::path &filepath, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  std::unique_ptr<std::FILE,int(*)(std::FILE *)>
+    in(std::fopen(filepath.c_str(),"rb"),&std::fclose);
+
+  return dsv_parse(filepath.c_str(),in.get(),parser,operations);
+}
+
+/*
+  Append record i of the content shared by the tests of the parses that divide
+  or spread out the work: an id and two more fields, with escaped newlines
+  and delimiters and D2QUOTE. If ragged, empty and short records are
+  scattered throughout, which needs a parser that allows any column count.
+*/
+inline void append_mixed_record(std::string &contents, std::size_t i,
+  const std::string &newline = "\r\n", bool ragged = true)
+{
+  std::string id = std::to_string(i);
+
+  if(i % 7 == 0)
+    contents += id + ",\"multi" + newline + "line, " + id + "\",x" + newline;
+  else if(i % 7 == 3)
+    contents += id + ",\"say \"\"" + id + "\"\"\"," + id + newline;
+  else if(i % 7 == 5 && ragged)
+    contents += (i % 5 == 0 ? newline : id + newline);
+  else
+    contents += id + ",plain text for " + id + "," + id + newline;
+}
+
+/*
+  A header and mixed records until the content holds at least min_bytes
+*/
+inline std::string mixed_contents(std::size_t min_bytes,
+  const std::string &newline = "\r\n", bool ragged = true)
+{
+  std::string contents = "id,text,value" + newline;
+  for(std::size_t i=0; contents.size() < min_bytes; ++i)
+    append_mixed_record(contents,i,newline,ragged);
+
+  return contents;
+}
+
+/*
+  A header and the given number of records, each an id, a key that takes one
+  of keys values and a text field that holds an escaped newline and
+  delimiter, D2QUOTE, nothing or plain text
+*/
+inline std::string keyed_contents(std::size_t records, std::size_t keys)
+{
+  std::string contents = "id,key,text\r\n";
+  for(std::size_t i=0; i<records; ++i) {
+    std::string id = std::to_string(i);
+    std::string key = "k" + std::to_string((i*7) % keys);
+
+    switch(i % 4) {
+      case 0:
+        contents += id + "," + key + ",\"multi\r\nline, " + id + "\"\r\n";
+        break;
+
+      case 1:
+        contents += id + "," + key + ",\"say \"\"" + id + "\"\"\"\r\n";
+        break;
+
+      case 2:
+        contents += id + "," + key + ",\r\n";
+        break;
+
+      default:
+        contents += id + "," + key + ",plain text for " + id + "\r\n";
+    }
+  }
+
+  return contents;
+}
+
+/*
+  Everything a parse passes on and its result
+*/
+struct parse_result {
+  int result;
+  file_context context;
+  logging_context log_context;
+
+  parse_result(void) :result(0) {}
+};
+
+/*
+  Have the header, record and logger callbacks of parser and operations fill
+  parsed
+*/
+inline void capture_parse(parse_result &parsed, dsv_parser_t parser,
+  dsv_operations_t operations)
+{
+  dsv_set_header_callback(header_callback,&parsed.context,operations);
+  dsv_set_record_callback(record_callback,&parsed.context,operations);
+  dsv_set_logger_callback(logger,&parsed.log_context,dsv_log_all,parser);
+}
+
+/*
+  A parse must return, pass on and log the same as expected, usually a
+  sequential parse of the same content
+*/
+inline void check_same_parse(const parse_result &expected,
+  const parse_result &parsed, const std::string &label)
+{
+  BOOST_REQUIRE_MESSAGE(parsed.result == expected.result,
+    label << ": returned " << parsed.result << " rather than "
+      << expected.result);
+
+  BOOST_REQUIRE_MESSAGE(
+    parsed.context.parsed_headers == expected.context.parsed_headers,
+    label << ": header differs");
+
+  BOOST_REQUIRE_MESSAGE(
+    parsed.context.parsed_records == expected.context.parsed_records,
+    label << ": records differ (" << parsed.context.parsed_records.size()
+      << " rather than " << expected.context.parsed_records.size() << ")");
+
+  BOOST_REQUIRE_MESSAGE(
+    check_logs(expected.log_context.recd_logs,parsed.log_context.recd_logs),
+    label << ": logs differ:\n"
+      << compare_logs(expected.log_context.recd_logs,
+        parsed.log_context.recd_logs));
+}
+
 void check_compliance(dsv_parser_t parser,
   const std::vector<std::vector<field_storage_type> > &headers,
   const std::vector<std::vector<field_storage_type> > &records,
   const std::vector<log_msg> &log_msgs,
   const std::vector<field_storage_type> contents,
-  const std::string &label, int expected_result)
+  const std::string &label, int expected_result,
+  const parse_function_type &parse_fn = stream_parse)
 {
   fs::path filepath = gen_testfile(contents,label);
 
-  std::unique_ptr<std::FILE,int(*)(std::FILE *)>
-    in(std::fopen(filepath.c_str(),"rb"),&std::fclose);
-
   detail::logging_context log_context;
   dsv_set_logger_callback(detail::logger,&log_context,dsv_log_all,parser);
 
@@ -478,7 +614,7 @@ void check_compliance(dsv_parser_t parser,
   dsv_set_header_callback(header_callback,&context,operations);
   dsv_set_record_callback(record_callback,&context,operations);
 
-  int result = dsv_parse(filepath.c_str(),in.get(),parser,operations);
+  int result = parse_fn(filepath,parser,operations);
   if(result != expected_result) {
     std::stringstream out;
     out << "dsv_parse returned with unexpected code: " << result << ", expecting "
@@ -522,7 +658,6 @@ void check_compliance(dsv_parser_t parser,
     << compare_logs(log_msgs,log_context.recd_logs));
 
   // if here, then delete the test file
-  in.reset(0);
   fs::remove(filepath);
 }
 